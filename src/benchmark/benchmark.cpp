@@ -23,6 +23,15 @@
 #include <cstring>
 #include <memory>
 #include <type_traits>
+#include <thread>
+
+#if !defined(_MSC_VER)
+#include <iconv.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
 
 #ifndef __SSE4_1__
 #define __SSE4_1__
@@ -35,6 +44,24 @@
 #include "utf8-encoding/fromutf8-sse.h"
 #include "utf8-encoding/utf8_utils.h"
 #include "utf8-encoding/utf8_decode_sse.h"
+#include "utf8-encoding/utf8_decode_sse2.h"
+#include "utf8-encoding/utf8_decode_sse_table.h"
+#include "utf8-encoding/utf8_decode_avx2.h"
+#include "utf8-encoding/utf8_decode_avx512.h"
+#include "utf8-encoding/utf8_encode_sse.h"
+#include "utf8-encoding/utf8_encode_avx2.h"
+#include "utf8-encoding/utf8_decode_utf32_sse.h"
+#include "utf8-encoding/utf8_decode_utf32_avx2.h"
+#include "utf8-encoding/utf8_encode_utf32_sse.h"
+#include "utf8-encoding/utf8_encode_utf32_avx2.h"
+#include "utf8-encoding/utf8_latin1_sse.h"
+#include "utf8-encoding/utf8_gb18030.h"
+#include "utf8-encoding/utf8_stream_decoder.h"
+#include "utf8-encoding/utf8_index.h"
+#include "utf8-encoding/utf8_parallel.h"
+#include "utf8-encoding/utf8_validate.h"
+#include "utf8-encoding/utf8_dispatch.h"
+#include "utf8-encoding/asm/asmlib.h"
 
 #include "CmdLine.h"
 #include "CPUWarmUp.h"
@@ -238,6 +265,83 @@ void * mb4_buffer_fill(void * buf, size_t size)
     return p;
 }
 
+//
+// Fill buffer with random characters, ascii_ratio percent of them are ASCII,
+// the others are 2 or 3 bytes sequences.
+//
+static
+void * mb3_buffer_fill_ascii(void * buf, size_t size, uint32_t ascii_ratio)
+{
+    char * p = (char *)buf;
+    char * end = p + size;
+    while ((p + 3) <= end) {
+        uint32_t code_point;
+        if ((next_random_u32() % 100) < ascii_ratio) {
+            code_point = get_range_u32<32, 128>(next_random_u32());
+        } else {
+            do {
+                code_point = rand_unicode();
+            } while (code_point < 0x80u);
+        }
+        std::size_t skip = utf8::utf8_encode(code_point, p);
+        p += skip;
+    }
+    while (p < end) {
+        *p++ = (uint8_t)((rand() % 127) + 1);
+    }
+    return p;
+}
+
+//
+// Fill buffer with the random Cyrillic or Greek words (2 bytes sequences),
+// separated by the spaces and some ASCII punctuations.
+//
+static
+void * mb2_buffer_fill(void * buf, size_t size)
+{
+    static const char kPunctuations[] = ",.;:!?-";
+
+    char * p = (char *)buf;
+    char * end = p + size;
+    while ((p + 32) <= end) {
+        uint32_t word_len = get_range_u32<2, 12>(next_random_u32());
+        bool is_greek = ((next_random_u32() % 4) == 0);
+        for (uint32_t i = 0; i < word_len; i++) {
+            uint32_t code_point;
+            if (is_greek)
+                code_point = get_range_u32<0x03B1, 0x03CA>(next_random_u32());
+            else
+                code_point = get_range_u32<0x0410, 0x0450>(next_random_u32());
+            p += utf8::utf8_encode(code_point, p);
+        }
+        if ((next_random_u32() % 8) == 0)
+            *p++ = kPunctuations[next_random_u32() % (sizeof(kPunctuations) - 1)];
+        *p++ = ' ';
+    }
+    while (p < end) {
+        *p++ = (uint8_t)((rand() % 127) + 1);
+    }
+    return p;
+}
+
+//
+// Fill buffer with the random Latin-1 (ISO-8859-1) text, ascii_ratio percent of
+// the characters are ASCII, the others are in [0xA0, 0xFF].
+//
+static
+void * latin1_buffer_fill(void * buf, size_t size, uint32_t ascii_ratio)
+{
+    uint8_t * p = (uint8_t *)buf;
+    uint8_t * end = p + size;
+    while (p < end) {
+        if ((next_random_u32() % 100) < ascii_ratio)
+            *p++ = (uint8_t)get_range_u32<32, 128>(next_random_u32());
+        else
+            *p++ = (uint8_t)get_range_u32<0xA0, 0x100>(next_random_u32());
+    }
+    return p;
+}
+
 static
 uint64_t mb3_buffer_decode_checksum(void * buf, size_t size)
 {
@@ -289,6 +393,46 @@ size_t mb3_buffer_decode(void * buf, size_t size, void * output)
     return (size_t)(unicode - unicode_first);
 }
 
+//
+// The code points above 0xFFFF are output as the UTF-16 surrogate pairs.
+//
+static
+size_t mb4_buffer_decode(void * buf, size_t size, void * output)
+{
+    char * p = (char *)buf;
+    char * end = p + size;
+    uint16_t * unicode = (uint16_t *)output;
+    uint16_t * unicode_first = (uint16_t *)output;
+    while ((p + 4) <= end) {
+        size_t skip;
+        uint32_t code_point = utf8::utf8_decode(p, skip);
+        if (code_point <= 0xFFFFu) {
+            *unicode++ = code_point;
+        } else {
+            code_point -= 0x10000u;
+            *unicode++ = (uint16_t)(0xD800u | (code_point >> 10u));
+            *unicode++ = (uint16_t)(0xDC00u | (code_point & 0x03FFu));
+        }
+        p += skip;
+    }
+
+    while (p < end) {
+        size_t skip;
+        uint32_t code_point = utf8::utf8_decode(p, skip);
+        p += skip;
+        if (p > end)
+            break;
+        if (code_point <= 0xFFFFu) {
+            *unicode++ = code_point;
+        } else {
+            code_point -= 0x10000u;
+            *unicode++ = (uint16_t)(0xD800u | (code_point >> 10u));
+            *unicode++ = (uint16_t)(0xDC00u | (code_point & 0x03FFu));
+        }
+    }
+    return (size_t)(unicode - unicode_first);
+}
+
 static inline
 size_t mb3_buffer_decode_sse(void * buf, size_t size, void * output)
 {
@@ -296,6 +440,18 @@ size_t mb3_buffer_decode_sse(void * buf, size_t size, void * output)
     return unicode_len;
 }
 
+static inline
+size_t mb3_buffer_decode_iconv(void * buf, size_t size, void * output)
+{
+    const char * src = (const char *)buf;
+    char * dest = (char *)output;
+    size_t src_left = size;
+    size_t dest_left = size * sizeof(uint16_t);
+    fromUtf8(&src, &src_left, &dest, &dest_left);
+    size_t unicode_len = (size_t)(dest - (char *)output) / sizeof(uint16_t);
+    return unicode_len;
+}
+
 static inline
 size_t mb3_buffer_decode_sse2(void * buf, size_t size, void * output)
 {
@@ -303,6 +459,155 @@ size_t mb3_buffer_decode_sse2(void * buf, size_t size, void * output)
     return unicode_len;
 }
 
+//
+// Decode the buffer by the chunks of 64 KiB, like a stream read by read() or recv().
+//
+static inline
+size_t mb3_buffer_decode_stream(void * buf, size_t size, void * output)
+{
+    static const size_t kChunkSize = 64 * 1024;
+
+    const char * src = (const char *)buf;
+    uint16_t * unicode = (uint16_t *)output;
+    utf8::Utf8StreamDecoder decoder;
+    size_t unicode_len = 0;
+    for (size_t offset = 0; offset < size; offset += kChunkSize) {
+        size_t chunk_size = ((size - offset) < kChunkSize) ? (size - offset) : kChunkSize;
+        unicode_len += decoder.decode(src + offset, chunk_size, unicode + unicode_len);
+    }
+    decoder.finish();
+    return unicode_len;
+}
+
+static inline
+size_t mb3_buffer_decode_sse_validate(void * buf, size_t size, void * output)
+{
+    size_t error_offset;
+    size_t unicode_len = fromUtf8_sse_validate((const char *)buf, size, (uint16_t *)output, &error_offset);
+    if (error_offset != size) {
+        printf("fromUtf8_sse_validate(): invalid sequence at offset %" PRIuPTR "\n\n", error_offset);
+    }
+    return unicode_len;
+}
+
+//
+// The length kernels only count the UTF-16 code units, the output is not used.
+//
+static inline
+size_t mb3_buffer_length_scalar(void * buf, size_t size, void * output)
+{
+    (void)output;
+    return utf8::utf16_length_from_utf8_scalar((const char *)buf, size);
+}
+
+#if UTF8_HAVE_SSE2
+static inline
+size_t mb3_buffer_length_sse2(void * buf, size_t size, void * output)
+{
+    (void)output;
+    return utf8::utf16_length_from_utf8_sse((const char *)buf, size);
+}
+#endif
+
+#if defined(__AVX2__)
+static inline
+size_t mb3_buffer_length_avx2(void * buf, size_t size, void * output)
+{
+    (void)output;
+    return utf8::utf16_length_from_utf8_avx2((const char *)buf, size);
+}
+#endif
+
+static inline
+size_t mb3_buffer_length_dispatch(void * buf, size_t size, void * output)
+{
+    (void)output;
+    return utf16_length_from_utf8((const char *)buf, size);
+}
+
+#if UTF8_HAVE_SSE2
+static inline
+size_t mb3_buffer_count_sse2(void * buf, size_t size, void * output)
+{
+    (void)output;
+    return utf8::count_code_points_sse((const char *)buf, size);
+}
+#endif
+
+static inline
+size_t mb3_buffer_count_dispatch(void * buf, size_t size, void * output)
+{
+    (void)output;
+    return count_code_points((const char *)buf, size);
+}
+
+// Returns the code points, the checkpoints of every 256 code points are recorded.
+static inline
+size_t mb3_buffer_index_build(void * buf, size_t size, void * output)
+{
+    (void)output;
+    utf8::Utf8CodePointIndex index;
+    index.build((const char *)buf, size);
+    return index.code_points();
+}
+
+// Returns the code points, the sum of the histogram.
+static inline
+size_t mb3_buffer_histogram_dispatch(void * buf, size_t size, void * output)
+{
+    (void)output;
+    size_t histogram[4];
+    utf8_seq_histogram((const char *)buf, size, histogram);
+    return (histogram[0] + histogram[1] + histogram[2] + histogram[3]);
+}
+
+static inline
+size_t mb3_buffer_decode_dispatch(void * buf, size_t size, void * output)
+{
+    size_t unicode_len = utf8_decode_dispatch((const char *)buf, size, (uint16_t *)output);
+    return unicode_len;
+}
+
+static inline
+size_t mb3_buffer_decode_asm(void * buf, size_t size, void * output)
+{
+    size_t unicode_len = utf8_decode_sse41((const char *)buf, size, (uint16_t *)output);
+    return unicode_len;
+}
+
+static inline
+size_t mb3_buffer_decode_sse_table(void * buf, size_t size, void * output)
+{
+    return utf8::utf8_decode_sse_table((const char *)buf, size, (uint16_t *)output);
+}
+
+#if UTF8_HAVE_SSE2
+static inline
+size_t mb3_buffer_decode_sse2_only(void * buf, size_t size, void * output)
+{
+    size_t unicode_len = utf8::utf8_decode_sse2((const char *)buf, size, (uint16_t *)output);
+    return unicode_len;
+}
+#endif
+
+#if defined(__AVX2__)
+static inline
+size_t mb3_buffer_decode_avx2(void * buf, size_t size, void * output)
+{
+    size_t unicode_len = utf8::utf8_decode_avx2((const char *)buf, size, (uint16_t *)output);
+    return unicode_len;
+}
+#endif
+
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+static inline
+size_t mb3_buffer_decode_avx512(void * buf, size_t size, void * output)
+{
+    size_t unicode_len = utf8::utf8_decode_avx512((const char *)buf, size, (uint16_t *)output);
+    return unicode_len;
+}
+#endif
+
 uint64_t unicode16_buffer_checksum(uint16_t * unicode_text, size_t unicode_len)
 {
     uint64_t check_sum = 0;
@@ -382,9 +687,25 @@ void unicode16_buffer_save(const char * filename, const uint16_t * buffer, size_
     }
 }
 
+//
+// The bytes of the UTF-16 output of a UTF-8 text: the exact code units counted by
+// utf16_length_from_utf8(), and 64 units more, the SSE and AVX2 kernels store
+// a block of 16 units beyond the last code unit, the asm kernels a whole one.
+//
+static
+size_t unicode16_buffer_size(const void * utf8_text, size_t text_size)
+{
+    static const size_t kBlockUnits = 64;
+
+    size_t unicode_len = utf16_length_from_utf8((const char *)utf8_text, text_size);
+    printf("utf16_length_from_utf8() = %" PRIuPTR " units, %0.2f MiB (the worst case %0.2f MiB)\n\n",
+           unicode_len, (double)(unicode_len * sizeof(uint16_t)) / MiB, (double)(text_size * sizeof(uint16_t)) / MiB);
+    return (unicode_len + kBlockUnits) * sizeof(uint16_t);
+}
+
 void rand_mb3_benchmark(size_t text_capacity, bool save_to_file)
 {
-    size_t unicode_len_0, unicode_len_1, unicode_len_2;
+    size_t unicode_len_0 = 0, unicode_len_1 = 0, unicode_len_2 = 0, unicode_len_3 = 0, unicode_len_4 = 0, unicode_len_5 = 0, unicode_len_6 = 0, unicode_len_7 = 0, unicode_len_8 = 0;
 
     printf("----------------------------------------------------------------------\n\n");
     printf("rand_mb3_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
@@ -392,21 +713,55 @@ void rand_mb3_benchmark(size_t text_capacity, bool save_to_file)
 
     size_t textSize         = text_capacity;
     size_t utf8_BufSize     = textSize * sizeof(char);
-    size_t utf16_BufSize    = textSize * sizeof(uint16_t);
     void * utf8_text        = (void *)malloc(utf8_BufSize);
+    if (utf8_text == nullptr)
+        return;
+
+    // Gerenate random unicode chars (Multi-bytes <= 3)
+    mb3_buffer_fill(utf8_text, utf8_BufSize);
+
+    size_t utf16_BufSize    = unicode16_buffer_size(utf8_text, utf8_BufSize);
     void * unicode_text_0   = (void *)malloc(utf16_BufSize);
     void * unicode_text_1   = (void *)malloc(utf16_BufSize);
     void * unicode_text_2   = (void *)malloc(utf16_BufSize);
+#if defined(__AVX2__)
+    void * unicode_text_3   = (void *)malloc(utf16_BufSize);
+#else
+    void * unicode_text_3   = nullptr;
+#endif
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+    void * unicode_text_4   = (void *)malloc(utf16_BufSize);
+#else
+    void * unicode_text_4   = nullptr;
+#endif
+    void * unicode_text_5   = (void *)malloc(utf16_BufSize);
+    void * unicode_text_6   = (void *)malloc(utf16_BufSize);
+    void * unicode_text_7   = (void *)malloc(utf16_BufSize);
+#if UTF8_HAVE_SSE2
+    void * unicode_text_8   = (void *)malloc(utf16_BufSize);
+#else
+    void * unicode_text_8   = nullptr;
+#endif
     if (utf8_text != nullptr) {
         printf("buffer init begin.\n");
-        // Gerenate random unicode chars (Multi-bytes <= 3)
-        mb3_buffer_fill(utf8_text, utf8_BufSize);
         if (unicode_text_0 != nullptr)
             std::memset(unicode_text_0, 0, utf16_BufSize);
         if (unicode_text_1 != nullptr)
             std::memset(unicode_text_1, 0, utf16_BufSize);
         if (unicode_text_2 != nullptr)
             std::memset(unicode_text_2, 0, utf16_BufSize);
+        if (unicode_text_3 != nullptr)
+            std::memset(unicode_text_3, 0, utf16_BufSize);
+        if (unicode_text_4 != nullptr)
+            std::memset(unicode_text_4, 0, utf16_BufSize);
+        if (unicode_text_5 != nullptr)
+            std::memset(unicode_text_5, 0, utf16_BufSize);
+        if (unicode_text_6 != nullptr)
+            std::memset(unicode_text_6, 0, utf16_BufSize);
+        if (unicode_text_7 != nullptr)
+            std::memset(unicode_text_7, 0, utf16_BufSize);
+        if (unicode_text_8 != nullptr)
+            std::memset(unicode_text_8, 0, utf16_BufSize);
         printf("buffer init done.\n\n");
 
         test::StopWatch sw;
@@ -424,203 +779,1919 @@ void rand_mb3_benchmark(size_t text_capacity, bool save_to_file)
 
             uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_0, unicode_len);
 
-            printf("utf8::utf8_encode():\n\n");
-            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
-                   check_sum, (double)unicode_len / MiB, unicode_len);
-            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
-                   elapsed_time * kMillisecs, throughput, tick);
-        }
+            printf("utf8::utf8_encode():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+        if (unicode_text_1 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse(utf8_text, utf8_BufSize, unicode_text_1);
+            sw.stop();
+
+            unicode_len_1 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_1, unicode_len);
+
+            printf("fromUtf8_sse41():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+        if (unicode_text_2 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse2(utf8_text, utf8_BufSize, unicode_text_2);
+            sw.stop();
+
+            unicode_len_2 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_2, unicode_len);
+
+            printf("utf8::utf8_decode_sse():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+#if defined(__AVX2__)
+        if (unicode_text_3 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_avx2(utf8_text, utf8_BufSize, unicode_text_3);
+            sw.stop();
+
+            unicode_len_3 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_3, unicode_len);
+
+            printf("utf8::utf8_decode_avx2():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+#endif
+
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+        if (unicode_text_4 != nullptr && (InstructionSet() >= 17)) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_avx512(utf8_text, utf8_BufSize, unicode_text_4);
+            sw.stop();
+
+            unicode_len_4 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_4, unicode_len);
+
+            printf("utf8::utf8_decode_avx512():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+#endif
+
+        if (unicode_text_5 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse_validate(utf8_text, utf8_BufSize, unicode_text_5);
+            sw.stop();
+
+            unicode_len_5 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_5, unicode_len);
+
+            printf("fromUtf8_sse_validate():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+        if (unicode_text_6 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_dispatch(utf8_text, utf8_BufSize, unicode_text_6);
+            sw.stop();
+
+            unicode_len_6 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_6, unicode_len);
+
+            printf("utf8_decode_dispatch():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+        if (unicode_text_7 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_asm(utf8_text, utf8_BufSize, unicode_text_7);
+            sw.stop();
+
+            unicode_len_7 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_7, unicode_len);
+
+            printf("utf8_decode_sse41() (asm):\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+#if UTF8_HAVE_SSE2
+        if (unicode_text_8 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse2_only(utf8_text, utf8_BufSize, unicode_text_8);
+            sw.stop();
+
+            unicode_len_8 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_8, unicode_len);
+
+            printf("utf8::utf8_decode_sse2():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+#endif
+
+        if (unicode_text_0 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_0.txt", (const uint16_t *)unicode_text_0, unicode_len_0);
+            free(unicode_text_0);
+        }
+        if (unicode_text_1 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_1.txt", (const uint16_t *)unicode_text_1, unicode_len_1);
+            free(unicode_text_1);
+        }
+        if (unicode_text_2 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_2.txt", (const uint16_t *)unicode_text_2, unicode_len_2);
+            free(unicode_text_2);
+        }
+        if (unicode_text_3 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_3.txt", (const uint16_t *)unicode_text_3, unicode_len_3);
+            free(unicode_text_3);
+        }
+        if (unicode_text_4 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_4.txt", (const uint16_t *)unicode_text_4, unicode_len_4);
+            free(unicode_text_4);
+        }
+        if (unicode_text_5 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_5.txt", (const uint16_t *)unicode_text_5, unicode_len_5);
+            free(unicode_text_5);
+        }
+        if (unicode_text_6 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_6.txt", (const uint16_t *)unicode_text_6, unicode_len_6);
+            free(unicode_text_6);
+        }
+        if (unicode_text_7 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_7.txt", (const uint16_t *)unicode_text_7, unicode_len_7);
+            free(unicode_text_7);
+        }
+        if (unicode_text_8 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_unicode_text_8.txt", (const uint16_t *)unicode_text_8, unicode_len_8);
+            free(unicode_text_8);
+        }
+
+        if (save_to_file) {
+            mb_buffer_save("rand_utf8_text.txt", (const char *)utf8_text, utf8_BufSize);
+        }
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+void rand_mb4_benchmark(size_t text_capacity, bool save_to_file)
+{
+    size_t unicode_len_0 = 0, unicode_len_1 = 0, unicode_len_2 = 0, unicode_len_3 = 0, unicode_len_4 = 0;
+
+    printf("----------------------------------------------------------------------\n\n");
+    printf("rand_mb4_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
+           (double)text_capacity / MiB, text_capacity);
+
+    size_t textSize         = text_capacity;
+    size_t utf8_BufSize     = textSize * sizeof(char);
+    void * utf8_text        = (void *)malloc(utf8_BufSize);
+    if (utf8_text == nullptr)
+        return;
+
+    // Gerenate random unicode chars (Multi-bytes <= 4)
+    mb4_buffer_fill(utf8_text, utf8_BufSize);
+
+    size_t utf16_BufSize    = unicode16_buffer_size(utf8_text, utf8_BufSize);
+    void * unicode_text_0   = (void *)malloc(utf16_BufSize);
+    void * unicode_text_1   = (void *)malloc(utf16_BufSize);
+    void * unicode_text_2   = (void *)malloc(utf16_BufSize);
+#if defined(__AVX2__)
+    void * unicode_text_3   = (void *)malloc(utf16_BufSize);
+#else
+    void * unicode_text_3   = nullptr;
+#endif
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+    void * unicode_text_4   = (void *)malloc(utf16_BufSize);
+#else
+    void * unicode_text_4   = nullptr;
+#endif
+    if (utf8_text != nullptr) {
+        printf("buffer init begin.\n");
+        if (unicode_text_0 != nullptr)
+            std::memset(unicode_text_0, 0, utf16_BufSize);
+        if (unicode_text_1 != nullptr)
+            std::memset(unicode_text_1, 0, utf16_BufSize);
+        if (unicode_text_2 != nullptr)
+            std::memset(unicode_text_2, 0, utf16_BufSize);
+        if (unicode_text_3 != nullptr)
+            std::memset(unicode_text_3, 0, utf16_BufSize);
+        if (unicode_text_4 != nullptr)
+            std::memset(unicode_text_4, 0, utf16_BufSize);
+        printf("buffer init done.\n\n");
+
+        test::StopWatch sw;
+
+        if (unicode_text_0 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb4_buffer_decode(utf8_text, utf8_BufSize, unicode_text_0);
+            sw.stop();
+
+            unicode_len_0 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_0, unicode_len);
+
+            printf("utf8::utf8_decode():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+        if (unicode_text_1 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse(utf8_text, utf8_BufSize, unicode_text_1);
+            sw.stop();
+
+            unicode_len_1 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_1, unicode_len);
+
+            printf("fromUtf8_sse41():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+        if (unicode_text_2 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse2(utf8_text, utf8_BufSize, unicode_text_2);
+            sw.stop();
+
+            unicode_len_2 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_2, unicode_len);
+
+            printf("utf8::utf8_decode_sse():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+
+#if defined(__AVX2__)
+        if (unicode_text_3 != nullptr) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_avx2(utf8_text, utf8_BufSize, unicode_text_3);
+            sw.stop();
+
+            unicode_len_3 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_3, unicode_len);
+
+            printf("utf8::utf8_decode_avx2():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+#endif
+
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+        if (unicode_text_4 != nullptr && (InstructionSet() >= 17)) {
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_avx512(utf8_text, utf8_BufSize, unicode_text_4);
+            sw.stop();
+
+            unicode_len_4 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_4, unicode_len);
+
+            printf("utf8::utf8_decode_avx512():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMillisecs, throughput, tick);
+        }
+#endif
+
+        if (unicode_text_0 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_mb4_unicode_text_0.txt", (const uint16_t *)unicode_text_0, unicode_len_0);
+            free(unicode_text_0);
+        }
+        if (unicode_text_1 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_mb4_unicode_text_1.txt", (const uint16_t *)unicode_text_1, unicode_len_1);
+            free(unicode_text_1);
+        }
+        if (unicode_text_2 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_mb4_unicode_text_2.txt", (const uint16_t *)unicode_text_2, unicode_len_2);
+            free(unicode_text_2);
+        }
+        if (unicode_text_3 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_mb4_unicode_text_3.txt", (const uint16_t *)unicode_text_3, unicode_len_3);
+            free(unicode_text_3);
+        }
+        if (unicode_text_4 != nullptr) {
+            if (save_to_file)
+                unicode16_buffer_save("rand_mb4_unicode_text_4.txt", (const uint16_t *)unicode_text_4, unicode_len_4);
+            free(unicode_text_4);
+        }
+
+        if (save_to_file) {
+            mb_buffer_save("rand_mb4_utf8_text.txt", (const char *)utf8_text, utf8_BufSize);
+        }
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+static
+void block_stats_print(const utf8::utf8_block_stats_t * stats)
+{
+    size_t total_blocks = stats->ascii_blocks + stats->mb2_blocks + stats->mb3_only_blocks +
+                          stats->ascii_mb3_blocks + stats->mb4_blocks + stats->generic_blocks;
+    double percent = (total_blocks != 0) ? (100.0 / total_blocks) : 0.0;
+
+    printf("blocks: %" PRIuPTR ", ascii: %0.2f%%, mb2: %0.2f%%, mb3 only: %0.2f%%, ascii + mb3: %0.2f%%, "
+           "mb4: %0.2f%%, generic: %0.2f%%\n\n",
+           total_blocks, stats->ascii_blocks * percent, stats->mb2_blocks * percent,
+           stats->mb3_only_blocks * percent, stats->ascii_mb3_blocks * percent,
+           stats->mb4_blocks * percent, stats->generic_blocks * percent);
+}
+
+void text_mb3_benchmark(const char * text_file, bool save_to_file)
+{
+    test::StopWatch sw;
+
+    void * utf8_text = nullptr;
+    printf("read_text_file() begin.\n");
+    sw.start();
+    size_t text_capacity = read_text_file(text_file, &utf8_text);
+    sw.stop();
+    if (text_capacity == 0 || utf8_text == nullptr) {
+        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_capacity);
+        return;
+    }
+    printf("read_text_file() done. time: %0.2f ms\n\n", sw.getElapsedMillisec());
+
+    printf("----------------------------------------------------------------------\n\n");
+    printf("text_mb3_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n",
+           (double)text_capacity / MiB, text_capacity);
+    printf("text_file: \"%s\"\n\n", text_file);
+
+    if (text_capacity >= 20 * MiB) {
+        save_to_file = false;
+    }
+
+    size_t textSize         = text_capacity;
+    size_t utf8_BufSize     = textSize * sizeof(char);
+    size_t utf16_BufSize    = unicode16_buffer_size(utf8_text, utf8_BufSize);
+
+    size_t unicode_len_0 = 0, unicode_len_1 = 0, unicode_len_2 = 0, unicode_len_3 = 0, unicode_len_4 = 0, unicode_len_5 = 0, unicode_len_6 = 0, unicode_len_7 = 0, unicode_len_8 = 0;
+
+    if (utf8_text != nullptr) {
+        printf("buffer0 init begin.\n");
+        void * unicode_text_0 = (void *)malloc(utf16_BufSize);
+        if (unicode_text_0 != nullptr) {
+            std::memset(unicode_text_0, 0, utf16_BufSize);
+            printf("buffer0 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode(utf8_text, utf8_BufSize, unicode_text_0);
+            sw.stop();
+
+            unicode_len_0 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_0, unicode_len);
+
+            printf("utf8::utf8_encode():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_0.txt", (const uint16_t *)unicode_text_0, unicode_len_0);
+            free(unicode_text_0);
+            unicode_text_0 = nullptr;
+        }
+
+        printf("buffer1 init begin.\n");
+        void * unicode_text_1   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_1 != nullptr) {
+            std::memset(unicode_text_1, 0, utf16_BufSize);
+            printf("buffer1 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse(utf8_text, utf8_BufSize, unicode_text_1);
+            sw.stop();
+
+            unicode_len_1 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_1, unicode_len);
+
+            printf("fromUtf8_sse41():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_1.txt", (const uint16_t *)unicode_text_1, unicode_len_1);
+            free(unicode_text_1);
+            unicode_text_1 = nullptr;
+        }
+
+        printf("buffer2 init begin.\n");
+        void * unicode_text_2   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_2 != nullptr) {
+            std::memset(unicode_text_2, 0, utf16_BufSize);
+            printf("buffer2 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse2(utf8_text, utf8_BufSize, unicode_text_2);
+            sw.stop();
+
+            unicode_len_2 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_2, unicode_len);
+
+            printf("utf8::utf8_decode_sse():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_2.txt", (const uint16_t *)unicode_text_2, unicode_len_2);
+
+            // The hit rate of the block kernels
+            utf8::utf8_block_stats_t stats = { 0 };
+            utf8::utf8_decode_sse_stats((const char *)utf8_text, utf8_BufSize, (uint16_t *)unicode_text_2, &stats);
+            block_stats_print(&stats);
+            free(unicode_text_2);
+            unicode_text_2 = nullptr;
+        }
+
+#if defined(__AVX2__)
+        printf("buffer3 init begin.\n");
+        void * unicode_text_3   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_3 != nullptr) {
+            std::memset(unicode_text_3, 0, utf16_BufSize);
+            printf("buffer3 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_avx2(utf8_text, utf8_BufSize, unicode_text_3);
+            sw.stop();
+
+            unicode_len_3 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_3, unicode_len);
+
+            printf("utf8::utf8_decode_avx2():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_3.txt", (const uint16_t *)unicode_text_3, unicode_len_3);
+            free(unicode_text_3);
+            unicode_text_3 = nullptr;
+        }
+#endif
+
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+        printf("buffer4 init begin.\n");
+        void * unicode_text_4   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_4 != nullptr && (InstructionSet() >= 17)) {
+            std::memset(unicode_text_4, 0, utf16_BufSize);
+            printf("buffer4 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_avx512(utf8_text, utf8_BufSize, unicode_text_4);
+            sw.stop();
+
+            unicode_len_4 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_4, unicode_len);
+
+            printf("utf8::utf8_decode_avx512():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_4.txt", (const uint16_t *)unicode_text_4, unicode_len_4);
+        }
+        if (unicode_text_4 != nullptr) {
+            free(unicode_text_4);
+            unicode_text_4 = nullptr;
+        }
+#endif
+
+        printf("buffer5 init begin.\n");
+        void * unicode_text_5   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_5 != nullptr) {
+            std::memset(unicode_text_5, 0, utf16_BufSize);
+            printf("buffer5 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse_validate(utf8_text, utf8_BufSize, unicode_text_5);
+            sw.stop();
+
+            unicode_len_5 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_5, unicode_len);
+
+            printf("fromUtf8_sse_validate():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_5.txt", (const uint16_t *)unicode_text_5, unicode_len_5);
+            free(unicode_text_5);
+            unicode_text_5 = nullptr;
+        }
+
+        printf("buffer6 init begin.\n");
+        void * unicode_text_6   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_6 != nullptr) {
+            std::memset(unicode_text_6, 0, utf16_BufSize);
+            printf("buffer6 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_dispatch(utf8_text, utf8_BufSize, unicode_text_6);
+            sw.stop();
+
+            unicode_len_6 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_6, unicode_len);
+
+            printf("utf8_decode_dispatch():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_6.txt", (const uint16_t *)unicode_text_6, unicode_len_6);
+            free(unicode_text_6);
+            unicode_text_6 = nullptr;
+        }
+
+        printf("buffer7 init begin.\n");
+        void * unicode_text_7   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_7 != nullptr) {
+            std::memset(unicode_text_7, 0, utf16_BufSize);
+            printf("buffer7 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_asm(utf8_text, utf8_BufSize, unicode_text_7);
+            sw.stop();
+
+            unicode_len_7 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_7, unicode_len);
+
+            printf("utf8_decode_sse41() (asm):\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_7.txt", (const uint16_t *)unicode_text_7, unicode_len_7);
+            free(unicode_text_7);
+            unicode_text_7 = nullptr;
+        }
+
+#if UTF8_HAVE_SSE2
+        printf("buffer8 init begin.\n");
+        void * unicode_text_8   = (void *)malloc(utf16_BufSize);
+        if (unicode_text_8 != nullptr) {
+            std::memset(unicode_text_8, 0, utf16_BufSize);
+            printf("buffer8 init done.\n\n");
+
+            sw.start();
+            std::size_t unicode_len = mb3_buffer_decode_sse2_only(utf8_text, utf8_BufSize, unicode_text_8);
+            sw.stop();
+
+            unicode_len_8 = unicode_len;
+            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
+            double elapsed_time = sw.getElapsedSecond();
+            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
+            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+
+            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_8, unicode_len);
+
+            printf("utf8::utf8_decode_sse2():\n\n");
+            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
+                   check_sum, (double)unicode_len / MiB, unicode_len);
+            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
+                   elapsed_time * kMicrosecs, throughput, tick);
+
+            if (save_to_file)
+                unicode16_buffer_save("unicode_text_8.txt", (const uint16_t *)unicode_text_8, unicode_len_8);
+            free(unicode_text_8);
+            unicode_text_8 = nullptr;
+        }
+#endif
+
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+typedef size_t (*utf8_decode_buffer_func_t)(void * buf, size_t size, void * output);
+
+static
+void decode_func_benchmark(const char * name, utf8_decode_buffer_func_t decode_func,
+                           void * utf8_text, size_t text_size, void * unicode_text, size_t repeat_times)
+{
+    test::StopWatch sw;
+
+    size_t unicode_len = 0;
+    sw.start();
+    for (size_t i = 0; i < repeat_times; i++) {
+        unicode_len += decode_func(utf8_text, text_size, unicode_text);
+    }
+    sw.stop();
+
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)text_size * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
+
+    printf("%-32s unicode_len = %-10" PRIuPTR " throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, unicode_len / repeat_times, throughput, tick);
+}
+
+static
+void decode_funcs_benchmark(void * utf8_text, size_t text_size, size_t repeat_times)
+{
+    // The SIMD kernels store a whole block beyond the last code unit.
+    void * unicode_text = (void *)malloc((text_size + 64) * sizeof(uint16_t));
+    if (unicode_text == nullptr)
+        return;
+
+    size_t histogram[4];
+    utf8_seq_histogram((const char *)utf8_text, text_size, histogram);
+    printf("sequences: 1 byte: %" PRIuPTR ", 2 bytes: %" PRIuPTR ", 3 bytes: %" PRIuPTR ", 4 bytes: %" PRIuPTR "\n\n",
+           histogram[0], histogram[1], histogram[2], histogram[3]);
+
+    decode_func_benchmark("utf8::utf8_decode()", mb4_buffer_decode,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("fromUtf8_sse41()", mb3_buffer_decode_sse,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("fromUtf8()", mb3_buffer_decode_iconv,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("utf8::utf8_decode_sse()", mb3_buffer_decode_sse2,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("utf8::utf8_decode_sse_table()", mb3_buffer_decode_sse_table,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("utf8::Utf8StreamDecoder(64K)", mb3_buffer_decode_stream,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#if UTF8_HAVE_SSE2
+    decode_func_benchmark("utf8::utf8_decode_sse2()", mb3_buffer_decode_sse2_only,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#endif
+#if defined(__AVX2__)
+    decode_func_benchmark("utf8::utf8_decode_avx2()", mb3_buffer_decode_avx2,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#endif
+#if defined(UTF8_HAVE_AVX512_VBMI2)
+    if (InstructionSet() >= 17) {
+        decode_func_benchmark("utf8::utf8_decode_avx512()", mb3_buffer_decode_avx512,
+                              utf8_text, text_size, unicode_text, repeat_times);
+    }
+#endif
+    decode_func_benchmark("utf8_decode_dispatch()", mb3_buffer_decode_dispatch,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("utf8_decode_sse41() (asm)", mb3_buffer_decode_asm,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    printf("\n");
+
+    decode_func_benchmark("utf8::utf16_length_from_utf8_scalar()", mb3_buffer_length_scalar,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#if UTF8_HAVE_SSE2
+    decode_func_benchmark("utf8::utf16_length_from_utf8_sse()", mb3_buffer_length_sse2,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#endif
+#if defined(__AVX2__)
+    decode_func_benchmark("utf8::utf16_length_from_utf8_avx2()", mb3_buffer_length_avx2,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#endif
+    decode_func_benchmark("utf16_length_from_utf8()", mb3_buffer_length_dispatch,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    printf("\n");
+
+#if UTF8_HAVE_SSE2
+    decode_func_benchmark("utf8::count_code_points_sse()", mb3_buffer_count_sse2,
+                          utf8_text, text_size, unicode_text, repeat_times);
+#endif
+    decode_func_benchmark("count_code_points()", mb3_buffer_count_dispatch,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("utf8_seq_histogram()", mb3_buffer_histogram_dispatch,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    decode_func_benchmark("utf8::Utf8CodePointIndex::build()", mb3_buffer_index_build,
+                          utf8_text, text_size, unicode_text, repeat_times);
+    printf("\n");
+
+    free(unicode_text);
+}
+
+static
+double text_ascii_ratio(const char * utf8_text, size_t text_size)
+{
+    size_t ascii_count = 0;
+    for (size_t i = 0; i < text_size; i++) {
+        if ((uint8_t)utf8_text[i] < 0x80u)
+            ascii_count++;
+    }
+    return (text_size != 0) ? ((double)ascii_count * 100.0 / text_size) : 0.0;
+}
+
+//
+// The decoders on the random texts of the different ASCII ratios.
+//
+void ascii_ratio_benchmark(size_t text_capacity)
+{
+    static const uint32_t ascii_ratios[] = { 0, 25, 50, 75, 90, 95, 99, 100 };
+
+    printf("----------------------------------------------------------------------\n\n");
+    printf("ascii_ratio_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
+           (double)text_capacity / MiB, text_capacity);
+
+    void * utf8_text = (void *)malloc(text_capacity);
+    if (utf8_text != nullptr) {
+        for (size_t i = 0; i < sizeof(ascii_ratios) / sizeof(ascii_ratios[0]); i++) {
+            mb3_buffer_fill_ascii(utf8_text, text_capacity, ascii_ratios[i]);
+
+            printf("ascii_ratio = %u%% (chars), %0.2f%% (bytes)\n\n", ascii_ratios[i],
+                   text_ascii_ratio((const char *)utf8_text, text_capacity));
+            decode_funcs_benchmark(utf8_text, text_capacity, 1);
+        }
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+//
+// The decoders on the random Cyrillic and Greek texts, mostly 2 bytes sequences.
+//
+void rand_mb2_benchmark(size_t text_capacity)
+{
+    printf("----------------------------------------------------------------------\n\n");
+    printf("rand_mb2_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
+           (double)text_capacity / MiB, text_capacity);
+
+    void * utf8_text = (void *)malloc(text_capacity);
+    if (utf8_text != nullptr) {
+        mb2_buffer_fill(utf8_text, text_capacity);
+
+        printf("ascii_ratio = %0.2f%% (bytes)\n\n",
+               text_ascii_ratio((const char *)utf8_text, text_capacity));
+        decode_funcs_benchmark(utf8_text, text_capacity, 1);
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+//
+// utf8_decode_parallel() by 1 to N threads, N is the number of the CPU cores.
+//
+void parallel_decode_benchmark(size_t text_capacity)
+{
+    test::StopWatch sw;
+
+    printf("----------------------------------------------------------------------\n\n");
+    printf("parallel_decode_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
+           (double)text_capacity / MiB, text_capacity);
+
+    void * utf8_text = (void *)malloc(text_capacity);
+    if (utf8_text != nullptr) {
+        // Gerenate random unicode chars (Multi-bytes <= 3)
+        mb3_buffer_fill(utf8_text, text_capacity);
+
+        size_t utf16_BufSize = unicode16_buffer_size(utf8_text, text_capacity);
+        void * unicode_text = (void *)malloc(utf16_BufSize);
+        if (unicode_text != nullptr) {
+            std::memset(unicode_text, 0, utf16_BufSize);
+
+            unsigned int max_threads = std::thread::hardware_concurrency();
+            if (max_threads == 0)
+                max_threads = 1;
+
+            double throughput_1 = 0.0;
+            for (unsigned int threads = 1; threads <= max_threads; threads++) {
+                sw.start();
+                size_t unicode_len = utf8_decode_parallel((const char *)utf8_text, text_capacity,
+                                                          (uint16_t *)unicode_text, threads);
+                sw.stop();
+
+                double elapsed_time = sw.getElapsedSecond();
+                double throughput = (double)text_capacity / elapsed_time / MiB;
+                if (threads == 1)
+                    throughput_1 = throughput;
+
+                uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text, unicode_len);
+
+                printf("threads = %-3u check_sum = %-12" PRIuPTR " throughput: %8.2f MiB/s, speedup = %0.2fx\n",
+                       threads, check_sum, throughput, throughput / throughput_1);
+            }
+            printf("\n");
+
+            free(unicode_text);
+        }
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+//
+// Fill buffer with the random CJK ideographs (3 bytes sequences).
+//
+static
+void * cjk_buffer_fill(void * buf, size_t size)
+{
+    char * p = (char *)buf;
+    char * end = p + size;
+    while ((p + 3) <= end) {
+        uint32_t code_point = get_range_u32<0x4E00, 0x9FA6>(next_random_u32());
+        p += utf8::utf8_encode(code_point, p);
+    }
+    while (p < end) {
+        *p++ = (uint8_t)((rand() % 127) + 1);
+    }
+    return p;
+}
+
+//
+// Allocate (size) bytes which end at an inaccessible page, so a store beyond
+// them crashes at once. Returns nullptr if the pages can't be allocated.
+//
+static
+void * guard_page_alloc(size_t size, void ** pages, size_t * pages_size)
+{
+#if defined(_MSC_VER)
+    SYSTEM_INFO system_info;
+    ::GetSystemInfo(&system_info);
+    size_t page_size = (size_t)system_info.dwPageSize;
+#else
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    size_t body_size = (size + page_size - 1) / page_size * page_size;
+    *pages_size = body_size + page_size;
+
+#if defined(_MSC_VER)
+    char * base = (char *)::VirtualAlloc(NULL, *pages_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (base == nullptr)
+        return nullptr;
+    DWORD old_protect;
+    ::VirtualProtect(base + body_size, page_size, PAGE_NOACCESS, &old_protect);
+#else
+    char * base = (char *)mmap(NULL, *pages_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (char *)MAP_FAILED)
+        return nullptr;
+    mprotect(base + body_size, page_size, PROT_NONE);
+#endif
+    *pages = (void *)base;
+    return (void *)(base + body_size - size);
+}
+
+static
+void guard_page_free(void * pages, size_t pages_size)
+{
+#if defined(_MSC_VER)
+    (void)pages_size;
+    ::VirtualFree(pages, 0, MEM_RELEASE);
+#else
+    munmap(pages, pages_size);
+#endif
+}
+
+//
+// Decode to a dest which ends at a guard page, sized by the room utf8_dispatch.h
+// asks of each dispatched kernel: utf16_length_from_utf8() units, 16 units more
+// for the SSE and AVX2 kernels. utf8_decode_parallel() gets the exact units,
+// by 1 to 4 threads. A store beyond the room crashes, the output must match the
+// scalar kernel. Returns the failed cases.
+//
+int decode_guard_page_test()
+{
+    typedef void * (*text_fill_func_t)(void * buf, size_t size);
+
+    static const size_t kTextSizes[] = { 1, 15, 16, 63, 64, 65, 127, 1000, 4 * KiB + 3, 2 * MiB + 5 };
+    static const size_t kMaxTextSize = 2 * MiB + 5;
+    static const size_t kBlockUnits = 16;
+
+    struct text_type_t {
+        const char *        name;
+        text_fill_func_t    fill_func;
+    };
+
+    static const text_type_t kTextTypes[] = {
+        { "mb2", mb2_buffer_fill },
+        { "mb3", mb3_buffer_fill },
+        { "mb4", mb4_buffer_fill },
+        { "cjk", cjk_buffer_fill },
+    };
+
+    printf("----------------------------------------------------------------------\n\n");
+    printf("decode_guard_page_test(): kernel = %s\n\n", utf8_kernel_name(utf8_decode_kernel()));
+
+    int failed = 0;
+    char * utf8_text = (char *)malloc(kMaxTextSize);
+    uint16_t * expected = (uint16_t *)malloc(kMaxTextSize * sizeof(uint16_t));
+    if (utf8_text != nullptr && expected != nullptr) {
+        for (size_t t = 0; t < sizeof(kTextTypes) / sizeof(kTextTypes[0]); t++) {
+            for (size_t i = 0; i < sizeof(kTextSizes) / sizeof(kTextSizes[0]); i++) {
+                size_t text_size = kTextSizes[i];
+                kTextTypes[t].fill_func(utf8_text, text_size);
+
+                size_t unicode_len = utf16_length_from_utf8(utf8_text, text_size);
+                size_t expected_len = utf8::utf8_decode_scalar(utf8_text, text_size, expected);
+
+                for (int kernel = UTF8_KERNEL_SCALAR; kernel <= (int)UTF8_KERNEL_MAX; kernel++) {
+                    utf8_decode_func_t decode_func = nullptr;
+                    size_t room = unicode_len;
+                    if (kernel < (int)UTF8_KERNEL_MAX) {
+                        decode_func = utf8_decode_get_kernel(kernel);
+                        if (decode_func == nullptr)
+                            continue;
+                        if (kernel != UTF8_KERNEL_SCALAR && kernel != UTF8_KERNEL_AVX512)
+                            room += kBlockUnits;
+                    }
+
+                    // UTF8_KERNEL_MAX is utf8_decode_parallel() by 1 to 4 threads.
+                    unsigned int max_threads = (decode_func != nullptr) ? 1 : 4;
+                    for (unsigned int threads = 1; threads <= max_threads; threads++) {
+                        void * pages;
+                        size_t pages_size;
+                        uint16_t * dest = (uint16_t *)guard_page_alloc(room * sizeof(uint16_t), &pages, &pages_size);
+                        if (dest == nullptr)
+                            continue;
+
+                        size_t decoded_len;
+                        if (decode_func != nullptr)
+                            decoded_len = decode_func(utf8_text, text_size, dest);
+                        else
+                            decoded_len = utf8_decode_parallel(utf8_text, text_size, dest, threads);
+
+                        if (decoded_len != expected_len ||
+                            std::memcmp(dest, expected, expected_len * sizeof(uint16_t)) != 0) {
+                            printf("FAILED: %s, text = %s, text_size = %" PRIuPTR ", threads = %u\n",
+                                   (decode_func != nullptr) ? utf8_kernel_name(kernel) : "utf8_decode_parallel()",
+                                   kTextTypes[t].name, text_size, threads);
+                            failed++;
+                        }
+                        guard_page_free(pages, pages_size);
+                    }
+                }
+            }
+        }
+    }
+    free(expected);
+    free(utf8_text);
+
+    printf("decode_guard_page_test(): %s\n\n", (failed == 0) ? "passed" : "failed");
+    printf("----------------------------------------------------------------------\n\n");
+    return failed;
+}
+
+void text_decode_benchmark(const char * text_file)
+{
+#ifndef _DEBUG
+    static const size_t kTotalBytes = 256 * MiB;
+#else
+    static const size_t kTotalBytes = 256 * KiB;
+#endif
+
+    void * utf8_text = nullptr;
+    size_t text_size = read_text_file(text_file, &utf8_text);
+    if (text_size == 0 || utf8_text == nullptr) {
+        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_size);
+        if (utf8_text != nullptr)
+            free(utf8_text);
+        return;
+    }
+
+    // The small files are decoded repeatedly, about kTotalBytes in total.
+    size_t repeat_times = (kTotalBytes + text_size - 1) / text_size;
+
+    printf("text_decode_benchmark(): text_file: \"%s\", %" PRIuPTR " bytes x %" PRIuPTR ", ascii_ratio = %0.2f%%\n\n",
+           text_file, text_size, repeat_times, text_ascii_ratio((const char *)utf8_text, text_size));
+
+    decode_funcs_benchmark(utf8_text, text_size, repeat_times);
+
+    free(utf8_text);
+}
+
+static
+void validate_func_benchmark(const char * name, utf8_validate_func_t validate_func,
+                             const char * utf8_text, size_t text_size, size_t repeat_times)
+{
+    test::StopWatch sw;
+
+    size_t valid_count = 0;
+    sw.start();
+    for (size_t i = 0; i < repeat_times; i++) {
+        bool is_valid = validate_func(utf8_text, text_size);
+        valid_count += (is_valid ? 1 : 0);
+    }
+    sw.stop();
+
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)text_size * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
+
+    printf("%-28s valid = %s, throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, ((valid_count == repeat_times) ? "true " : "false"), throughput, tick);
+}
+
+void text_validate_benchmark(const char * text_file)
+{
+#ifndef _DEBUG
+    static const size_t kTotalBytes = 256 * MiB;
+#else
+    static const size_t kTotalBytes = 256 * KiB;
+#endif
+
+    void * utf8_text = nullptr;
+    size_t text_size = read_text_file(text_file, &utf8_text);
+    if (text_size == 0 || utf8_text == nullptr) {
+        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_size);
+        if (utf8_text != nullptr)
+            free(utf8_text);
+        return;
+    }
+
+    // The small files are validated repeatedly, about kTotalBytes in total.
+    size_t repeat_times = (kTotalBytes + text_size - 1) / text_size;
+
+    printf("text_validate_benchmark(): text_file: \"%s\", %" PRIuPTR " bytes x %" PRIuPTR "\n\n",
+           text_file, text_size, repeat_times);
+
+    const char * text = (const char *)utf8_text;
+    validate_func_benchmark("utf8::utf8_validate_scalar()", utf8::utf8_validate_scalar, text, text_size, repeat_times);
+#if defined(__SSE4_1__)
+    validate_func_benchmark("utf8::utf8_validate_sse41()", utf8::utf8_validate_sse41, text, text_size, repeat_times);
+#endif
+#if defined(__AVX2__)
+    validate_func_benchmark("utf8::utf8_validate_avx2()", utf8::utf8_validate_avx2, text, text_size, repeat_times);
+#endif
+#if defined(UTF8_HAVE_AVX512_BW)
+    if (InstructionSet() >= 16) {
+        validate_func_benchmark("utf8::utf8_validate_avx512()", utf8::utf8_validate_avx512, text, text_size, repeat_times);
+    }
+#endif
+    validate_func_benchmark("utf8::validate()", utf8::validate, text, text_size, repeat_times);
+    printf("\n");
+
+    free(utf8_text);
+}
+
+static const char * const kTextFiles[] = {
+    "long_ascii.txt",
+    "long_chinese.txt",
+    "short_ascii.txt",
+    "short_chinese.txt",
+    "video_title_small.txt"
+};
+
+typedef void (*text_benchmark_func_t)(const char * text_file);
+
+//
+// Run text_benchmark on all the files under texts/, in the same directory as text_file.
+//
+static
+void texts_benchmark(const char * text_file, text_benchmark_func_t text_benchmark)
+{
+    if (text_file == nullptr)
+        return;
+
+    std::string text_dir = text_file;
+    size_t pos = text_dir.find_last_of("/\\");
+    if (pos != std::string::npos)
+        text_dir = text_dir.substr(0, pos + 1);
+    else
+        text_dir.clear();
+
+    printf("----------------------------------------------------------------------\n\n");
+
+    for (size_t i = 0; i < sizeof(kTextFiles) / sizeof(kTextFiles[0]); i++) {
+        std::string filename = text_dir + kTextFiles[i];
+        text_benchmark(filename.c_str());
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+void texts_validate_benchmark(const char * text_file)
+{
+    texts_benchmark(text_file, text_validate_benchmark);
+}
+
+void texts_decode_benchmark(const char * text_file)
+{
+    texts_benchmark(text_file, text_decode_benchmark);
+}
+
+typedef size_t (*utf16_encode_buffer_func_t)(const uint16_t * src, size_t len, char * dest);
+
+static
+size_t utf16_encode_scalar(const uint16_t * src, size_t len, char * dest)
+{
+    return utf8::utf16_to_utf8_scalar(src, len, dest);
+}
+
+static
+size_t utf16_encode_sse(const uint16_t * src, size_t len, char * dest)
+{
+    return utf8::utf16_to_utf8_sse(src, len, dest);
+}
+
+#if defined(__AVX2__)
+static
+size_t utf16_encode_avx2(const uint16_t * src, size_t len, char * dest)
+{
+    return utf8::utf16_to_utf8_avx2(src, len, dest);
+}
+#endif
+
+//
+// Encode the UTF-16 text back to UTF-8, the output must be the same as the original text.
+//
+static
+void encode_func_benchmark(const char * name, utf16_encode_buffer_func_t encode_func,
+                           const uint16_t * unicode_text, size_t unicode_len,
+                           const char * utf8_text, size_t text_size,
+                           char * output, size_t repeat_times)
+{
+    test::StopWatch sw;
+
+    size_t output_len = 0;
+    sw.start();
+    for (size_t i = 0; i < repeat_times; i++) {
+        output_len = encode_func(unicode_text, unicode_len, output);
+    }
+    sw.stop();
+
+    bool round_trip_ok = (output_len == text_size) && (std::memcmp(output, utf8_text, text_size) == 0);
+
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)unicode_len * sizeof(uint16_t) * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
+
+    printf("%-32s round trip = %-6s throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, round_trip_ok ? "ok" : "FAILED", throughput, tick);
+}
+
+//
+// Decode the UTF-8 text by utf8_decode_dispatch() (the rest by the scalar
+// decoder), then encode it back by each UTF-16 to UTF-8 encoder.
+//
+static
+void encode_funcs_benchmark(void * utf8_text, size_t text_size, size_t repeat_times)
+{
+    uint16_t * unicode_text = (uint16_t *)malloc((text_size + 64) * sizeof(uint16_t));
+    char * output = (char *)malloc(text_size * 3 + 64);
+    if (unicode_text != nullptr && output != nullptr) {
+        const char * src = (const char *)utf8_text;
+        size_t unicode_len = utf8_decode_dispatch(src, text_size, unicode_text);
+
+        // The consumed bytes of the SIMD decoders, to decode the rest.
+        size_t consumed = 0;
+        for (size_t i = 0; i < unicode_len; i++) {
+            uint16_t unit = unicode_text[i];
+            if (unit < 0x80u)
+                consumed += 1;
+            else if (unit < 0x800u)
+                consumed += 2;
+            else if ((unit & 0xFC00u) == 0xD800u)
+                consumed += 4;
+            else if ((unit & 0xFC00u) != 0xDC00u)
+                consumed += 3;
+        }
+        unicode_len += utf8::utf8_decode_scalar(src + consumed, text_size - consumed, unicode_text + unicode_len);
+
+        encode_func_benchmark("utf8::utf16_to_utf8_scalar()", utf16_encode_scalar, unicode_text, unicode_len,
+                              src, text_size, output, repeat_times);
+        encode_func_benchmark("utf8::utf16_to_utf8_sse()", utf16_encode_sse, unicode_text, unicode_len,
+                              src, text_size, output, repeat_times);
+#if defined(__AVX2__)
+        encode_func_benchmark("utf8::utf16_to_utf8_avx2()", utf16_encode_avx2, unicode_text, unicode_len,
+                              src, text_size, output, repeat_times);
+#endif
+        encode_func_benchmark("utf16_to_utf8()", utf16_to_utf8, unicode_text, unicode_len,
+                              src, text_size, output, repeat_times);
+        printf("\n");
+    }
+
+    if (output != nullptr)
+        free(output);
+    if (unicode_text != nullptr)
+        free(unicode_text);
+}
+
+//
+// The round trip of the random texts: 1 ~ 3 bytes, 1 ~ 4 bytes (surrogate pairs),
+// mostly 2 bytes and mostly ASCII.
+//
+void rand_encode_benchmark(size_t text_capacity)
+{
+    printf("----------------------------------------------------------------------\n\n");
+    printf("rand_encode_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes), kernel = %s\n\n",
+           (double)text_capacity / MiB, text_capacity, utf8_kernel_name(utf16_encode_kernel()));
+
+    void * utf8_text = (void *)malloc(text_capacity);
+    if (utf8_text != nullptr) {
+        printf("mb3_buffer_fill():\n\n");
+        mb3_buffer_fill(utf8_text, text_capacity);
+        encode_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        printf("mb4_buffer_fill():\n\n");
+        mb4_buffer_fill(utf8_text, text_capacity);
+        encode_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        printf("mb2_buffer_fill():\n\n");
+        mb2_buffer_fill(utf8_text, text_capacity);
+        encode_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        printf("mb3_buffer_fill_ascii(95%%):\n\n");
+        mb3_buffer_fill_ascii(utf8_text, text_capacity, 95);
+        encode_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+void text_encode_benchmark(const char * text_file)
+{
+#ifndef _DEBUG
+    static const size_t kTotalBytes = 256 * MiB;
+#else
+    static const size_t kTotalBytes = 256 * KiB;
+#endif
+
+    void * utf8_text = nullptr;
+    size_t text_size = read_text_file(text_file, &utf8_text);
+    if (text_size == 0 || utf8_text == nullptr) {
+        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_size);
+        if (utf8_text != nullptr)
+            free(utf8_text);
+        return;
+    }
+
+    size_t repeat_times = (kTotalBytes + text_size - 1) / text_size;
+
+    printf("text_encode_benchmark(): text_file: \"%s\", %" PRIuPTR " bytes x %" PRIuPTR "\n\n",
+           text_file, text_size, repeat_times);
+
+    encode_funcs_benchmark(utf8_text, text_size, repeat_times);
+
+    free(utf8_text);
+}
+
+void texts_encode_benchmark(const char * text_file)
+{
+    texts_benchmark(text_file, text_encode_benchmark);
+}
+
+typedef size_t (*utf32_decode_buffer_func_t)(const char * src, size_t len, uint32_t * dest);
+
+static
+size_t utf32_decode_scalar(const char * src, size_t len, uint32_t * dest)
+{
+    return utf8::utf8_to_utf32_scalar(src, len, dest);
+}
+
+static
+size_t utf32_decode_sse(const char * src, size_t len, uint32_t * dest)
+{
+    return utf8::utf8_to_utf32_sse(src, len, dest);
+}
+
+#if defined(__AVX2__)
+static
+size_t utf32_decode_avx2(const char * src, size_t len, uint32_t * dest)
+{
+    return utf8::utf8_to_utf32_avx2(src, len, dest);
+}
+#endif
+
+//
+// Decode the UTF-8 text to UTF-32, the output must be the same as the scalar decoder.
+//
+static
+void utf32_func_benchmark(const char * name, utf32_decode_buffer_func_t decode_func,
+                          const char * utf8_text, size_t text_size,
+                          const uint32_t * expected, size_t expected_len,
+                          uint32_t * output, size_t repeat_times)
+{
+    test::StopWatch sw;
+
+    size_t output_len = 0;
+    sw.start();
+    for (size_t i = 0; i < repeat_times; i++) {
+        output_len = decode_func(utf8_text, text_size, output);
+    }
+    sw.stop();
+
+    bool result_ok = (output_len == expected_len) &&
+                     (std::memcmp(output, expected, expected_len * sizeof(uint32_t)) == 0);
+
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)text_size * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
+
+    printf("%-32s result = %-6s throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, result_ok ? "ok" : "FAILED", throughput, tick);
+}
+
+typedef size_t (*utf32_encode_buffer_func_t)(const uint32_t * src, size_t len, char * dest);
+
+static
+size_t utf32_encode_scalar(const uint32_t * src, size_t len, char * dest)
+{
+    return utf8::utf32_to_utf8_scalar(src, len, dest);
+}
+
+static
+size_t utf32_encode_sse(const uint32_t * src, size_t len, char * dest)
+{
+    return utf8::utf32_to_utf8_sse(src, len, dest);
+}
+
+#if defined(__AVX2__)
+static
+size_t utf32_encode_avx2(const uint32_t * src, size_t len, char * dest)
+{
+    return utf8::utf32_to_utf8_avx2(src, len, dest);
+}
+#endif
+
+//
+// Encode the UTF-32 text back to UTF-8, the output must be the same as the original text.
+//
+static
+void utf32_encode_func_benchmark(const char * name, utf32_encode_buffer_func_t encode_func,
+                                 const uint32_t * unicode_text, size_t unicode_len,
+                                 const char * utf8_text, size_t text_size,
+                                 char * output, size_t repeat_times)
+{
+    test::StopWatch sw;
+
+    size_t output_len = 0;
+    sw.start();
+    for (size_t i = 0; i < repeat_times; i++) {
+        output_len = encode_func(unicode_text, unicode_len, output);
+    }
+    sw.stop();
+
+    bool round_trip_ok = (output_len == text_size) && (std::memcmp(output, utf8_text, text_size) == 0);
+
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)unicode_len * sizeof(uint32_t) * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
+
+    printf("%-32s round trip = %-6s throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, round_trip_ok ? "ok" : "FAILED", throughput, tick);
+}
+
+static
+void utf32_funcs_benchmark(void * utf8_text, size_t text_size, size_t repeat_times)
+{
+    uint32_t * expected = (uint32_t *)malloc((text_size + 16) * sizeof(uint32_t));
+    uint32_t * output = (uint32_t *)malloc((text_size + 16) * sizeof(uint32_t));
+    char * encoded = (char *)malloc(text_size * 4 + 8);
+    if (expected != nullptr && output != nullptr) {
+        const char * src = (const char *)utf8_text;
+        size_t expected_len = utf8::utf8_to_utf32_scalar(src, text_size, expected);
+
+        utf32_func_benchmark("utf8::utf8_to_utf32_scalar()", utf32_decode_scalar, src, text_size,
+                             expected, expected_len, output, repeat_times);
+        utf32_func_benchmark("utf8::utf8_to_utf32_sse()", utf32_decode_sse, src, text_size,
+                             expected, expected_len, output, repeat_times);
+#if defined(__AVX2__)
+        utf32_func_benchmark("utf8::utf8_to_utf32_avx2()", utf32_decode_avx2, src, text_size,
+                             expected, expected_len, output, repeat_times);
+#endif
+        printf("\n");
+
+        // Encode the code points back to the original text.
+        if (encoded != nullptr) {
+            utf32_encode_func_benchmark("utf8::utf32_to_utf8_scalar()", utf32_encode_scalar, expected, expected_len,
+                                        src, text_size, encoded, repeat_times);
+            utf32_encode_func_benchmark("utf8::utf32_to_utf8_sse()", utf32_encode_sse, expected, expected_len,
+                                        src, text_size, encoded, repeat_times);
+#if defined(__AVX2__)
+            utf32_encode_func_benchmark("utf8::utf32_to_utf8_avx2()", utf32_encode_avx2, expected, expected_len,
+                                        src, text_size, encoded, repeat_times);
+#endif
+            printf("\n");
+        }
+    }
+
+    if (encoded != nullptr)
+        free(encoded);
+    if (output != nullptr)
+        free(output);
+    if (expected != nullptr)
+        free(expected);
+}
+
+void rand_utf32_benchmark(size_t text_capacity)
+{
+    printf("----------------------------------------------------------------------\n\n");
+    printf("rand_utf32_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
+           (double)text_capacity / MiB, text_capacity);
+
+    void * utf8_text = (void *)malloc(text_capacity);
+    if (utf8_text != nullptr) {
+        printf("mb3_buffer_fill():\n\n");
+        mb3_buffer_fill(utf8_text, text_capacity);
+        utf32_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        printf("mb4_buffer_fill():\n\n");
+        mb4_buffer_fill(utf8_text, text_capacity);
+        utf32_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        printf("mb2_buffer_fill():\n\n");
+        mb2_buffer_fill(utf8_text, text_capacity);
+        utf32_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        printf("mb3_buffer_fill_ascii(95%%):\n\n");
+        mb3_buffer_fill_ascii(utf8_text, text_capacity, 95);
+        utf32_funcs_benchmark(utf8_text, text_capacity, 1);
+
+        free(utf8_text);
+    }
+
+    printf("----------------------------------------------------------------------\n\n");
+}
+
+void text_utf32_benchmark(const char * text_file)
+{
+#ifndef _DEBUG
+    static const size_t kTotalBytes = 256 * MiB;
+#else
+    static const size_t kTotalBytes = 256 * KiB;
+#endif
+
+    void * utf8_text = nullptr;
+    size_t text_size = read_text_file(text_file, &utf8_text);
+    if (text_size == 0 || utf8_text == nullptr) {
+        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_size);
+        if (utf8_text != nullptr)
+            free(utf8_text);
+        return;
+    }
+
+    size_t repeat_times = (kTotalBytes + text_size - 1) / text_size;
 
-        if (unicode_text_1 != nullptr) {
-            sw.start();
-            std::size_t unicode_len = mb3_buffer_decode_sse(utf8_text, utf8_BufSize, unicode_text_1);
-            sw.stop();
+    printf("text_utf32_benchmark(): text_file: \"%s\", %" PRIuPTR " bytes x %" PRIuPTR "\n\n",
+           text_file, text_size, repeat_times);
 
-            unicode_len_1 = unicode_len;
-            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
-            double elapsed_time = sw.getElapsedSecond();
-            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
-            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+    utf32_funcs_benchmark(utf8_text, text_size, repeat_times);
 
-            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_1, unicode_len);
+    free(utf8_text);
+}
 
-            printf("fromUtf8_sse41():\n\n");
-            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
-                   check_sum, (double)unicode_len / MiB, unicode_len);
-            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
-                   elapsed_time * kMillisecs, throughput, tick);
-        }
+void texts_utf32_benchmark(const char * text_file)
+{
+    texts_benchmark(text_file, text_utf32_benchmark);
+}
 
-        if (unicode_text_2 != nullptr) {
-            sw.start();
-            std::size_t unicode_len = mb3_buffer_decode_sse2(utf8_text, utf8_BufSize, unicode_text_2);
-            sw.stop();
+typedef size_t (*latin1_buffer_func_t)(const char * src, size_t len, char * dest);
 
-            unicode_len_2 = unicode_len;
-            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
-            double elapsed_time = sw.getElapsedSecond();
-            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
-            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+static
+size_t latin1_encode_scalar(const char * src, size_t len, char * dest)
+{
+    return utf8::latin1_to_utf8_scalar(src, len, dest);
+}
 
-            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_2, unicode_len);
+static
+size_t latin1_encode_sse(const char * src, size_t len, char * dest)
+{
+    return utf8::latin1_to_utf8_sse(src, len, dest);
+}
 
-            printf("utf8::utf8_decode_sse():\n\n");
-            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
-                   check_sum, (double)unicode_len / MiB, unicode_len);
-            printf("elapsed time: %0.2f ms, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
-                   elapsed_time * kMillisecs, throughput, tick);
-        }
+static
+size_t latin1_encode_iconv(const char * src, size_t len, char * dest)
+{
+    size_t in_bytesleft = len;
+    size_t out_bytesleft = len * 2 + 8;
+    char * out_buf = dest;
+    latin1ToUtf8(&src, &in_bytesleft, &out_buf, &out_bytesleft);
+    return (size_t)(out_buf - dest);
+}
 
-        if (unicode_text_0 != nullptr) {
-            if (save_to_file)
-                unicode16_buffer_save("rand_unicode_text_0.txt", (const uint16_t *)unicode_text_0, unicode_len_0);
-            free(unicode_text_0);
-        }
-        if (unicode_text_1 != nullptr) {
-            if (save_to_file)
-                unicode16_buffer_save("rand_unicode_text_1.txt", (const uint16_t *)unicode_text_1, unicode_len_1);
-            free(unicode_text_1);
-        }
-        if (unicode_text_2 != nullptr) {
-            if (save_to_file)
-                unicode16_buffer_save("rand_unicode_text_2.txt", (const uint16_t *)unicode_text_2, unicode_len_2);
-            free(unicode_text_2);
-        }
+static
+size_t latin1_decode_scalar(const char * src, size_t len, char * dest)
+{
+    size_t consumed;
+    return utf8::utf8_to_latin1_scalar(src, len, dest, &consumed);
+}
 
-        if (save_to_file) {
-            mb_buffer_save("rand_utf8_text.txt", (const char *)utf8_text, utf8_BufSize);
-        }
-        free(utf8_text);
-    }
+static
+size_t latin1_decode_sse(const char * src, size_t len, char * dest)
+{
+    size_t consumed;
+    return utf8::utf8_to_latin1_sse(src, len, dest, &consumed);
+}
 
-    printf("----------------------------------------------------------------------\n\n");
+static
+size_t latin1_decode_iconv(const char * src, size_t len, char * dest)
+{
+    size_t in_bytesleft = len;
+    size_t out_bytesleft = len + 8;
+    char * out_buf = dest;
+    utf8ToLatin1(&src, &in_bytesleft, &out_buf, &out_bytesleft);
+    return (size_t)(out_buf - dest);
 }
 
-void text_mb3_benchmark(const char * text_file, bool save_to_file)
+//
+// Convert the text between Latin-1 and UTF-8, the output must be the same as expected.
+//
+static
+void latin1_func_benchmark(const char * name, latin1_buffer_func_t convert_func,
+                           const char * text, size_t text_size,
+                           const char * expected, size_t expected_len,
+                           char * output, size_t repeat_times)
 {
     test::StopWatch sw;
 
-    void * utf8_text = nullptr;
-    printf("read_text_file() begin.\n");
+    size_t output_len = 0;
     sw.start();
-    size_t text_capacity = read_text_file(text_file, &utf8_text);
+    for (size_t i = 0; i < repeat_times; i++) {
+        output_len = convert_func(text, text_size, output);
+    }
     sw.stop();
-    if (text_capacity == 0 || utf8_text == nullptr) {
-        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_capacity);
-        return;
+
+    bool result_ok = (output_len == expected_len) && (std::memcmp(output, expected, expected_len) == 0);
+
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)text_size * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
+
+    printf("%-32s result = %-6s throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, result_ok ? "ok" : "FAILED", throughput, tick);
+}
+
+static
+void latin1_funcs_benchmark(void * latin1_text, size_t text_size, size_t repeat_times)
+{
+    char * utf8_text = (char *)malloc(text_size * 2 + 8);
+    char * output = (char *)malloc(text_size * 2 + 8);
+    if (utf8_text != nullptr && output != nullptr) {
+        const char * src = (const char *)latin1_text;
+        size_t utf8_len = utf8::latin1_to_utf8_scalar(src, text_size, utf8_text);
+
+        latin1_func_benchmark("utf8::latin1_to_utf8_scalar()", latin1_encode_scalar, src, text_size,
+                              utf8_text, utf8_len, output, repeat_times);
+        latin1_func_benchmark("utf8::latin1_to_utf8_sse()", latin1_encode_sse, src, text_size,
+                              utf8_text, utf8_len, output, repeat_times);
+        latin1_func_benchmark("latin1ToUtf8()", latin1_encode_iconv, src, text_size,
+                              utf8_text, utf8_len, output, repeat_times);
+        printf("\n");
+
+        // Decode the UTF-8 text back to the original text.
+        latin1_func_benchmark("utf8::utf8_to_latin1_scalar()", latin1_decode_scalar, utf8_text, utf8_len,
+                              src, text_size, output, repeat_times);
+        latin1_func_benchmark("utf8::utf8_to_latin1_sse()", latin1_decode_sse, utf8_text, utf8_len,
+                              src, text_size, output, repeat_times);
+        latin1_func_benchmark("utf8ToLatin1()", latin1_decode_iconv, utf8_text, utf8_len,
+                              src, text_size, output, repeat_times);
+        printf("\n");
     }
-    printf("read_text_file() done. time: %0.2f ms\n\n", sw.getElapsedMillisec());
+
+    if (output != nullptr)
+        free(output);
+    if (utf8_text != nullptr)
+        free(utf8_text);
+}
+
+void rand_latin1_benchmark(size_t text_capacity)
+{
+    static const uint32_t kAsciiRatios[] = { 100, 95, 80, 50, 0 };
 
     printf("----------------------------------------------------------------------\n\n");
-    printf("text_mb3_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n",
+    printf("rand_latin1_benchmark(): text_capacity = %0.2f MiB (%" PRIuPTR " bytes)\n\n",
            (double)text_capacity / MiB, text_capacity);
-    printf("text_file: \"%s\"\n\n", text_file);
 
-    if (text_capacity >= 20 * MiB) {
-        save_to_file = false;
+    void * latin1_text = (void *)malloc(text_capacity);
+    if (latin1_text != nullptr) {
+        for (size_t i = 0; i < sizeof(kAsciiRatios) / sizeof(kAsciiRatios[0]); i++) {
+            printf("latin1_buffer_fill(%u%%):\n\n", kAsciiRatios[i]);
+            latin1_buffer_fill(latin1_text, text_capacity, kAsciiRatios[i]);
+            latin1_funcs_benchmark(latin1_text, text_capacity, 1);
+        }
+        free(latin1_text);
     }
 
-    size_t textSize         = text_capacity;
-    size_t utf8_BufSize     = textSize * sizeof(char);
-    size_t utf16_BufSize    = textSize * sizeof(uint16_t);
+    printf("----------------------------------------------------------------------\n\n");
+}
 
-    size_t unicode_len_0, unicode_len_1, unicode_len_2;
+typedef size_t (*gb18030_buffer_func_t)(const char * src, size_t len, char * dest, size_t dest_size);
 
-    if (utf8_text != nullptr) {
-        printf("buffer0 init begin.\n");
-        void * unicode_text_0 = (void *)malloc(utf16_BufSize);
-        if (unicode_text_0 != nullptr) {
-            std::memset(unicode_text_0, 0, utf16_BufSize);
-            printf("buffer0 init done.\n\n");
+static
+size_t gb18030_encode_kernel(const char * src, size_t len, char * dest, size_t dest_size)
+{
+    size_t consumed;
+    (void)dest_size;
+    return utf8_to_gb18030(src, len, dest, &consumed);
+}
 
-            sw.start();
-            std::size_t unicode_len = mb3_buffer_decode(utf8_text, utf8_BufSize, unicode_text_0);
-            sw.stop();
+static
+size_t gb18030_encode_iconv(const char * src, size_t len, char * dest, size_t dest_size)
+{
+    char * out_buf = dest;
+    utf8ToGb18030(&src, &len, &out_buf, &dest_size);
+    return (size_t)(out_buf - dest);
+}
 
-            unicode_len_0 = unicode_len;
-            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
-            double elapsed_time = sw.getElapsedSecond();
-            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
-            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+static
+size_t gb18030_decode_kernel(const char * src, size_t len, char * dest, size_t dest_size)
+{
+    size_t consumed;
+    (void)dest_size;
+    return gb18030_to_utf8(src, len, dest, &consumed);
+}
 
-            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_0, unicode_len);
+static
+size_t gb18030_decode_iconv(const char * src, size_t len, char * dest, size_t dest_size)
+{
+    char * out_buf = dest;
+    gb18030ToUtf8(&src, &len, &out_buf, &dest_size);
+    return (size_t)(out_buf - dest);
+}
 
-            printf("utf8::utf8_encode():\n\n");
-            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
-                   check_sum, (double)unicode_len / MiB, unicode_len);
-            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
-                   elapsed_time * kMicrosecs, throughput, tick);
+#if !defined(_MSC_VER)
 
-            if (save_to_file)
-                unicode16_buffer_save("unicode_text_0.txt", (const uint16_t *)unicode_text_0, unicode_len_0);
-            free(unicode_text_0);
-            unicode_text_0 = nullptr;
-        }
+static
+size_t glibc_iconv(iconv_t cd, const char * src, size_t len, char * dest, size_t dest_size)
+{
+    char * in_buf = (char *)src;
+    char * out_buf = dest;
+    iconv(cd, nullptr, nullptr, nullptr, nullptr);
+    iconv(cd, &in_buf, &len, &out_buf, &dest_size);
+    return (size_t)(out_buf - dest);
+}
 
-        printf("buffer1 init begin.\n");
-        void * unicode_text_1   = (void *)malloc(utf16_BufSize);
-        if (unicode_text_1 != nullptr) {
-            std::memset(unicode_text_1, 0, utf16_BufSize);
-            printf("buffer1 init done.\n\n");
+static
+size_t gb18030_encode_glibc(const char * src, size_t len, char * dest, size_t dest_size)
+{
+    static iconv_t cd = iconv_open("GB18030", "UTF-8");
+    return glibc_iconv(cd, src, len, dest, dest_size);
+}
 
-            sw.start();
-            std::size_t unicode_len = mb3_buffer_decode_sse(utf8_text, utf8_BufSize, unicode_text_1);
-            sw.stop();
+static
+size_t gb18030_decode_glibc(const char * src, size_t len, char * dest, size_t dest_size)
+{
+    static iconv_t cd = iconv_open("UTF-8", "GB18030");
+    return glibc_iconv(cd, src, len, dest, dest_size);
+}
 
-            unicode_len_1 = unicode_len;
-            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
-            double elapsed_time = sw.getElapsedSecond();
-            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
-            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+#endif // !_MSC_VER
 
-            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_1, unicode_len);
+//
+// Convert the text between UTF-8 and GB18030, the output must be the same as expected.
+//
+static
+void gb18030_func_benchmark(const char * name, gb18030_buffer_func_t convert_func,
+                            const char * text, size_t text_size,
+                            const char * expected, size_t expected_len,
+                            char * output, size_t output_size, size_t repeat_times)
+{
+    test::StopWatch sw;
 
-            printf("fromUtf8_sse41():\n\n");
-            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
-                   check_sum, (double)unicode_len / MiB, unicode_len);
-            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
-                   elapsed_time * kMicrosecs, throughput, tick);
+    size_t output_len = 0;
+    sw.start();
+    for (size_t i = 0; i < repeat_times; i++) {
+        output_len = convert_func(text, text_size, output, output_size);
+    }
+    sw.stop();
 
-            if (save_to_file)
-                unicode16_buffer_save("unicode_text_1.txt", (const uint16_t *)unicode_text_1, unicode_len_1);
-            free(unicode_text_1);
-            unicode_text_1 = nullptr;
-        }
+    bool result_ok = (output_len == expected_len) && (std::memcmp(output, expected, expected_len) == 0);
 
-        printf("buffer2 init begin.\n");
-        void * unicode_text_2   = (void *)malloc(utf16_BufSize);
-        if (unicode_text_2 != nullptr) {
-            std::memset(unicode_text_2, 0, utf16_BufSize);
-            printf("buffer2 init done.\n\n");
+    double elapsed_time = sw.getElapsedSecond();
+    double total_bytes = (double)text_size * repeat_times;
+    double throughput = total_bytes / elapsed_time / MiB;
+    double tick = elapsed_time * kNanosecs / total_bytes;
 
-            sw.start();
-            std::size_t unicode_len = mb3_buffer_decode_sse2(utf8_text, utf8_BufSize, unicode_text_2);
-            sw.stop();
+    printf("%-32s result = %-6s throughput: %8.2f MiB/s, tick = %0.3f ns/byte\n",
+           name, result_ok ? "ok" : "FAILED", throughput, tick);
+}
 
-            unicode_len_2 = unicode_len;
-            std::size_t unicode_bytes = unicode_len * sizeof(uint16_t);
-            double elapsed_time = sw.getElapsedSecond();
-            double throughput = (double)utf8_BufSize / elapsed_time / MiB;
-            double tick = elapsed_time * kNanosecs / utf8_BufSize;
+static
+void gb18030_funcs_benchmark(void * utf8_text, size_t text_size, size_t repeat_times)
+{
+    size_t buffer_size = text_size * 2 + 16;
+    char * gb18030_text = (char *)malloc(buffer_size);
+    char * output = (char *)malloc(buffer_size);
+    if (gb18030_text != nullptr && output != nullptr) {
+        const char * src = (const char *)utf8_text;
+        size_t consumed;
+        size_t gb18030_len = utf8_to_gb18030(src, text_size, gb18030_text, &consumed);
+        if (consumed != text_size) {
+            printf("utf8_to_gb18030(): stopped at %" PRIuPTR " of %" PRIuPTR " bytes\n\n", consumed, text_size);
+            text_size = consumed;
+        }
 
-            uint64_t check_sum = unicode16_buffer_checksum((uint16_t *)unicode_text_2, unicode_len);
+        gb18030_func_benchmark("utf8_to_gb18030()", gb18030_encode_kernel, src, text_size,
+                               gb18030_text, gb18030_len, output, buffer_size, repeat_times);
+        gb18030_func_benchmark("utf8ToGb18030()", gb18030_encode_iconv, src, text_size,
+                               gb18030_text, gb18030_len, output, buffer_size, repeat_times);
+#if !defined(_MSC_VER)
+        gb18030_func_benchmark("iconv(UTF-8 to GB18030)", gb18030_encode_glibc, src, text_size,
+                               gb18030_text, gb18030_len, output, buffer_size, repeat_times);
+#endif
+        printf("\n");
 
-            printf("utf8::utf8_decode_sse():\n\n");
-            printf("check_sum = %" PRIuPTR ", unicode_len = %0.2f MiB (%" PRIuPTR ")\n\n",
-                   check_sum, (double)unicode_len / MiB, unicode_len);
-            printf("elapsed time: %0.2f us, throughput: %0.2f MiB/s, tick = %0.3f ns/byte\n\n",
-                   elapsed_time * kMicrosecs, throughput, tick);
+        // Decode the GB18030 text back to the original text.
+        gb18030_func_benchmark("gb18030_to_utf8()", gb18030_decode_kernel, gb18030_text, gb18030_len,
+                               src, text_size, output, buffer_size, repeat_times);
+        gb18030_func_benchmark("gb18030ToUtf8()", gb18030_decode_iconv, gb18030_text, gb18030_len,
+                               src, text_size, output, buffer_size, repeat_times);
+#if !defined(_MSC_VER)
+        gb18030_func_benchmark("iconv(GB18030 to UTF-8)", gb18030_decode_glibc, gb18030_text, gb18030_len,
+                               src, text_size, output, buffer_size, repeat_times);
+#endif
+        printf("\n");
+    }
 
-            if (save_to_file)
-                unicode16_buffer_save("unicode_text_2.txt", (const uint16_t *)unicode_text_2, unicode_len_2);
-            free(unicode_text_2);
-            unicode_text_2 = nullptr;
-        }
+    if (output != nullptr)
+        free(output);
+    if (gb18030_text != nullptr)
+        free(gb18030_text);
+}
 
-        free(utf8_text);
+void text_gb18030_benchmark(const char * text_file)
+{
+#ifndef _DEBUG
+    static const size_t kTotalBytes = 256 * MiB;
+#else
+    static const size_t kTotalBytes = 256 * KiB;
+#endif
+
+    void * utf8_text = nullptr;
+    size_t text_size = read_text_file(text_file, &utf8_text);
+    if (text_size == 0 || utf8_text == nullptr) {
+        printf("ERROR: text_file: %s, text_capacity: %" PRIuPTR " bytes\n\n", text_file, text_size);
+        if (utf8_text != nullptr)
+            free(utf8_text);
+        return;
     }
 
-    printf("----------------------------------------------------------------------\n\n");
+    size_t repeat_times = (kTotalBytes + text_size - 1) / text_size;
+
+    printf("text_gb18030_benchmark(): text_file: \"%s\", %" PRIuPTR " bytes x %" PRIuPTR "\n\n",
+           text_file, text_size, repeat_times);
+
+    gb18030_funcs_benchmark(utf8_text, text_size, repeat_times);
+
+    free(utf8_text);
+}
+
+void texts_gb18030_benchmark(const char * text_file)
+{
+    texts_benchmark(text_file, text_gb18030_benchmark);
 }
 
 void benchmark(const char * text_file)
@@ -633,10 +2704,31 @@ void benchmark(const char * text_file)
     static const size_t kTextSize_save = 16 * KiB;
 #endif
 
+    printf("utf8_decode_dispatch(): kernel = %s\n\n", utf8_kernel_name(utf8_decode_kernel()));
+
     //rand_mb3_benchmark(kTextSize_save, true);
     rand_mb3_benchmark(kTextSize,      false);
 
+    //rand_mb4_benchmark(kTextSize_save, true);
+    rand_mb4_benchmark(kTextSize,      false);
+
     text_mb3_benchmark(text_file, true);
+
+    ascii_ratio_benchmark(kTextSize);
+    rand_mb2_benchmark(kTextSize);
+    parallel_decode_benchmark(kTextSize);
+    texts_decode_benchmark(text_file);
+
+    rand_encode_benchmark(kTextSize);
+    texts_encode_benchmark(text_file);
+
+    rand_utf32_benchmark(kTextSize);
+    texts_utf32_benchmark(text_file);
+
+    rand_latin1_benchmark(kTextSize);
+    texts_gb18030_benchmark(text_file);
+
+    texts_validate_benchmark(text_file);
 }
 
 const char * get_default_text_file()
@@ -1133,6 +3225,11 @@ int main(int argc, char * argv[])
     //is_array_test();
     //variant_test();
 
+    if (decode_guard_page_test() != 0) {
+        read_any_key();
+        return EXIT_FAILURE;
+    }
+
     printf("--input-file: \"%s\"\n\n", config.text_file);
 
     if (0) {
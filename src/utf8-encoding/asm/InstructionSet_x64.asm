@@ -46,6 +46,7 @@
 ; 14 or above = FMA3, F16C, BMI1, BMI2, LZCNT
 ; 15 or above = AVX512F supported
 ; 16 or above = AVX512BW, AVX512DQ, AVX512VL supported
+; 17 or above = AVX512VBMI, AVX512VBMI2 supported
 ;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
@@ -186,7 +187,20 @@ FirstTime:
         bt      ebx, 31                ; AVX512VL
         jnc     ISEND
         inc     eax                    ; 16
-       
+
+        push    rax
+        push    rcx
+        mov     eax, 7
+        xor     ecx, ecx
+        cpuid                          ; check for AVX512VBMI, AVX512VBMI2
+        bt      ecx, 1                 ; AVX512VBMI
+        jnc     IS16
+        bt      ecx, 6                 ; AVX512VBMI2
+IS16:   pop     rcx
+        pop     rax
+        jnc     ISEND
+        inc     eax                    ; 17
+
 ISEND:  mov     [IInstrSet@], eax      ; save value in global variable
 
         pop     rbx
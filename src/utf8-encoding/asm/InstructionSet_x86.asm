@@ -48,6 +48,7 @@
 ; 14 or above = FMA3, F16C, BMI1, BMI2, LZCNT
 ; 15 or above = AVX512F supported
 ; 16 or above = AVX512BW, AVX512DQ, AVX512VL supported
+; 17 or above = AVX512VBMI, AVX512VBMI2 supported
 ;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
@@ -255,6 +256,19 @@ TESTPS   EQU 10CH                      ; position to write TESTDATA = upper part
         jnc     ISEND
         inc     eax                    ; 16
 
+        push    eax
+        push    ecx
+        mov     eax, 7
+        xor     ecx, ecx
+        cpuid                          ; check for AVX512VBMI, AVX512VBMI2
+        bt      ecx, 1                 ; AVX512VBMI
+        jnc     IS16
+        bt      ecx, 6                 ; AVX512VBMI2
+IS16:   pop     ecx
+        pop     eax
+        jnc     ISEND
+        inc     eax                    ; 17
+
 ISEND:  pop     edx                    ; address of _IInstrSet
         mov     [edx], eax             ; save value in public variable _IInstrSet
         pop     ebx
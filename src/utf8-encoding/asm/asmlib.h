@@ -24,6 +24,9 @@
 Define compiler-specific types and directives
 ***********************************************************************/
 
+#include <stdint.h>
+#include <stddef.h>
+
 // Turn off name mangling
 #ifdef __cplusplus
 extern "C" {
@@ -33,8 +36,14 @@ extern "C" {
 Function prototypes, memory and string functions
 ***********************************************************************/
 
-// Search for substring in string
-unsigned int utf8_decode_sse41(const char * utf8, int * skip);
+// Decode UTF-8 to UTF-16, return the number of the output code units.
+// Both versions decode all the whole characters (see utf8_decode_sse()), the
+// SSE4.1 version decodes the last 0 ~ 15 bytes by the generic code.
+size_t utf8_decode_sse41(const char * src, size_t len, uint16_t * dest);
+
+// Direct entries to the CPU-specific versions, without CPU dispatching
+size_t utf8_decode_Generic(const char * src, size_t len, uint16_t * dest);
+size_t utf8_decode_SSE41(const char * src, size_t len, uint16_t * dest);
 
 // Tell which instruction set is supported
 int    InstructionSet(void);
@@ -43,15 +52,6 @@ int    InstructionSet(void);
 }  // end of extern "C"
 #endif
 
-#ifdef __cplusplus
-
-static inline
-unsigned int utf8_decode_sse41(char * utf8, int * skip) {
-   return utf8_decode_sse41((const char *)utf8, skip);
-}  // Overload utf8_decode_sse4_1() with const char * version
-
-#endif
-
 // Test if emmintrin.h is included and __m128i defined
 #if defined(__GNUC__) && defined(_EMMINTRIN_H_INCLUDED) && !defined(__SSE2__)
 #error Please compile with -sse2 or higher 
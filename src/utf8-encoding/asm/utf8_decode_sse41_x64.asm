@@ -4,7 +4,14 @@
 ; Last modified:    2022-04-28
 
 ;
-; Position-independent code is generated if POSITIONINDEPENDENT is defined.
+; C prototype:
+; extern "C" size_t utf8_decode_sse41(const char * src, size_t len, uint16_t * dest);
+;
+; Decode the UTF-8 string to UTF-16, return the number of the output code units.
+; Same as utf8::utf8_decode_sse(), both versions decode all the whole characters,
+; the SSE4.1 version always stores 16 code units per block, and the last 0 ~ 15
+; bytes are decoded by the generic code (decode_chars). The 4 bytes sequences
+; are output as the UTF-16 surrogate pairs, the input is not validated.
 ;
 ; CPU dispatching included for 386 and SSE4.1 instruction sets.
 ;
@@ -20,11 +27,27 @@ global utf8_decode_sse41                ; Function utf8_decode_sse41()
 
 ; Direct entries to CPU-specific versions
 global utf8_decode_Generic              ; Generic version for processors without SSE4.1
-global utf8_decode_SSE41                 ; Version for processors with SSE4.1
+global utf8_decode_SSE41                ; Version for processors with SSE4.1
 
 ; Imported from InstructionSet_x64.asm:
 extern InstructionSet                   ; Instruction set for CPU dispatcher
 
+; define register use
+%ifdef  WINDOWS
+%define arg1       rcx                  ; parameter 1, pointer to src
+%define arg2       rdx                  ; parameter 2, len
+%define arg3       r8                   ; parameter 3, pointer to dest
+%else
+%define arg1       rdi                  ; parameter 1, pointer to src
+%define arg2       rsi                  ; parameter 2, len
+%define arg3       rdx                  ; parameter 3, pointer to dest
+%endif
+
+%define src        r10                  ; pointer to the current UTF-8 character
+%define src_end    r11                  ; src + len
+%define dest       r9                   ; pointer to the output code units
+%define limit      r8                   ; decode_chars stops before the characters beyond it
+
 section .text
 
 ; utf8_decode() function
@@ -36,82 +59,217 @@ global ?OVR_utf8_decode
 
 align 16
 utf8_decode_sse41: ; function dispatching
-        ; jmp     near [utf8Dispatch]   ; Go to appropriate version, depending on instruction set
-
-; define register use
-%ifdef  WINDOWS
-%define arg1       rcx                  ; parameter 1, pointer to haystack
-%define arg2       rdx                  ; parameter 2, pointer to needle
-%define bit_index  r8d                  ; bit index in eax mask
-%define bit_indexr r8                   ; bit index in eax mask
-%define text       r9                   ; pointer to match in haystack
-%define pattern    r10                  ; pointer to match in needle
-%define tempb      r8b                  ; temporary byte
-%else
-%define arg1       rdi                  ; parameter 1, pointer to haystack
-%define arg2       rsi                  ; parameter 2, pointer to needle
-%define bit_index  ecx                  ; bit index in eax mask
-%define bit_indexr rcx                  ; bit index in eax mask
-%define text       r9                   ; pointer to match in haystack
-%define pattern    rdx                  ; pointer to match in needle
-%define tempb      cl                   ; temporary byte
-%endif
+        jmp     near [utf8Dispatch]         ; Go to appropriate version, depending on instruction set
 
 align 16
 utf8_decode_SSE41: ; SSE4.1 version
-        movdqu  xmm1, [arg2]                ; needle
-
-haystack_next:
-        ; [arg1] = haystack
-        pcmpistrm xmm1, [arg1], 00001100B   ; unsigned byte search, equal ordered, return mask in xmm0
-        jc      match_begin                 ; found beginning of a match
-        jz      not_found                   ; end of haystack found, dismatch
-        add     arg1, 16
-        jmp     haystack_next
-
-match_begin:
-        jz      found_short                 ; haystack ends here, a short match is found
-        movd    eax, xmm0                   ; bit mask of possible matches
-next_bitindex:
-        bsf     bit_index, eax              ; index of first bit in mask of possible matches
-
-        ; compare strings for full match
-        lea     text, [arg1 + bit_indexr]   ; haystack + index
-        mov     pattern, arg2               ; needle
-
-; align 16
-compare_loop: ; compare loop for long match
-        movdqu  xmm2, [pattern]             ; paragraph of needle
-        pcmpistrm xmm2, [text], 00001100B   ; unsigned bytes, equal ordered, modifies xmm0
-        ; (can't use "equal each, masked" because it inverts when past end of needle, but not when past end of both)
-
-        jno     longmatch_fail              ; difference found after extending partial match
-        js      longmatch_success           ; end of needle found, and no difference
-        add     pattern, 16
-        add     text, 16
-        jmp     compare_loop                ; loop to next 16 bytes
-
-longmatch_fail:
-        ; remove index bit of first partial match
-        btr     eax, bit_index
+        mov     src, arg1
+        lea     src_end, [arg1 + arg2]
+        mov     dest, arg3
+        sub     rsp, 24
+        mov     [rsp + 16], dest            ; dest_first
+
+sse_next_block:
+        lea     rax, [src + 16]
+        cmp     rax, src_end
+        ja      sse_done                    ; less than 16 bytes left
+        movdqu  xmm1, [src]                 ; chunk
+
+        ; The pure ASCII run
+        pmovmskb eax, xmm1
         test    eax, eax
-        jnz     next_bitindex               ; mask contains more index bits, loop to next bit in eax mask
-        ; mask exhausted for possible matches, continue to next haystack paragraph
-        add     arg1, 16
-        jmp     haystack_next               ; loop to next paragraph of haystack
-
-longmatch_success: ; match found over more than one paragraph
-        lea     rax, [arg1 + bit_indexr]    ; haystack + index to begin of long match
-        ret
-
-found_short: ; match found within single paragraph
-        movd    eax, xmm0                   ; bit mask of matches
-        bsf     eax, eax                    ; index of first match
-        add     rax, arg1                   ; pointer to first match
-        ret
-
-not_found: ; needle not found, return 0
-        xor     rax, rax
+        jz      sse_ascii_run
+
+        ; The high 4 bits of the first bytes, the other bytes are 0
+        movdqa  xmm2, xmm1
+        pand    xmm2, [head_mask]
+        pcmpeqb xmm2, [head_mask]
+        pand    xmm2, xmm1
+        psrlw   xmm2, 4
+        pand    xmm2, [mask_0F]
+
+        ; Have any 4 bytes sequences, decode the whole characters of this block one by one.
+        movdqa  xmm0, xmm2
+        pcmpeqb xmm0, [mask_0F]
+        pmovmskb eax, xmm0
+        test    eax, eax
+        jnz     sse_mb4_block
+
+        ; count = the length of the character at the first byte, counts = the byte index in character
+        movdqa  xmm0, [count_lookup]
+        pshufb  xmm0, xmm2                  ; count
+        movdqa  xmm3, xmm0
+        psubusb xmm3, [ones_mask]           ; count - 1
+        movdqa  xmm2, xmm3
+        pslldq  xmm2, 1
+        por     xmm2, xmm0
+        psubusb xmm0, [twos_mask]           ; count - 2
+        pslldq  xmm0, 2
+        por     xmm2, xmm0                  ; counts
+
+        ; shifts = prefix sum of (count - 1)
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 1
+        paddb   xmm3, xmm0
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 2
+        paddb   xmm3, xmm0
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 4
+        paddb   xmm3, xmm0
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 8
+        paddb   xmm3, xmm0
+
+        ; Only the last byte of a character is the tail char
+        movdqa  xmm0, [twos_mask]
+        pcmpgtb xmm0, xmm2                  ; counts < 2
+        pand    xmm3, xmm0                  ; shifts of the tail chars
+        pmovmskb ecx, xmm0
+        bsr     ecx, ecx                    ; index of the last tail char
+
+        ; dest_advance = source_advance - shifts[source_advance - 1]
+        movdqu  [rsp], xmm3
+        movzx   eax, byte [rsp + rcx]
+        inc     ecx                         ; source_advance
+        mov     edx, ecx
+        sub     edx, eax                    ; dest_advance
+
+        ; The low 8 bits of the code units
+        pxor    xmm4, xmm4
+        pcmpeqb xmm4, xmm2
+        pand    xmm4, xmm1                  ; ascii
+        movdqa  xmm5, [ones_mask]
+        pcmpeqb xmm5, xmm2
+        pand    xmm5, xmm1
+        pand    xmm5, [mask_3F]
+        por     xmm4, xmm5                  ; bits 0 ~ 5
+        movdqa  xmm5, [twos_mask]
+        pcmpeqb xmm5, xmm2
+        pand    xmm5, xmm1
+        pslldq  xmm5, 1
+        movdqa  xmm0, xmm5
+        psllw   xmm0, 6
+        pand    xmm0, [mask_C0]
+        por     xmm4, xmm0                  ; chunk_low, bits 6 ~ 7
+
+        ; The high 8 bits of the code units
+        psrlw   xmm5, 2
+        pand    xmm5, [mask_0F]             ; bits 8 ~ 11
+        pcmpeqb xmm2, [threes_mask]
+        pand    xmm2, xmm1
+        pslldq  xmm2, 2
+        psllw   xmm2, 4
+        pand    xmm2, [mask_F0]
+        por     xmm5, xmm2                  ; chunk_high, bits 12 ~ 15
+
+        ; Move each tail char down by its shift, 1, 2, 4, 8 bytes per round
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 1
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 7
+        psrldq  xmm0, 1
+        pblendvb xmm3, xmm1, xmm0
+
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 2
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 6
+        psrldq  xmm0, 2
+        pblendvb xmm3, xmm1, xmm0
+
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 4
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 5
+        psrldq  xmm0, 4
+        pblendvb xmm3, xmm1, xmm0
+
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 8
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 4
+        psrldq  xmm0, 8
+        pblendvb xmm3, xmm1, xmm0
+
+        ; Remove the gaps by shuffling
+        paddb   xmm3, [shuffle_base]
+        pshufb  xmm4, xmm3
+        pshufb  xmm5, xmm3
+
+        ; Now we can unpack and store
+        movdqa  xmm0, xmm4
+        punpcklbw xmm0, xmm5
+        punpckhbw xmm4, xmm5
+        movdqu  [dest], xmm0
+        movdqu  [dest + 16], xmm4
+
+        add     src, rcx
+        lea     dest, [dest + rdx * 2]
+        jmp     sse_next_block
+
+sse_mb4_block:
+        lea     limit, [src + 16]
+        call    decode_chars
+        jmp     sse_next_block
+
+sse_ascii_run:
+        pxor    xmm0, xmm0                  ; widen the 16 bytes in xmm1
+        movdqa  xmm2, xmm1
+        punpcklbw xmm1, xmm0
+        punpckhbw xmm2, xmm0
+        movdqu  [dest], xmm1
+        movdqu  [dest + 16], xmm2
+        add     src, 16
+        add     dest, 32
+
+sse_ascii_next:
+        lea     rax, [src + 64]
+        cmp     rax, src_end
+        ja      sse_next_block
+        movdqu  xmm1, [src]
+        movdqu  xmm2, [src + 16]
+        movdqu  xmm3, [src + 32]
+        movdqu  xmm4, [src + 48]
+        movdqa  xmm5, xmm1
+        por     xmm5, xmm2
+        por     xmm5, xmm3
+        por     xmm5, xmm4
+        pmovmskb eax, xmm5
+        test    eax, eax
+        jnz     sse_next_block              ; not all the 64 bytes are ASCII
+        pxor    xmm0, xmm0
+        movdqa  xmm5, xmm1
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm1, xmm0
+        movdqu  [dest], xmm5
+        movdqu  [dest + 16], xmm1
+        movdqa  xmm5, xmm2
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm2, xmm0
+        movdqu  [dest + 32], xmm5
+        movdqu  [dest + 48], xmm2
+        movdqa  xmm5, xmm3
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm3, xmm0
+        movdqu  [dest + 64], xmm5
+        movdqu  [dest + 80], xmm3
+        movdqa  xmm5, xmm4
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm4, xmm0
+        movdqu  [dest + 96], xmm5
+        movdqu  [dest + 112], xmm4
+        add     src, 64
+        add     dest, 128
+        jmp     sse_ascii_next
+
+sse_done:
+        mov     limit, src_end              ; the last 0 ~ 15 bytes
+        call    decode_chars
+        mov     rax, dest
+        sub     rax, [rsp + 16]
+        shr     rax, 1                      ; the number of the code units
+        add     rsp, 24
         ret
 
 ; utf8_decode_SSE41: endp
@@ -119,77 +277,152 @@ not_found: ; needle not found, return 0
 
 align 16
 utf8_decode_Generic: ; generic version
-
-        mov     ax, [arg2]
-        test    al, al
-        jz      _Found                 ; a zero-length needle is always found
-        test    ah, ah
-        jz      _SingleCharNeedle
-
-_SearchLoop: ; search for first character match
-        mov     tempb, [arg1]
-        test    tempb, tempb
-        jz      _NotFound              ; end of haystack reached without finding
-        cmp     al, tempb
-        je      _FirstCharMatch        ; first character match
-_IncompleteMatch:
-        inc     arg1
-        jmp     _SearchLoop            ; loop through haystack
-
-_FirstCharMatch:
-        mov     text, arg1             ; begin of match position
-        mov     pattern, arg2
-_MatchLoop:
-        inc     text
-        inc     pattern
-        mov     al, [pattern]
-        test    al, al
-        jz      _Found                 ; end of needle. match ok
-        cmp     al, [text]
-        je      _MatchLoop
-        ; match failed, recover and continue
-        mov     al, [arg2]
-        jmp     _IncompleteMatch
-
-_NotFound: ; needle not found. return 0
-        xor     eax, eax
+        mov     src, arg1
+        lea     src_end, [arg1 + arg2]
+        mov     dest, arg3
+        mov     limit, src_end
+        push    dest                        ; dest_first
+        call    decode_chars
+        pop     rcx
+        mov     rax, dest
+        sub     rax, rcx
+        shr     rax, 1                      ; the number of the code units
         ret
 
-_Found: ; needle found. return pointer to position in haystack
-        mov     rax, arg1
+; utf8_decode_Generic: endp
+
+
+;
+; Decode the whole characters in [src, limit), advance src and dest.
+; Same as utf8::utf8_decode_scalar(), the length of a character is
+; decided by the high 4 bits of the first byte.
+; Modifies eax, ecx, edx.
+;
+align 16
+decode_chars:
+        cmp     src, limit
+        jae     decode_done
+        movzx   eax, byte [src]
+        cmp     eax, 80h
+        jae     decode_mb
+        mov     [dest], ax                  ; 0xxxxxxx
+        inc     src
+        add     dest, 2
+        jmp     decode_chars
+
+decode_mb:
+        cmp     eax, 0E0h
+        jae     decode_mb3
+        lea     rdx, [src + 2]              ; 110xxxxx 10xxxxxx
+        cmp     rdx, limit
+        ja      decode_done
+        and     eax, 1Fh
+        shl     eax, 6
+        movzx   ecx, byte [src + 1]
+        and     ecx, 3Fh
+        or      eax, ecx
+        mov     [dest], ax
+        mov     src, rdx
+        add     dest, 2
+        jmp     decode_chars
+
+decode_mb3:
+        cmp     eax, 0F0h
+        jae     decode_mb4
+        lea     rdx, [src + 3]              ; 1110xxxx 10xxxxxx 10xxxxxx
+        cmp     rdx, limit
+        ja      decode_done
+        and     eax, 0Fh
+        shl     eax, 12
+        movzx   ecx, byte [src + 1]
+        and     ecx, 3Fh
+        shl     ecx, 6
+        or      eax, ecx
+        movzx   ecx, byte [src + 2]
+        and     ecx, 3Fh
+        or      eax, ecx
+        mov     [dest], ax
+        mov     src, rdx
+        add     dest, 2
+        jmp     decode_chars
+
+decode_mb4:
+        lea     rdx, [src + 4]              ; 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+        cmp     rdx, limit
+        ja      decode_done
+        and     eax, 07h
+        shl     eax, 18
+        movzx   ecx, byte [src + 1]
+        and     ecx, 3Fh
+        shl     ecx, 12
+        or      eax, ecx
+        movzx   ecx, byte [src + 2]
+        and     ecx, 3Fh
+        shl     ecx, 6
+        or      eax, ecx
+        movzx   ecx, byte [src + 3]
+        and     ecx, 3Fh
+        or      eax, ecx
+        ; The surrogate pair
+        mov     ecx, eax
+        shr     eax, 10
+        add     eax, 0D7C0h
+        and     ecx, 3FFh
+        add     ecx, 0DC00h
+        mov     [dest], ax
+        mov     [dest + 2], cx
+        mov     src, rdx
+        add     dest, 4
+        jmp     decode_chars
+
+decode_done:
         ret
 
-_SingleCharNeedle: ; Needle is a single character
-        mov     tempb, byte [arg1]
-        test    tempb, tempb
-        jz      _NotFound              ; end of haystack reached without finding
-        cmp     al, tempb
-        je      _Found
-        inc     arg1
-        jmp     _SingleCharNeedle      ; loop through haystack
+; decode_chars: endp
 
 
 align 16
-; CPU dispatching for strstr. This is executed only once
+; CPU dispatching for utf8_decode_sse41(). This is executed only once
 utf8CPUDispatch:
         ; get supported instruction set
         push    arg1
         push    arg2
+        push    arg3
+%ifdef  WINDOWS
+        sub     rsp, 32                     ; shadow space
+        call    InstructionSet
+        add     rsp, 32
+%else
         call    InstructionSet
+%endif
+        pop     arg3
         pop     arg2
         pop     arg1
-        ; Point to generic version of strstr
+        ; Point to generic version of utf8_decode
         lea     r9, [utf8_decode_Generic]
-        cmp     eax, 10                ; check SSE4.1
+        cmp     eax, 8                      ; check SSE4.1
         jb      Q100
         ; SSE4.1 supported
-        ; Point to SSE4.1 version of strstr
+        ; Point to SSE4.1 version of utf8_decode
         lea     r9, [utf8_decode_SSE41]
 Q100:   mov     [utf8Dispatch], r9
-        ; Continue in appropriate version of strstr
+        ; Continue in appropriate version of utf8_decode
         jmp     r9
 
 SECTION .data
+align 16
+
+; The length of the character by the high 4 bits of the first byte, the other bytes are 0
+count_lookup    DB      0, 1, 1, 2, 1, 1, 2, 3, 1, 1, 1, 1, 2, 2, 3, 4
+shuffle_base    DB      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+head_mask       times 16 DB 0C0h
+mask_C0         times 16 DB 0C0h
+mask_F0         times 16 DB 0F0h
+mask_0F         times 16 DB 0Fh
+mask_3F         times 16 DB 3Fh
+ones_mask       times 16 DB 01h
+twos_mask       times 16 DB 02h
+threes_mask     times 16 DB 03h
 
 ; Pointer to appropriate version. Initially points to dispatcher
 utf8Dispatch DQ utf8CPUDispatch
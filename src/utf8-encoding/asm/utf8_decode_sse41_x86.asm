@@ -3,6 +3,12 @@
 ; Date created:     2022-04-28
 ; Last modified:    2022-04-28
 
+;
+; C prototype:
+; extern "C" size_t utf8_decode_sse41(const char * src, size_t len, uint16_t * dest);
+;
+; Decode the UTF-8 string to UTF-16, return the number of the output code units.
+; See utf8_decode_sse41_x64.asm, this is the 32 bit version of it.
 ;
 ; Position-independent code is generated if POSITIONINDEPENDENT is defined.
 ;
@@ -23,6 +29,15 @@ global _utf8_decode_SSE41               ; Version for processors with SSE4.1
 ; Imported from InstructionSet_x86.asm:
 extern _InstructionSet                  ; Instruction set for CPU dispatcher
 
+; define register use
+%define src        esi                  ; pointer to the current UTF-8 character
+%define src_end    ebx                  ; src + len
+%define dest       edi                  ; pointer to the output code units
+%define limit      ebp                  ; decode_chars stops before the characters beyond it
+
+; The constants are addressed by ebp in the SSE4.1 version
+%define CONST(x)   ebp + (x) - utf8_constants
+
 section .text
 
 ; utf8_decode() function
@@ -32,7 +47,7 @@ global ?OVR_utf8_decode
 ?OVR_utf8_decode:
 %endif
 
-_utf8_decode_sse4_1: ; function dispatching
+_utf8_decode_sse41: ; function dispatching
 
 %IFNDEF POSITIONINDEPENDENT
         jmp     near [utf8Dispatch] ; Go to appropriate version, depending on instruction set
@@ -49,69 +64,231 @@ RP:                                    ; reference point edx = offset RP
 
 align 16
 _utf8_decode_SSE41: ; SSE4.1 version
+        push    ebp
         push    ebx
         push    esi
-        mov     esi, [esp+12]          ; haystack
-        mov     eax, [esp+16]          ; needle
-        movdqu  xmm1, [eax]            ; needle
-
-align 8
-haystacknext:
-        ; [esi] = haystack
-        pcmpistrm xmm1, [esi], 00001100b ; unsigned byte search, equal ordered, return mask in xmm0
-        jc      matchbegin             ; found beginning of a match
-        jz      nomatch                ; end of haystack found, no match
-        add     esi, 16
-        jmp     haystacknext
-
-matchbegin:
-        jz      foundshort             ; haystack ends here, a short match is found
-        movd    eax, xmm0              ; bit mask of possible matches
-nextindexbit:
-        bsf     ecx, eax               ; index of first bit in mask of possible matches
-
-        ; compare strings for full match
-        lea     ebx, [esi+ecx]         ; haystack + index
-        mov     edx, [esp+16]          ; needle
-
-compareloop: ; compare loop for long match
-        movdqu  xmm2, [edx]            ; paragraph of needle
-        pcmpistrm xmm2, [ebx], 00001100B ; unsigned bytes, equal ordered, modifies xmm0
-        ; (can't use "equal each, masked" because it inverts when past end of needle, but not when past end of both)
-
-        jno     longmatchfail          ; difference found after extending partial match
-        js      longmatchsuccess       ; end of needle found, and no difference
-        add     edx, 16
-        add     ebx, 16
-        jmp     compareloop            ; loop to next 16 bytes
-
-longmatchfail:
-        ; remove index bit of first partial match
-        btr     eax, ecx
-        test    eax, eax
-        jnz     nextindexbit           ; mask contains more index bits, loop to next bit in eax mask
-        ; mask exhausted for possible matches, continue to next haystack paragraph
-        add     esi, 16
-        jmp     haystacknext           ; loop to next paragraph of haystack
+        push    edi
+        sub     esp, 16                ; shifts of the tail chars
+        mov     src, [esp+36]          ; src
+        mov     src_end, [esp+40]      ; len
+        add     src_end, src
+        mov     dest, [esp+44]         ; dest
 
-longmatchsuccess: ; match found over more than one paragraph
-        lea     eax, [esi+ecx]         ; haystack + index to begin of long match
-        pop     esi
-        pop     ebx
-        ret
+%IFNDEF POSITIONINDEPENDENT
+        mov     ebp, utf8_constants
+%ELSE
+        call    get_thunk_edx
+RP1:    ; reference point edx
+        lea     ebp, [edx+utf8_constants-RP1]
+%ENDIF
 
-foundshort: ; match found within single paragraph
-        movd    eax, xmm0              ; bit mask of matches
-        bsf     eax, eax               ; index of first match
-        add     eax, esi               ; pointer to first match
-        pop     esi
-        pop     ebx
-        ret
+SSE41NextBlock:
+        lea     eax, [src+16]
+        cmp     eax, src_end
+        ja      SSE41Done              ; less than 16 bytes left
+        movdqu  xmm1, [src]            ; chunk
 
-nomatch: ; needle not found, return 0
-        xor     eax, eax
+        ; The pure ASCII run
+        pmovmskb eax, xmm1
+        test    eax, eax
+        jz      SSE41AsciiRun
+
+        ; The high 4 bits of the first bytes, the other bytes are 0
+        movdqa  xmm2, xmm1
+        pand    xmm2, [CONST(head_mask)]
+        pcmpeqb xmm2, [CONST(head_mask)]
+        pand    xmm2, xmm1
+        psrlw   xmm2, 4
+        pand    xmm2, [CONST(mask_0F)]
+
+        ; Have any 4 bytes sequences, decode the whole characters of this block one by one.
+        movdqa  xmm0, xmm2
+        pcmpeqb xmm0, [CONST(mask_0F)]
+        pmovmskb eax, xmm0
+        test    eax, eax
+        jnz     SSE41Mb4Block
+
+        ; count = the length of the character at the first byte, counts = the byte index in character
+        movdqa  xmm0, [CONST(count_lookup)]
+        pshufb  xmm0, xmm2             ; count
+        movdqa  xmm3, xmm0
+        psubusb xmm3, [CONST(ones_mask)] ; count - 1
+        movdqa  xmm2, xmm3
+        pslldq  xmm2, 1
+        por     xmm2, xmm0
+        psubusb xmm0, [CONST(twos_mask)] ; count - 2
+        pslldq  xmm0, 2
+        por     xmm2, xmm0             ; counts
+
+        ; shifts = prefix sum of (count - 1)
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 1
+        paddb   xmm3, xmm0
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 2
+        paddb   xmm3, xmm0
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 4
+        paddb   xmm3, xmm0
+        movdqa  xmm0, xmm3
+        pslldq  xmm0, 8
+        paddb   xmm3, xmm0
+
+        ; Only the last byte of a character is the tail char
+        movdqa  xmm0, [CONST(twos_mask)]
+        pcmpgtb xmm0, xmm2             ; counts < 2
+        pand    xmm3, xmm0             ; shifts of the tail chars
+        pmovmskb ecx, xmm0
+        bsr     ecx, ecx               ; index of the last tail char
+
+        ; dest_advance = source_advance - shifts[source_advance - 1]
+        movdqu  [esp], xmm3
+        movzx   eax, byte [esp+ecx]
+        inc     ecx                    ; source_advance
+        mov     edx, ecx
+        sub     edx, eax               ; dest_advance
+
+        ; The low 8 bits of the code units
+        pxor    xmm4, xmm4
+        pcmpeqb xmm4, xmm2
+        pand    xmm4, xmm1             ; ascii
+        movdqa  xmm5, [CONST(ones_mask)]
+        pcmpeqb xmm5, xmm2
+        pand    xmm5, xmm1
+        pand    xmm5, [CONST(mask_3F)]
+        por     xmm4, xmm5             ; bits 0 ~ 5
+        movdqa  xmm5, [CONST(twos_mask)]
+        pcmpeqb xmm5, xmm2
+        pand    xmm5, xmm1
+        pslldq  xmm5, 1
+        movdqa  xmm0, xmm5
+        psllw   xmm0, 6
+        pand    xmm0, [CONST(mask_C0)]
+        por     xmm4, xmm0             ; chunk_low, bits 6 ~ 7
+
+        ; The high 8 bits of the code units
+        psrlw   xmm5, 2
+        pand    xmm5, [CONST(mask_0F)] ; bits 8 ~ 11
+        pcmpeqb xmm2, [CONST(threes_mask)]
+        pand    xmm2, xmm1
+        pslldq  xmm2, 2
+        psllw   xmm2, 4
+        pand    xmm2, [CONST(mask_F0)]
+        por     xmm5, xmm2             ; chunk_high, bits 12 ~ 15
+
+        ; Move each tail char down by its shift, 1, 2, 4, 8 bytes per round
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 1
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 7
+        psrldq  xmm0, 1
+        pblendvb xmm3, xmm1, xmm0
+
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 2
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 6
+        psrldq  xmm0, 2
+        pblendvb xmm3, xmm1, xmm0
+
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 4
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 5
+        psrldq  xmm0, 4
+        pblendvb xmm3, xmm1, xmm0
+
+        movdqa  xmm1, xmm3
+        psrldq  xmm1, 8
+        movdqa  xmm0, xmm3
+        psllw   xmm0, 4
+        psrldq  xmm0, 8
+        pblendvb xmm3, xmm1, xmm0
+
+        ; Remove the gaps by shuffling
+        paddb   xmm3, [CONST(shuffle_base)]
+        pshufb  xmm4, xmm3
+        pshufb  xmm5, xmm3
+
+        ; Now we can unpack and store
+        movdqa  xmm0, xmm4
+        punpcklbw xmm0, xmm5
+        punpckhbw xmm4, xmm5
+        movdqu  [dest], xmm0
+        movdqu  [dest+16], xmm4
+
+        add     src, ecx
+        lea     dest, [dest+edx*2]
+        jmp     SSE41NextBlock
+
+SSE41Mb4Block:
+        push    ebp
+        lea     limit, [src+16]
+        call    DecodeChars
+        pop     ebp
+        jmp     SSE41NextBlock
+
+SSE41AsciiRun:
+        pxor    xmm0, xmm0             ; widen the 16 bytes in xmm1
+        movdqa  xmm2, xmm1
+        punpcklbw xmm1, xmm0
+        punpckhbw xmm2, xmm0
+        movdqu  [dest], xmm1
+        movdqu  [dest+16], xmm2
+        add     src, 16
+        add     dest, 32
+
+SSE41AsciiNext:
+        lea     eax, [src+64]
+        cmp     eax, src_end
+        ja      SSE41NextBlock
+        movdqu  xmm1, [src]
+        movdqu  xmm2, [src+16]
+        movdqu  xmm3, [src+32]
+        movdqu  xmm4, [src+48]
+        movdqa  xmm5, xmm1
+        por     xmm5, xmm2
+        por     xmm5, xmm3
+        por     xmm5, xmm4
+        pmovmskb eax, xmm5
+        test    eax, eax
+        jnz     SSE41NextBlock         ; not all the 64 bytes are ASCII
+        pxor    xmm0, xmm0
+        movdqa  xmm5, xmm1
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm1, xmm0
+        movdqu  [dest], xmm5
+        movdqu  [dest+16], xmm1
+        movdqa  xmm5, xmm2
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm2, xmm0
+        movdqu  [dest+32], xmm5
+        movdqu  [dest+48], xmm2
+        movdqa  xmm5, xmm3
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm3, xmm0
+        movdqu  [dest+64], xmm5
+        movdqu  [dest+80], xmm3
+        movdqa  xmm5, xmm4
+        punpcklbw xmm5, xmm0
+        punpckhbw xmm4, xmm0
+        movdqu  [dest+96], xmm5
+        movdqu  [dest+112], xmm4
+        add     src, 64
+        add     dest, 128
+        jmp     SSE41AsciiNext
+
+SSE41Done:
+        mov     limit, src_end         ; the last 0 ~ 15 bytes, ebp is not used any more
+        call    DecodeChars
+        mov     eax, dest
+        sub     eax, [esp+44]
+        shr     eax, 1                 ; the number of the code units
+        add     esp, 16
+        pop     edi
         pop     esi
         pop     ebx
+        pop     ebp
         ret
 
 ;_utf8_decode_SSE41: endp
@@ -119,62 +296,114 @@ nomatch: ; needle not found, return 0
 
 align 16
 _utf8_decode_Generic: ; generic version
+        push    ebp
+        push    ebx
         push    esi
         push    edi
-        mov     esi, [esp+12]          ; haystack
-        mov     edi, [esp+16]          ; needle
-
-        mov     ax, [edi]
-        test    al, al
-        jz      _Found                 ; a zero-length needle is always found
-        test    ah, ah
-        jz      _SingleCharNeedle
-
-_SearchLoop: ; search for first character match
-        mov     cl, [esi]
-        test    cl, cl
-        jz      _NotFound              ; end of haystack reached without finding
-        cmp     al, cl
-        je      _FirstCharMatch        ; first character match
-_IncompleteMatch:
-        inc     esi
-        jmp     _SearchLoop            ; loop through haystack
-
-_FirstCharMatch:
-        mov     ecx, esi               ; begin of match position
-_MatchLoop:
-        inc     ecx
-        inc     edi
-        mov     al, [edi]
-        test    al, al
-        jz      _Found                 ; end of needle. match ok
-        cmp     al, [ecx]
-        je      _MatchLoop
-        ; match failed, recover and continue
-        mov     edi, [esp+16]          ; needle
-        mov     al, [edi]
-        jmp     _IncompleteMatch
-
-_NotFound: ; needle not found. return 0
-        xor     eax, eax
+        mov     src, [esp+20]          ; src
+        mov     limit, [esp+24]        ; len
+        add     limit, src
+        mov     dest, [esp+28]         ; dest
+        call    DecodeChars
+        mov     eax, dest
+        sub     eax, [esp+28]
+        shr     eax, 1                 ; the number of the code units
         pop     edi
         pop     esi
+        pop     ebx
+        pop     ebp
         ret
 
-_Found: ; needle found. return pointer to position in haystack
-        mov     eax, esi
-        pop     edi
-        pop     esi
+;_utf8_decode_Generic: endp
+
+
+;
+; Decode the whole characters in [src, limit), advance src and dest.
+; Same as utf8::utf8_decode_scalar(), the length of a character is
+; decided by the high 4 bits of the first byte.
+; Modifies eax, ecx, edx.
+;
+align 16
+DecodeChars:
+        cmp     src, limit
+        jae     DecodeDone
+        movzx   eax, byte [src]
+        cmp     eax, 80h
+        jae     DecodeMb
+        mov     [dest], ax             ; 0xxxxxxx
+        inc     src
+        add     dest, 2
+        jmp     DecodeChars
+
+DecodeMb:
+        cmp     eax, 0E0h
+        jae     DecodeMb3
+        lea     edx, [src+2]           ; 110xxxxx 10xxxxxx
+        cmp     edx, limit
+        ja      DecodeDone
+        and     eax, 1Fh
+        shl     eax, 6
+        movzx   ecx, byte [src+1]
+        and     ecx, 3Fh
+        or      eax, ecx
+        mov     [dest], ax
+        mov     src, edx
+        add     dest, 2
+        jmp     DecodeChars
+
+DecodeMb3:
+        cmp     eax, 0F0h
+        jae     DecodeMb4
+        lea     edx, [src+3]           ; 1110xxxx 10xxxxxx 10xxxxxx
+        cmp     edx, limit
+        ja      DecodeDone
+        and     eax, 0Fh
+        shl     eax, 12
+        movzx   ecx, byte [src+1]
+        and     ecx, 3Fh
+        shl     ecx, 6
+        or      eax, ecx
+        movzx   ecx, byte [src+2]
+        and     ecx, 3Fh
+        or      eax, ecx
+        mov     [dest], ax
+        mov     src, edx
+        add     dest, 2
+        jmp     DecodeChars
+
+DecodeMb4:
+        lea     edx, [src+4]           ; 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+        cmp     edx, limit
+        ja      DecodeDone
+        and     eax, 07h
+        shl     eax, 18
+        movzx   ecx, byte [src+1]
+        and     ecx, 3Fh
+        shl     ecx, 12
+        or      eax, ecx
+        movzx   ecx, byte [src+2]
+        and     ecx, 3Fh
+        shl     ecx, 6
+        or      eax, ecx
+        movzx   ecx, byte [src+3]
+        and     ecx, 3Fh
+        or      eax, ecx
+        ; The surrogate pair
+        mov     ecx, eax
+        shr     eax, 10
+        add     eax, 0D7C0h
+        and     ecx, 3FFh
+        add     ecx, 0DC00h
+        mov     [dest], ax
+        mov     [dest+2], cx
+        mov     src, edx
+        add     dest, 4
+        jmp     DecodeChars
+
+DecodeDone:
         ret
 
-_SingleCharNeedle: ; Needle is a single character
-        movzx   ecx, byte [esi]
-        test    cl, cl
-        jz      _NotFound				; end of haystack reached without finding
-        cmp     al, cl
-        je      _Found
-        inc     esi
-        jmp     _SingleCharNeedle		; loop through haystack
+;DecodeChars: endp
 
 
 %IFDEF  POSITIONINDEPENDENT
@@ -183,20 +412,20 @@ get_thunk_edx: ; load caller address into edx for position-independent code
         ret
 %ENDIF
 
-; CPU dispatching for strstr. This is executed only once
+; CPU dispatching for utf8_decode_sse41(). This is executed only once
 utf8CPUDispatch:
 %IFNDEF POSITIONINDEPENDENT
         ; get supported instruction set
         call    _InstructionSet
-        ; Point to generic version of strstr
+        ; Point to generic version of utf8_decode
         mov     ecx, _utf8_decode_Generic
-        cmp     eax, 10                ; check SSE4.1
+        cmp     eax, 8                 ; check SSE4.1
         jb      Q100
         ; SSE4.1 supported
-        ; Point to SSE4.1 version of strstr
+        ; Point to SSE4.1 version of utf8_decode
         mov     ecx, _utf8_decode_SSE41
 Q100:   mov     [utf8Dispatch], ecx
-        ; Continue in appropriate version of strstr
+        ; Continue in appropriate version of utf8_decode
         jmp     ecx
 
 %ELSE   ; Position-independent version
@@ -204,19 +433,33 @@ Q100:   mov     [utf8Dispatch], ecx
         call    _InstructionSet
         call    get_thunk_edx
 RP2:    ; reference point edx
-        ; Point to generic version of strstr
+        ; Point to generic version of utf8_decode
         lea     ecx, [edx+_utf8_decode_Generic-RP2]
-        cmp     eax, 10                ; check SSE4.1
+        cmp     eax, 8                 ; check SSE4.1
         jb      Q100
         ; SSE4.1 supported
-        ; Point to SSE4.1 version of strstr
+        ; Point to SSE4.1 version of utf8_decode
         lea     ecx, [edx+_utf8_decode_SSE41-RP2]
 Q100:   mov     [edx+utf8Dispatch-RP2], ecx
-        ; Continue in appropriate version of strstr
+        ; Continue in appropriate version of utf8_decode
         jmp     ecx
 %ENDIF
 
 SECTION .data
+align 16
+
+utf8_constants:
+; The length of the character by the high 4 bits of the first byte, the other bytes are 0
+count_lookup    DB      0, 1, 1, 2, 1, 1, 2, 3, 1, 1, 1, 1, 2, 2, 3, 4
+shuffle_base    DB      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+head_mask       times 16 DB 0C0h
+mask_C0         times 16 DB 0C0h
+mask_F0         times 16 DB 0F0h
+mask_0F         times 16 DB 0Fh
+mask_3F         times 16 DB 3Fh
+ones_mask       times 16 DB 01h
+twos_mask       times 16 DB 02h
+threes_mask     times 16 DB 03h
 
 ; Pointer to appropriate version. Initially points to dispatcher
 utf8Dispatch DD utf8CPUDispatch
@@ -0,0 +1,300 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2012 Olivier Goffart <ogoffart@woboq.com>
+ * http://woboq.com
+ *
+ * This is an experiment to process UTF-8 using SSE4 intrinscis.
+ * Read: http://woboq.com/blog/utf-8-processing-using-simd.html
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+ *
+ * For any question, please contact contact@woboq.com
+ *
+ ****************************************************************************/
+
+#ifndef FROMUTF8_SSE_KERNEL_H
+#define FROMUTF8_SSE_KERNEL_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "utf8-encoding/utf8_decode_sse.h"
+
+//
+// The SSE4.1 kernels of fromutf8-sse.cc, they are compiled in
+// utf8_dispatch_sse41.cc and reached by the dispatcher (see utf8_dispatch.h),
+// fromutf8-sse.cc itself is compiled with the default flags.
+//
+
+#if defined(__SSE4_1__)
+
+//
+// Check a 16 bytes block without any branch, the bytes of the invalid
+// sequences are set to 0xFF in the result. The block must start at the
+// beginning of a character, the sequences cut by the end of the block are
+// checked again in the next block (they are never consumed).
+//
+// The overlong sequences, the UTF-16 surrogates and the code points above
+// U+10FFFF are invalid. The noncharacters are invalid too, same as
+// fromUtf8_sse_validate(), unless kAllowNonchars, same as fromUtf8().
+//
+template <bool kAllowNonchars>
+static inline
+__m128i fromUtf8_check_sse(__m128i chunk)
+{
+    __m128i prev1 = _mm_slli_si128(chunk, 1);
+    __m128i prev2 = _mm_slli_si128(chunk, 2);
+    __m128i prev3 = _mm_slli_si128(chunk, 3);
+
+    // The continuation bytes must be exactly the bytes required by the lead bytes.
+    __m128i is_body   = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0x80u));
+    __m128i need_body = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(prev1, _mm_set1_epi8(0xC0u)), prev1),
+                        _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(prev2, _mm_set1_epi8(0xE0u)), prev2),
+                                     _mm_cmpeq_epi8(_mm_max_epu8(prev3, _mm_set1_epi8(0xF0u)), prev3)));
+    __m128i error = _mm_xor_si128(is_body, need_body);
+
+    // 0xC0, 0xC1 and 0xF5 ~ 0xFF are never used
+    error = _mm_or_si128(error, _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xFEu)), _mm_set1_epi8(0xC0u)));
+    error = _mm_or_si128(error, _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0xF5u)), chunk));
+
+    // The overlong 3 bytes (E0 80..9F), the UTF-16 surrogates (ED A0..BF),
+    // the overlong 4 bytes (F0 80..8F) and above U+10FFFF (F4 90..BF).
+    // The continuation bytes are negative, so the signed compare is enough.
+    __m128i below_A0 = _mm_cmplt_epi8(chunk, _mm_set1_epi8(0xA0u));
+    __m128i below_90 = _mm_cmplt_epi8(chunk, _mm_set1_epi8(0x90u));
+    error = _mm_or_si128(error, _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8(0xE0u)), below_A0));
+    error = _mm_or_si128(error, _mm_andnot_si128(below_A0, _mm_cmpeq_epi8(prev1, _mm_set1_epi8(0xEDu))));
+    error = _mm_or_si128(error, _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8(0xF0u)), below_90));
+    error = _mm_or_si128(error, _mm_andnot_si128(below_90, _mm_cmpeq_epi8(prev1, _mm_set1_epi8(0xF4u))));
+
+    if (kAllowNonchars)
+        return error;
+
+    // The noncharacters: U+FDD0 ~ U+FDEF (EF B7 90..AF), U+FFFE and U+FFFF (EF BF BE..BF),
+    // U+nFFFE and U+nFFFF of the other planes (F0..F4 8F..BF BF BE..BF, with xF in the 2nd byte).
+    __m128i prev2_is_EF = _mm_cmpeq_epi8(prev2, _mm_set1_epi8(0xEFu));
+    __m128i plane_end   = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(prev3, _mm_set1_epi8(0xF0u)), prev3),
+                                        _mm_cmpeq_epi8(_mm_and_si128(prev2, _mm_set1_epi8(0x0F)), _mm_set1_epi8(0x0F)));
+    __m128i is_FFFE     = _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8(0xBFu)),
+                                        _mm_cmpeq_epi8(_mm_or_si128(chunk, _mm_set1_epi8(0x01)), _mm_set1_epi8(0xBFu)));
+    __m128i is_FDD0     = _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8(0xB7u)),
+                                        _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(0x8Fu)),
+                                                      _mm_cmplt_epi8(chunk, _mm_set1_epi8(0xB0u))));
+    error = _mm_or_si128(error, _mm_and_si128(is_FFFE, _mm_or_si128(prev2_is_EF, plane_end)));
+    error = _mm_or_si128(error, _mm_and_si128(is_FDD0, prev2_is_EF));
+    return error;
+}
+
+//
+// Decode a 16 bytes block, it must start at the beginning of a character,
+// returns the bytes of the whole characters decoded, the code units are
+// returned to *dest_advance, and a whole block of units is always stored.
+//
+static inline
+uint32_t fromUtf8_sse_block(__m128i chunk, uint16_t * dest, uint32_t * dest_advance,
+                            const utf8::utf8_pack_u16_table_t & pack_table)
+{
+    __m128i chunk_signed = _mm_add_epi8(chunk, _mm_set1_epi8(0x80u));
+    __m128i cond2 = _mm_cmplt_epi8(_mm_set1_epi8(0xC2u - 1 - 0x80u), chunk_signed);
+    __m128i state = _mm_set1_epi8(0x00u | 0x80u);
+    state = _mm_blendv_epi8(state, _mm_set1_epi8(0x02u | 0xC0u), cond2);
+
+    __m128i cond3 = _mm_cmplt_epi8(_mm_set1_epi8(0xE0u - 1 - 0x80u), chunk_signed);
+
+    // Only 2 bytes sequences, see utf8_decode_sse_mb2_block().
+    if (!_mm_movemask_epi8(cond3)) {
+        return utf8::utf8_decode_sse_mb2_block(chunk, dest, dest_advance, pack_table);
+    }
+
+    state = _mm_blendv_epi8(state, _mm_set1_epi8(0x03u | 0xE0u), cond3);
+    __m128i mask3 = _mm_slli_si128(cond3, 1);
+
+    __m128i cond4 = _mm_cmplt_epi8(_mm_set1_epi8(0xF0u - 1 - 0x80u), chunk_signed);
+
+    // 4 bytes sequences are decoded to the UTF-16 surrogate pairs
+    if (_mm_movemask_epi8(cond4)) {
+        return utf8::utf8_decode_sse_mb4_block(chunk, dest, dest_advance);
+    }
+
+    __m128i count =  _mm_and_si128(state, _mm_set1_epi8(0x07));
+    __m128i count_sub1 = _mm_subs_epu8(count, _mm_set1_epi8(0x01));
+    __m128i counts = _mm_add_epi8(count, _mm_slli_si128(count_sub1, 1));
+
+    __m128i shifts = count_sub1;
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 1));
+    counts = _mm_add_epi8(counts, _mm_slli_si128(_mm_subs_epu8(counts, _mm_set1_epi8(0x02)), 2));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 2));
+
+#if 0
+    // ASCII characters (and only them) should have the corresponding byte of counts equal 0.
+    if (asciiMask ^ _mm_movemask_epi8(_mm_cmpgt_epi8(counts, _mm_set1_epi8(0x00)))) {
+        return 0; // error
+    }
+#endif
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 4));
+
+#if 0
+    // The difference between a byte in counts and the next one should be negative,
+    // zero, or one. Any other value means there is not enough continuation bytes.
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_sub_epi8(
+                          _mm_slli_si128(counts, 1), counts),
+                          _mm_set1_epi8(0x01)))) {
+        return 0; // error
+    }
+#endif
+
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 8));
+
+    __m128i mask = _mm_and_si128(state, _mm_set1_epi8(0xF8u));
+
+    // Keep only if the corresponding byte should stay
+    // that is, if counts is 1 or 0 (so < 2).
+    shifts = _mm_and_si128(shifts, _mm_cmplt_epi8(counts, _mm_set1_epi8(0x02)));
+
+    chunk = _mm_andnot_si128(mask, chunk); // from now on, we only have usefull bits
+
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 1),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 7), 1));
+
+    __m128i chunk_right = _mm_slli_si128(chunk, 1);
+
+    __m128i chunk_low = _mm_blendv_epi8(chunk,
+                              _mm_or_si128(chunk, _mm_and_si128(_mm_slli_epi16(chunk_right, 6), _mm_set1_epi8(0xC0u))),
+                              _mm_cmpeq_epi8(counts, _mm_set1_epi8(0x01)));
+
+    __m128i chunk_high = _mm_and_si128(chunk, _mm_cmpeq_epi8(counts, _mm_set1_epi8(0x02)));
+
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 2),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 6), 2));
+    chunk_high = _mm_srli_epi32(chunk_high, 2);
+
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 4),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 5), 4));
+    chunk_high = _mm_or_si128(chunk_high, _mm_and_si128(
+                              _mm_and_si128(_mm_slli_epi32(chunk_right, 4),
+                                            _mm_set1_epi8(0xF0u)), mask3));
+    int c = _mm_extract_epi16(counts, 7);
+    int source_advance = ((c & 0x0200) == 0) ? 16 : (((c & 0x02) == 0) ? 15 : 14);
+
+#if 0
+    // For the 3 bytes sequences we check the high byte to prevent
+    // the over long sequence (0x00 - 0x07) or the UTF-16 surrogate (0xD8 - 0xDF)
+    __m128i high_bits = _mm_and_si128(chunk_high, _mm_set1_epi8(0xF8u));
+    if (!_mm_testz_si128(mask3, _mm_or_si128(
+                _mm_cmpeq_epi8(high_bits, _mm_set1_epi8(0x00u)),
+                _mm_cmpeq_epi8(high_bits, _mm_set1_epi8(0xD8u))))) {
+        return 0;
+    }
+#endif
+
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 8),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 4), 8));
+
+    chunk_high = _mm_slli_si128(chunk_high, 1);
+
+    __m128i shuf = _mm_add_epi8(shifts, _mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+
+    // Remove the gaps by shuffling
+    chunk_low  = _mm_shuffle_epi8(chunk_low,  shuf);
+    chunk_high = _mm_shuffle_epi8(chunk_high, shuf);
+
+    // Now we can unpack and store
+    __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
+    __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),     utf16_low);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), utf16_high);
+
+    int s = _mm_extract_epi32(shifts, 3);
+    *dest_advance = (uint32_t)(source_advance - (0xFFu & (s >> 8 * (3 - 16 + source_advance))));
+
+#if 0
+#if defined(__SSE4_2__)
+    // Check for a few more invalid unicode using range comparison and _mm_cmpestrc
+    const int check_mode = 5; /* _SIDD_UWORD_OPS | _SIDD_CMP_RANGES */
+    if (_mm_cmpestrc(_mm_cvtsi64_si128(0xFDEFFDD0FFFFFFFE), 4, utf16_high, 8, check_mode) |
+        _mm_cmpestrc(_mm_cvtsi64_si128(0xFDEFFDD0FFFFFFFE), 4, utf16_low,  8, check_mode)) {
+        return 0;
+    }
+#else
+    if (!_mm_testz_si128(_mm_cmpeq_epi8(_mm_set1_epi8(0xFD), chunk_high),
+           _mm_and_si128(_mm_cmplt_epi8(_mm_set1_epi8(0xD0), chunk_low),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(0xEF), chunk_low))) ||
+        !_mm_testz_si128(_mm_cmpeq_epi8(_mm_set1_epi8(0xFF), chunk_high),
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_set1_epi8(0xFE), chunk_low),
+                         _mm_cmpeq_epi8(_mm_set1_epi8(0xFF), chunk_low)))) {
+        return 0;
+    }
+#endif // __SSE4_2__
+#endif
+
+    return (uint32_t)source_advance;
+}
+
+template <bool kValidate, bool kAllowNonchars = false>
+static inline
+size_t fromUtf8_sse_impl(const char *& src, size_t len, uint16_t * dest, __m128i & error)
+{
+    const char * end = src + len;
+    const uint16_t * dest_first = dest;
+    const utf8::utf8_pack_u16_table_t & pack_table = utf8::utf8_pack_u16_table();
+
+    while ((src + 16) <= end) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+
+        // ASCII optimize, the ASCII bytes are always valid.
+        int asciiMask = _mm_movemask_epi8(chunk);
+        if (!asciiMask) {
+            size_t ascii_len = utf8::utf8_decode_sse_ascii(src, end, dest);
+            dest += ascii_len;
+            src  += ascii_len;
+            continue;
+        }
+
+        // Stop at the block of the first invalid sequence, it's left to the scalar code.
+        if (kValidate) {
+            __m128i block_error = fromUtf8_check_sse<kAllowNonchars>(chunk);
+            if (!_mm_testz_si128(block_error, block_error)) {
+                error = block_error;
+                break;
+            }
+        }
+
+        uint32_t dest_advance;
+        src  += fromUtf8_sse_block(chunk, dest, &dest_advance, pack_table);
+        dest += dest_advance;
+    }
+
+    // Without validation, the last 1 ~ 15 bytes are decoded as a zero padded
+    // block, see utf8::utf8_decode_sse(), else they are left to the scalar code.
+    if (!kValidate) {
+        const char * tail_end = end - utf8::utf8_cut_tail_len(src, end);
+        while (src < tail_end) {
+            __m128i chunk = utf8::utf8_load_tail_sse(src, (size_t)(tail_end - src));
+            uint32_t dest_advance;
+            src  += fromUtf8_sse_block(chunk, dest, &dest_advance, pack_table);
+            dest += dest_advance;
+        }
+
+        // Drop the NUL code units of the padding, one for each byte.
+        if (src > tail_end) {
+            dest -= (size_t)(src - tail_end);
+            src = tail_end;
+        }
+    }
+
+    size_t dest_len = (size_t)(dest - dest_first);
+    return dest_len;
+}
+
+#endif // __SSE4_1__
+
+#endif // FROMUTF8_SSE_KERNEL_H
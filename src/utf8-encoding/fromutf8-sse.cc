@@ -18,6 +18,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <errno.h>
 
 #ifdef __cplusplus
 #include <cstdint>
@@ -26,320 +27,322 @@
 #include <algorithm>
 #endif // __cplusplus
 
-#if defined(_MSC_VER)
-
-#ifndef __SSE4_1__
-#define __SSE4_1__
-#endif
-
-#ifndef __SSE4_2__
-#define __SSE4_2__
-#endif
-
-#endif // _MSC_VER
-
-#ifdef __SSE4_1__
-#include <smmintrin.h>
-#endif
-#ifdef __SSE4_2__
-#include <nmmintrin.h>
-#endif
+//
+// Compiled with the default flags, the SSE4.1 kernels (fromutf8-sse-kernel.h
+// and utf8_latin1_sse.h) are taken from utf8_dispatch.h, or the scalar code.
+//
 
 #include "utf8-encoding/fromutf8-sse.h"
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_dispatch.h"
 
 size_t fromUtf8_sse(const char * src, size_t len, uint16_t * dest)
 {
-#if defined(__SSE4_1__)
-    const char * end = src + len;
-    const uint16_t * dest_first = dest;
-
-    while ((src + 16) <= end) {
-        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    return fromutf8_decode_dispatch(src, len, dest);
+}
 
-#if 0 // ASCII optimize
-        int asciiMask = _mm_movemask_epi8(chunk);
-        if (!asciiMask) {
-            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),     _mm_unpacklo_epi8(chunk, _mm_set1_epi8(0x00)));
-            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), _mm_unpackhi_epi8(chunk, _mm_set1_epi8(0x00)));
-            dest += 16;
-            src  += 16;
+//
+// Decode and validate sequencially, stop at the first invalid sequence.
+// Returns the number of the code units, *valid_len is the bytes of the valid prefix.
+//
+static
+size_t fromUtf8_validate_scalar(const char * src, size_t len, uint16_t * dest, size_t * valid_len)
+{
+    const uint8_t * chars = (const uint8_t *)src;
+    const uint16_t * dest_first = dest;
+    size_t i = 0;
+    while (i < len) {
+        uint32_t ch = chars[i];
+        if (ch < 0x80u) {
+            *dest++ = (uint16_t)ch;
+            i++;
             continue;
         }
-#else
-        int asciiMask = 0xFFFFu;
-#endif
-        __m128i chunk_signed = _mm_add_epi8(chunk, _mm_set1_epi8(0x80u));
-        __m128i cond2 = _mm_cmplt_epi8(_mm_set1_epi8(0xC2u - 1 - 0x80u), chunk_signed);
-        __m128i state = _mm_set1_epi8(0x00u | 0x80u);
-        state = _mm_blendv_epi8(state, _mm_set1_epi8(0x02u | 0xC0u), cond2);
-
-        __m128i cond3 = _mm_cmplt_epi8(_mm_set1_epi8(0xE0u - 1 - 0x80u), chunk_signed);
 
-        // Possible improvement: create a separate processing when there are
-        // only 2 bytes sequences
-        //if (!_mm_movemask_epi8(cond3)) { /* process 2 max */ }
-
-        state = _mm_blendv_epi8(state, _mm_set1_epi8(0x03u | 0xE0u), cond3);
-        __m128i mask3 = _mm_slli_si128(cond3, 1);
-
-        __m128i cond4 = _mm_cmplt_epi8(_mm_set1_epi8(0xF0u - 1 - 0x80u), chunk_signed);
-
-        // 4 bytes sequences are not vectorize. Fall back to the scalar processing
-        if (_mm_movemask_epi8(cond4)) {
-            //break;
+        uint32_t uc, min_uc;
+        size_t need;
+        if ((ch & 0xE0u) == 0xC0u) {
+            uc = ch & 0x1Fu;
+            need = 1;
+            min_uc = 0x80u;
+        } else if ((ch & 0xF0u) == 0xE0u) {
+            uc = ch & 0x0Fu;
+            need = 2;
+            min_uc = 0x800u;
+        } else if ((ch & 0xF8u) == 0xF0u) {
+            uc = ch & 0x07u;
+            need = 3;
+            min_uc = 0x10000u;
+        } else {
+            break;
         }
 
-        __m128i count =  _mm_and_si128(state, _mm_set1_epi8(0x07));
-        __m128i count_sub1 = _mm_subs_epu8(count, _mm_set1_epi8(0x01));
-        __m128i counts = _mm_add_epi8(count, _mm_slli_si128(count_sub1, 1));
-
-        __m128i shifts = count_sub1;
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 1));
-        counts = _mm_add_epi8(counts, _mm_slli_si128(_mm_subs_epu8(counts, _mm_set1_epi8(0x02)), 2));
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 2));
+        // The truncated sequence at the end is also invalid
+        if ((len - i) <= need)
+            break;
 
-#if 0
-        // ASCII characters (and only them) should have the corresponding byte of counts equal 0.
-        if (asciiMask ^ _mm_movemask_epi8(_mm_cmpgt_epi8(counts, _mm_set1_epi8(0x00)))) {
-            break; // error
+        size_t n;
+        for (n = 1; n <= need; n++) {
+            uint32_t body = chars[i + n];
+            if ((body & 0xC0u) != 0x80u)
+                break;
+            uc = (uc << 6) | (body & 0x3Fu);
         }
-#endif
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 4));
-
-#if 0
-        // The difference between a byte in counts and the next one should be negative,
-        // zero, or one. Any other value means there is not enough continuation bytes.
-        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_sub_epi8(
-                              _mm_slli_si128(counts, 1), counts),
-                              _mm_set1_epi8(0x01)))) {
-            break; // error
-        }
-#endif
-
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 8));
-
-        __m128i mask = _mm_and_si128(state, _mm_set1_epi8(0xF8u));
+        if (n <= need)
+            break;
 
-        // Keep only if the corresponding byte should stay
-        // that is, if counts is 1 or 0 (so < 2).
-        shifts = _mm_and_si128(shifts, _mm_cmplt_epi8(counts, _mm_set1_epi8(0x02)));
+        // Overlong sequence, UTF-16 surrogate, above U+10FFFF or non-character
+        if ((uc < min_uc) || ((uc - 0xD800u) < 2048u) || (uc > 0x10FFFFu) ||
+            ((uc >= 0xFDD0u) && (uc <= 0xFDEFu || (uc & 0xFFFEu) == 0xFFFEu)))
+            break;
 
-        chunk = _mm_andnot_si128(mask, chunk); // from now on, we only have usefull bits
+        if (uc < 0x10000u) {
+            *dest++ = (uint16_t)uc;
+        } else {
+            *dest++ = (uint16_t)((uc >> 10) + 0xD7C0u);
+            *dest++ = (uint16_t)((uc % 0x0400u) + 0xDC00u);
+        }
+        i += need + 1;
+    }
 
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 1),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 7), 1));
+    *valid_len = i;
+    return (size_t)(dest - dest_first);
+}
 
-        __m128i chunk_right = _mm_slli_si128(chunk, 1);
+size_t fromUtf8_sse_validate(const char * src, size_t len, uint16_t * dest, size_t * error_offset)
+{
+    size_t src_len;
+    size_t dest_len = fromutf8_decode_valid_dispatch(src, len, dest, &src_len);
 
-        __m128i chunk_low = _mm_blendv_epi8(chunk,
-                                  _mm_or_si128(chunk, _mm_and_si128(_mm_slli_epi16(chunk_right, 6), _mm_set1_epi8(0xC0u))),
-                                  _mm_cmpeq_epi8(counts, _mm_set1_epi8(0x01)));
+    // The rest, or the block of the first invalid sequence.
 
-        __m128i chunk_high = _mm_and_si128(chunk, _mm_cmpeq_epi8(counts, _mm_set1_epi8(0x02)));
+    size_t valid_len;
+    dest_len += fromUtf8_validate_scalar(src + src_len, len - src_len, dest + dest_len, &valid_len);
+    if (error_offset != nullptr)
+        *error_offset = src_len + valid_len;
+    return dest_len;
+}
 
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 2),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 6), 2));
-        chunk_high = _mm_srli_epi32(chunk_high, 2);
+//
+// Decode one character, the invalid sequences are replaced by U+FFFD, one for
+// the longest valid prefix of it (at least the first byte), the same as the
+// "maximal subpart" practice of Unicode, and *replaced is set. Returns the
+// bytes consumed, or 0 if it's a valid prefix cut by the end (avail bytes, at
+// least 1).
+//
+static inline
+size_t fromUtf8_decode_char(const char * src, size_t avail, uint32_t * code_point, bool * replaced)
+{
+    static const uint32_t kReplacementCharacter = 0xFFFDu;
+
+    const uint8_t * chars = (const uint8_t *)src;
+    uint32_t ch = chars[0];
+    *replaced = false;
+    if (ch < 0x80u) {
+        *code_point = ch;
+        return 1;
+    }
 
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 4),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 5), 4));
-        chunk_high = _mm_or_si128(chunk_high, _mm_and_si128(
-                                  _mm_and_si128(_mm_slli_epi32(chunk_right, 4),
-                                                _mm_set1_epi8(0xF0u)), mask3));
-        int c = _mm_extract_epi16(counts, 7);
-        int source_advance = ((c & 0x0200) == 0) ? 16 : (((c & 0x02) == 0) ? 15 : 14);
+    // The range of the 2nd byte excludes the overlong sequences,
+    // the UTF-16 surrogates and the code points above U+10FFFF.
+    uint32_t uc, lower = 0x80u, upper = 0xBFu;
+    size_t need;
+    if (ch >= 0xC2u && ch <= 0xDFu) {
+        uc = ch & 0x1Fu;
+        need = 1;
+    } else if ((ch & 0xF0u) == 0xE0u) {
+        uc = ch & 0x0Fu;
+        need = 2;
+        if (ch == 0xE0u) lower = 0xA0u;
+        if (ch == 0xEDu) upper = 0x9Fu;
+    } else if (ch >= 0xF0u && ch <= 0xF4u) {
+        uc = ch & 0x07u;
+        need = 3;
+        if (ch == 0xF0u) lower = 0x90u;
+        if (ch == 0xF4u) upper = 0x8Fu;
+    } else {
+        *code_point = kReplacementCharacter;
+        *replaced = true;
+        return 1;
+    }
 
-#if 0
-        // For the 3 bytes sequences we check the high byte to prevent
-        // the over long sequence (0x00 - 0x07) or the UTF-16 surrogate (0xD8 - 0xDF)
-        __m128i high_bits = _mm_and_si128(chunk_high, _mm_set1_epi8(0xF8u));
-        if (!_mm_testz_si128(mask3, _mm_or_si128(
-                    _mm_cmpeq_epi8(high_bits, _mm_set1_epi8(0x00u)),
-                    _mm_cmpeq_epi8(high_bits, _mm_set1_epi8(0xD8u))))) {
-            break;
+    for (size_t n = 1; n <= need; n++) {
+        if (n >= avail)
+            return 0;
+        uint32_t body = chars[n];
+        if (body < lower || body > upper) {
+            *code_point = kReplacementCharacter;
+            *replaced = true;
+            return n;
         }
-#endif
-
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 8),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 4), 8));
-
-        chunk_high = _mm_slli_si128(chunk_high, 1);
-
-        __m128i shuf = _mm_add_epi8(shifts, _mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
-
-        // Remove the gaps by shuffling
-        chunk_low  = _mm_shuffle_epi8(chunk_low,  shuf);
-        chunk_high = _mm_shuffle_epi8(chunk_high, shuf);
-
-        // Now we can unpack and store
-        __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
-        __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
+        uc = (uc << 6) | (body & 0x3Fu);
+        lower = 0x80u;
+        upper = 0xBFu;
+    }
 
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),     utf16_low);
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), utf16_high);
+    *code_point = uc;
+    return need + 1;
+}
 
-        int s = _mm_extract_epi32(shifts, 3);
-        int dest_advance = source_advance - (0xFFu & (s >> 8 * (3 - 16 + source_advance)));
+size_t fromUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft)
+{
+    static const size_t kBlockSize = 16;
+
+    const char *& src = *in_buf;
+    uint16_t * dest = reinterpret_cast<uint16_t *>(*out_buf);
+    size_t in_left = *in_bytesleft;
+    size_t out_left = *out_bytesleft / sizeof(uint16_t);
+    size_t invalid = 0;
+    int error = 0;
+
+    while (in_left > 0) {
+        // A block never has more code units than bytes, and the kernel stores at
+        // most a block of units for a whole block of bytes, so nothing is written
+        // beyond min(in_left, out_left) units.
+        size_t len = std::min<size_t>(in_left, out_left);
+        if (len >= kBlockSize) {
+            size_t consumed;
+            size_t written = fromutf8_decode_wellformed_dispatch(src, len, dest, &consumed);
+            in_left  -= consumed;
+            out_left -= written;
+            src  += consumed;
+            dest += written;
+        }
 
-#if 0
-#if defined(__SSE4_2__)
-        // Check for a few more invalid unicode using range comparison and _mm_cmpestrc
-        const int check_mode = 5; /* _SIDD_UWORD_OPS | _SIDD_CMP_RANGES */
-        if (_mm_cmpestrc(_mm_cvtsi64_si128(0xFDEFFDD0FFFFFFFE), 4, utf16_high, 8, check_mode) |
-            _mm_cmpestrc(_mm_cvtsi64_si128(0xFDEFFDD0FFFFFFFE), 4, utf16_low,  8, check_mode)) {
-            break;
+        // The block the kernel stopped at: the first invalid sequence, or the
+        // last bytes of the input or the output. Go back to the kernel after
+        // the first invalid sequence or a block of bytes.
+        const char * block_end = src + std::min<size_t>(in_left, kBlockSize);
+        while (src < block_end) {
+            uint32_t uc;
+            bool replaced;
+            size_t skip = fromUtf8_decode_char(src, in_left, &uc, &replaced);
+            if (skip == 0) {
+                error = EINVAL;
+                break;
+            }
+            size_t units = (uc >= 0x10000u) ? 2 : 1;
+            if (units > out_left) {
+                error = E2BIG;
+                break;
+            }
+            if (uc < 0x10000u) {
+                *dest++ = (uint16_t)uc;
+            } else {
+                *dest++ = (uint16_t)((uc >> 10) + 0xD7C0u);
+                *dest++ = (uint16_t)((uc % 0x0400u) + 0xDC00u);
+            }
+            src += skip;
+            in_left  -= skip;
+            out_left -= units;
+            if (replaced) {
+                invalid++;
+                break;
+            }
         }
-#else
-        if (!_mm_testz_si128(_mm_cmpeq_epi8(_mm_set1_epi8(0xFD), chunk_high),
-               _mm_and_si128(_mm_cmplt_epi8(_mm_set1_epi8(0xD0), chunk_low),
-                             _mm_cmpgt_epi8(_mm_set1_epi8(0xEF), chunk_low))) ||
-            !_mm_testz_si128(_mm_cmpeq_epi8(_mm_set1_epi8(0xFF), chunk_high),
-                _mm_or_si128(_mm_cmpeq_epi8(_mm_set1_epi8(0xFE), chunk_low),
-                             _mm_cmpeq_epi8(_mm_set1_epi8(0xFF), chunk_low)))) {
+        if (error != 0)
             break;
-        }
-#endif // __SSE4_2__
-#endif
-
-        dest += dest_advance;
-        src  += source_advance;
     }
 
-    size_t dest_len = (size_t)(dest - dest_first);
-    return dest_len;
+    *out_bytesleft -= (size_t)(dest - reinterpret_cast<uint16_t *>(*out_buf)) * sizeof(uint16_t);
+    *out_buf = reinterpret_cast<char *>(dest);
+    *in_bytesleft = in_left;
 
-    // The rest will be handled sequencially.
-    // Possible improvement: go back to the vectorized processing after the error or the 4 byte sequence
-#endif // __SSE4_1__
+    if (error != 0) {
+        errno = error;
+        return (size_t)-1;
+    }
+    return invalid;
 }
 
-// Same signature as match iconv
-size_t fromUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft)
+size_t latin1ToUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft)
 {
-    uint16_t *& qch = *reinterpret_cast<uint16_t **>(out_buf);
-    const char *& chars = *const_cast<const char **>(in_buf);
-    size_t len = std::min<size_t>(*in_bytesleft, *out_bytesleft / 2);
-
-    // First process the bytes using SSE
-    fromUtf8_sse(chars, len, qch);
-
-    // Then handle the remaining bytes using scalar algorith.
-    // Basically extracted from from QUtf8::convertToUnicode in qutfcodec.c
-
-    // required QChar API
-    class QChar {
-    public:
-        enum SpecialCharacter {
-            ReplacementCharacter = 0xFFFDu,
-            ObjectReplacementCharacter = 0xFFFCu,
-            LastValidCodePoint = 0x10FFFFu
-        };
-
-        static inline bool isNonCharacter(uint32_t ucs4) {
-            return (ucs4 >= 0xFDD0u) && (ucs4 <= 0xFDEFu || (ucs4 & 0xFFFEu) == 0xFFFEu);
+    const char *& src = *in_buf;
+    char *& dest = *out_buf;
+    size_t in_left = *in_bytesleft;
+    size_t out_left = *out_bytesleft;
+
+    while (in_left > 0) {
+        // The SIMD kernel writes up to 8 bytes after the output, and a character
+        // is 2 bytes at most, so (out_left - 8) / 2 bytes are always converted.
+        if (out_left >= 10) {
+            size_t len = std::min<size_t>(in_left, (out_left - 8) / 2);
+            size_t written = latin1_encode_dispatch(src, len, dest);
+            src  += len;
+            dest += written;
+            in_left  -= len;
+            out_left -= written;
+            continue;
         }
 
-        static inline bool isSurrogate(uint32_t ucs4) {
-            return ((ucs4 - 0xD800u) < 2048u);
-        }
+        // The last bytes of the output, one by one.
+        size_t need = ((uint8_t)*src < 0x80u) ? 1 : 2;
+        if (need > out_left)
+            break;
+        dest += utf8::latin1_to_utf8_scalar(src, 1, dest);
+        src++;
+        in_left--;
+        out_left -= need;
+    }
 
-        static inline bool requiresSurrogates(uint32_t ucs4) {
-            return (ucs4 >= 0x10000u);
-        }
+    *in_bytesleft = in_left;
+    *out_bytesleft = out_left;
 
-        static inline uint16_t highSurrogate(uint32_t ucs4) {
-            return uint16_t((ucs4 >> 10) + 0xD7C0u);
+    if (in_left != 0) {
+        errno = E2BIG;
+        return (size_t)-1;
+    }
+    return 0;
+}
+
+size_t utf8ToLatin1(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft)
+{
+    const char *& src = *in_buf;
+    char *& dest = *out_buf;
+    size_t in_left = *in_bytesleft;
+    size_t out_left = *out_bytesleft;
+    int error = 0;
+
+    while (in_left > 0) {
+        // The SIMD kernel writes up to 8 bytes after the output, and the output
+        // is never longer than the input. Back to the SIMD after every stop.
+        if (out_left > 8) {
+            size_t len = std::min<size_t>(in_left, out_left - 8);
+            size_t consumed;
+            size_t written = latin1_decode_dispatch(src, len, dest, &consumed);
+            src  += consumed;
+            dest += written;
+            in_left  -= consumed;
+            out_left -= written;
+            if (consumed == len)
+                continue;
         }
 
-        static inline uint16_t lowSurrogate(uint32_t ucs4) {
-            return uint16_t((ucs4 % 0x0400u) + 0xDC00u);
+        // The character the kernel stopped at, or the last bytes of the output.
+        if (out_left == 0) {
+            error = E2BIG;
+            break;
         }
-    };
-
-    bool header_done = false;
-    uint16_t replacement = QChar::ReplacementCharacter;
-    int need = 0;
-    int error = -1;
-    int invalid = 0;
-
-    uint8_t ch;
-    uint32_t uc = 0;
-    uint32_t min_uc = 0;
-
-    uint16_t * start = qch;
-
-    int i;
-    for (i = 0; i < len - need; ++i) {
-        ch = (uint8_t)chars[i];
-        if (need != 0) {
-            if ((ch & 0xC0u) == 0x80u) {
-                uc = (uc << 6) | (ch & 0x3Fu);
-                --need;
-                if (need == 0) {
-                    // utf-8 bom composes into 0xFEFF code point
-                    bool nonCharacter;
-                    if (!header_done && uc == 0xFEFFu) {
-                        // don't do anything, just skip the BOM
-                    } else if (!(nonCharacter = QChar::isNonCharacter(uc)) && QChar::requiresSurrogates(uc) && uc <= QChar::LastValidCodePoint) {
-                        // surrogate pair
-                        *qch++ = QChar::highSurrogate(uc);
-                        *qch++ = QChar::lowSurrogate(uc);
-                    } else if ((uc < min_uc) || QChar::isSurrogate(uc) || nonCharacter || uc > QChar::LastValidCodePoint) {
-                        // error: overlong sequence, UTF16 surrogate or non-character
-                        *qch++ = replacement;
-                        ++invalid;
-                    } else {
-                        *qch++ = ((uc & 0xFFu) << 8) | ((uc & 0xFF00u) >> 8);
-                    }
-                    header_done = true;
-                }
-            } else {
-                // error
-                i = error;
-                *qch++ = replacement;
-                ++invalid;
-                need = 0;
-                header_done = true;
-            }
-        } else {
-            if (ch < 128) {
-                *qch++ = uint16_t(ch) << 8;
-                header_done = true;
-            } else if ((ch & 0xE0u) == 0xC0u) {
-                uc = ch & 0x1Fu;
-                need = 1;
-                error = i;
-                min_uc = 0x80u;
-                header_done = true;
-            } else if ((ch & 0xF0u) == 0xE0u) {
-                uc = ch & 0x0Fu;
-                need = 2;
-                error = i;
-                min_uc = 0x800u;
-            } else if ((ch & 0xF8u) == 0xF0u) {
-                uc = ch & 0x07u;
-                need = 3;
-                error = i;
-                min_uc = 0x10000u;
-                header_done = true;
-            } else {
-                // error
-                *qch++ = replacement;
-                ++invalid;
-                header_done = true;
-            }
+        uint8_t ch = (uint8_t)*src;
+        size_t consumed;
+        size_t written = utf8::utf8_to_latin1_scalar(src, (ch < 0x80u) ? 1 : std::min<size_t>(in_left, 2),
+                                                     dest, &consumed);
+        if (written == 0) {
+            error = ((ch & 0xFEu) == 0xC2u && in_left == 1) ? EINVAL : EILSEQ;
+            break;
         }
+        src  += consumed;
+        dest += written;
+        in_left  -= consumed;
+        out_left -= written;
     }
 
-    if (need) {
-        i--;
-    }
-
-    *in_bytesleft = len - i;
-    chars += i;
+    *in_bytesleft = in_left;
+    *out_bytesleft = out_left;
 
-    size_t r = (qch - start);
-    *out_bytesleft -= r;
-
-    return (need ? -1 : 0);
+    if (error != 0) {
+        errno = error;
+        return (size_t)-1;
+    }
+    return 0;
 }
@@ -14,9 +14,37 @@
 extern "C" {
 #endif
 
+// Decode all the whole characters without validation, same as utf8::utf8_decode_sse(),
+// the dest must have room for (len + 16) code units.
 size_t fromUtf8_sse(const char * src, size_t len, uint16_t * dest);
+
+// Returns the number of UTF-16 code units before the first invalid sequence,
+// *error_offset is the byte offset of it, or len if the whole input is valid.
+size_t fromUtf8_sse_validate(const char * src, size_t len, uint16_t * dest, size_t * error_offset);
+
+//
+// UTF-8 to UTF-16, same signature as iconv(), the output is never written beyond
+// *out_bytesleft. The invalid sequences are replaced by U+FFFD, one for the
+// longest valid prefix of each (at least one byte).
+//
+// Returns the number of the replaced sequences if all the input is converted,
+// else (size_t)-1 and errno is E2BIG (the output is full) or EINVAL (a sequence
+// cut by the end of the input), the input stops before it.
+//
 size_t fromUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft);
 
+//
+// Latin-1 (ISO-8859-1) <--> UTF-8, same signature as iconv(): *in_buf and *out_buf
+// are advanced past the bytes consumed and written, *in_bytesleft and *out_bytesleft
+// are decreased by them, the output is never written beyond *out_bytesleft.
+//
+// Returns 0 if all the input is converted, else (size_t)-1 and errno is E2BIG
+// (the output is full), EILSEQ (a character above U+00FF or an invalid sequence)
+// or EINVAL (a sequence cut by the end of the input), the input stops before it.
+//
+size_t latin1ToUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft);
+size_t utf8ToLatin1(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,363 @@
+#ifndef UTF8_DECODE_AVX2_H
+#define UTF8_DECODE_AVX2_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "utf8-encoding/utf8_decode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__AVX2__)
+
+//
+// Same as utf8_decode_sse_ascii(), widen the pure ASCII run by vpmovzxbw,
+// 64 bytes per round, then 32 bytes. The first 32 bytes must be ASCII.
+//
+static inline
+size_t utf8_decode_avx2_ascii(const char * src, const char * end, uint16_t * dest)
+{
+    const char * first = src;
+
+    while ((src + 64) <= end) {
+        __m256i chunk0 = _mm256_loadu_si256((const __m256i *)(src + 0));
+        __m256i chunk1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(chunk0, chunk1)) != 0)
+            break;
+
+        _mm256_storeu_si256((__m256i *)(dest + 0),  _mm256_cvtepu8_epi16(_mm256_castsi256_si128(chunk0)));
+        _mm256_storeu_si256((__m256i *)(dest + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(chunk0, 1)));
+        _mm256_storeu_si256((__m256i *)(dest + 32), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(chunk1)));
+        _mm256_storeu_si256((__m256i *)(dest + 48), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(chunk1, 1)));
+        src  += 64;
+        dest += 64;
+    }
+
+    while ((src + 32) <= end) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)src);
+        if (_mm256_movemask_epi8(chunk) != 0)
+            break;
+
+        _mm256_storeu_si256((__m256i *)(dest + 0),  _mm256_cvtepu8_epi16(_mm256_castsi256_si128(chunk)));
+        _mm256_storeu_si256((__m256i *)(dest + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(chunk, 1)));
+        src  += 32;
+        dest += 32;
+    }
+
+    return (size_t)(src - first);
+}
+
+//
+// The 32 bytes are split into two 16 bytes lanes, and each lane runs the same
+// algorithm as utf8_decode_sse(), because the byte shifts, pshufb and blendv
+// of AVX2 all work inside a 128 bit lane. The first lane ends at the last
+// character boundary in [14, 16], the second lane is loaded from there.
+//
+// The last 0 ~ 31 bytes are decoded by utf8_decode_sse(), with its zero padded
+// tail blocks, so all the whole characters are decoded, the same as it. The
+// dest must have room for (len + 16) code units.
+//
+static inline
+size_t utf8_decode_avx2(const char * src, size_t len, uint16_t * dest)
+{
+    static const size_t kPerLoopBytes = 32;
+
+    const __m256i reverse_contiguous_1_lookup
+                                = _mm256_setr_epi8(0, 1, 1, 2, 1, 1, 2, 3, 1, 1, 1, 1, 2, 2, 3, 4,
+                                                   0, 1, 1, 2, 1, 1, 2, 3, 1, 1, 1, 1, 2, 2, 3, 4);
+    const __m256i shuffle_base  = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                                   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m256i head_mask     = _mm256_set1_epi8(0xC0u);
+    const __m256i body_mask     = _mm256_set1_epi8(0x80u);
+    const __m256i mask4         = _mm256_set1_epi8(0x0F);
+    const __m256i mb4_mask      = _mm256_set1_epi8(0xF0u);
+    const __m256i ones_mask     = _mm256_set1_epi8(0x01);
+    const __m256i twos_mask     = _mm256_set1_epi8(0x02);
+    const __m256i threes_mask   = _mm256_set1_epi8(0x03);
+
+    const char * end = src + len;
+    const uint16_t * dest_first = dest;
+
+    __m256i all_zeros = _mm256_setzero_si256();
+
+    while ((src + kPerLoopBytes) <= end) {
+        __m256i whole = _mm256_loadu_si256((const __m256i *)src);
+
+        // The pure ASCII run
+        if (_mm256_movemask_epi8(whole) == 0) {
+            size_t ascii_len = utf8_decode_avx2_ascii(src, end, dest);
+            src  += ascii_len;
+            dest += ascii_len;
+            continue;
+        }
+
+        // Have any 4 bytes sequences, decode 16 bytes with utf8_decode_sse_mb4_block().
+        __m256i whole_is_mb4 = _mm256_cmpeq_epi8(_mm256_and_si256(whole, mb4_mask), mb4_mask);
+        if (_mm256_movemask_epi8(whole_is_mb4) != 0) {
+            uint32_t dest_advance;
+            src  += utf8_decode_sse_mb4_block(_mm256_castsi256_si128(whole), dest, &dest_advance);
+            dest += dest_advance;
+            continue;
+        }
+
+        // The second lane starts at the last non-continuation byte in [14, 16].
+        __m256i whole_is_first = _mm256_and_si256(whole, head_mask);
+        uint32_t body_bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(whole_is_first, body_mask));
+        uint32_t lane1_offset = (uint32_t)bit_bsr32((~body_bits & 0x0001FFFFu) | 0x00004000u);
+        assert(lane1_offset >= 14 && lane1_offset <= 16);
+
+        __m128i lane1 = _mm_loadu_si128((const __m128i *)(src + lane1_offset));
+        __m256i chunk = _mm256_inserti128_si256(whole, lane1, 1);
+
+        __m256i chunk_is_first = _mm256_and_si256(chunk, head_mask);
+        __m256i is_first_mask  = _mm256_cmpeq_epi8(chunk_is_first, head_mask);
+        __m256i is_first_chunk = _mm256_and_si256(chunk, is_first_mask);
+
+        __m256i mb_mask_high4 = _mm256_srli_epi16(is_first_chunk, 4);
+        __m256i mb_mask_4 = _mm256_and_si256(mb_mask_high4, mask4);
+        __m256i count = _mm256_shuffle_epi8(reverse_contiguous_1_lookup, mb_mask_4);
+
+        __m256i count_sub1 = _mm256_subs_epu8(count, ones_mask);
+        __m256i counts = _mm256_or_si256(count, _mm256_slli_si256(count_sub1, 1));
+        __m256i count_sub2_shift2 = _mm256_slli_si256(_mm256_subs_epu8(count, twos_mask), 2);
+        counts = _mm256_or_si256(counts, count_sub2_shift2);
+
+        __m256i shifts = count_sub1;
+        shifts = _mm256_add_epi8(shifts, _mm256_slli_si256(shifts, 1));
+        shifts = _mm256_add_epi8(shifts, _mm256_slli_si256(shifts, 2));
+        shifts = _mm256_add_epi8(shifts, _mm256_slli_si256(shifts, 4));
+        shifts = _mm256_add_epi8(shifts, _mm256_slli_si256(shifts, 8));
+
+        // counts < 2
+        __m256i tail_chars_mask = _mm256_cmpgt_epi8(twos_mask, counts);
+
+        shifts = _mm256_and_si256(shifts, tail_chars_mask);
+
+        uint32_t tail_chars = (uint32_t)_mm256_movemask_epi8(tail_chars_mask);
+        uint32_t tail_chars_lane0 = tail_chars & 0x0000FFFFu;
+        uint32_t tail_chars_lane1 = tail_chars >> 16;
+        assert(tail_chars_lane1 != 0);
+
+        uint32_t source_advance = lane1_offset + (uint32_t)bit_bsr32(tail_chars_lane1) + 1;
+        uint32_t dest_advance0  = (uint32_t)_mm_popcnt_u32(tail_chars_lane0);
+        uint32_t dest_advance1  = (uint32_t)_mm_popcnt_u32(tail_chars_lane1);
+
+        shifts = _mm256_blendv_epi8(shifts, _mm256_srli_si256(shifts, 1),
+                                    _mm256_srli_si256(_mm256_slli_epi16(shifts, 7), 1));
+
+        shifts = _mm256_blendv_epi8(shifts, _mm256_srli_si256(shifts, 2),
+                                    _mm256_srli_si256(_mm256_slli_epi16(shifts, 6), 2));
+
+        __m256i ascii_mask  = _mm256_cmpeq_epi8(counts, all_zeros);
+        __m256i chunk_ascii = _mm256_and_si256(chunk, ascii_mask);
+
+        __m256i mb_1_mask  = _mm256_cmpeq_epi8(counts, ones_mask);
+        __m256i chunk_mb_1 = _mm256_and_si256(chunk, mb_1_mask);
+        __m256i chunk_low_05 = _mm256_and_si256(chunk_mb_1, _mm256_set1_epi8(0x3Fu));
+
+        shifts = _mm256_blendv_epi8(shifts, _mm256_srli_si256(shifts, 4),
+                                    _mm256_srli_si256(_mm256_slli_epi16(shifts, 5), 4));
+
+        __m256i mb_2_mask  = _mm256_cmpeq_epi8(counts, twos_mask);
+        __m256i chunk_mb_2 = _mm256_slli_si256(_mm256_and_si256(chunk, mb_2_mask), 1);
+        __m256i chunk_low_67 = _mm256_and_si256(_mm256_slli_epi16(chunk_mb_2, 6), _mm256_set1_epi8(0xC0u));
+
+        __m256i chunk_low = _mm256_or_si256(_mm256_or_si256(chunk_low_05, chunk_low_67), chunk_ascii);
+
+        shifts = _mm256_blendv_epi8(shifts, _mm256_srli_si256(shifts, 8),
+                                    _mm256_srli_si256(_mm256_slli_epi16(shifts, 4), 8));
+
+        __m256i mb_3_mask  = _mm256_cmpeq_epi8(counts, threes_mask);
+        __m256i chunk_mb_3 = _mm256_slli_si256(_mm256_and_si256(chunk, mb_3_mask), 2);
+
+        __m256i chunk_high_03 = _mm256_and_si256(_mm256_srli_epi16(chunk_mb_2, 2), _mm256_set1_epi8(0x0Fu));
+        __m256i chunk_high_47 = _mm256_and_si256(_mm256_slli_epi16(chunk_mb_3, 4), _mm256_set1_epi8(0xF0u));
+
+        __m256i chunk_high = _mm256_or_si256(chunk_high_03, chunk_high_47);
+
+        __m256i shift_and_shuffle = _mm256_add_epi8(shifts, shuffle_base);
+
+        // Remove the gaps by shuffling
+        chunk_low  = _mm256_shuffle_epi8(chunk_low,  shift_and_shuffle);
+        chunk_high = _mm256_shuffle_epi8(chunk_high, shift_and_shuffle);
+
+        // Now we can unpack and store, the unpack also works in the 128 bit lanes,
+        // so gather the 16 code units of each lane before storing.
+        __m256i utf16_low  = _mm256_unpacklo_epi8(chunk_low, chunk_high);
+        __m256i utf16_high = _mm256_unpackhi_epi8(chunk_low, chunk_high);
+
+        __m256i utf16_lane0 = _mm256_permute2x128_si256(utf16_low, utf16_high, 0x20);
+        __m256i utf16_lane1 = _mm256_permute2x128_si256(utf16_low, utf16_high, 0x31);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), utf16_lane0);
+        dest += dest_advance0;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), utf16_lane1);
+        dest += dest_advance1;
+
+        src += source_advance;
+    }
+
+    dest += utf8_decode_sse(src, (size_t)(end - src), dest);
+
+    size_t unicode_len = (size_t)(dest - dest_first);
+    return unicode_len;
+}
+
+//
+// Same as utf16_length_from_utf8_sse(), 64 bytes per round by 2 ymm registers,
+// at most 4 per byte counter, so they are summed every 63 rounds. The last
+// bytes are counted by utf16_length_from_utf8_sse().
+//
+static inline
+size_t utf16_length_from_utf8_avx2(const char * src, size_t len)
+{
+    static const size_t kMaxRounds = 63;
+
+    const char * end = src + len;
+    size_t units = 0;
+
+    __m256i body_max = _mm256_set1_epi8(-65);
+    __m256i mb4_min  = _mm256_set1_epi8((char)0xF0u);
+    __m256i zeros    = _mm256_setzero_si256();
+
+    while ((src + 64) <= end) {
+        size_t rounds = (size_t)(end - src) / 64;
+        if (rounds > kMaxRounds)
+            rounds = kMaxRounds;
+
+        __m256i counts = _mm256_setzero_si256();
+        for (size_t i = 0; i < rounds; i++) {
+            __m256i chunk0 = _mm256_loadu_si256((const __m256i *)(src + 0));
+            __m256i chunk1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+
+            counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(chunk0, body_max));
+            counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(chunk1, body_max));
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(_mm256_max_epu8(chunk0, mb4_min), chunk0));
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(_mm256_max_epu8(chunk1, mb4_min), chunk1));
+            src += 64;
+        }
+
+        __m256i sums = _mm256_sad_epu8(counts, zeros);
+        __m128i sums128 = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        units += (size_t)_mm_cvtsi128_si32(sums128) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums128, 8));
+    }
+
+    units += utf16_length_from_utf8_sse(src, (size_t)(end - src));
+    return units;
+}
+
+// The sign bits of the 64 bytes of 2 ymm blocks, bit i is the byte i.
+static inline
+uint64_t utf8_movemask64_avx2(__m256i mask0, __m256i mask1)
+{
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(mask0) |
+          ((uint64_t)(uint32_t)_mm256_movemask_epi8(mask1) << 32u);
+}
+
+//
+// Same as count_code_points_sse(), the 64 bits mask is gathered from 2 ymm
+// registers. The last bytes are counted by count_code_points_sse().
+//
+static inline
+size_t count_code_points_avx2(const char * src, size_t len)
+{
+    const char * end = src + len;
+    size_t count = 0;
+
+    __m256i body_max = _mm256_set1_epi8(-65);
+
+    while ((src + 64) <= end) {
+        __m256i chunk0 = _mm256_loadu_si256((const __m256i *)(src + 0));
+        __m256i chunk1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+
+        uint64_t lead_bits = utf8_movemask64_avx2(_mm256_cmpgt_epi8(chunk0, body_max),
+                                                  _mm256_cmpgt_epi8(chunk1, body_max));
+        count += bit_popcnt64(lead_bits);
+        src += 64;
+    }
+
+    count += count_code_points_sse(src, (size_t)(end - src));
+    return count;
+}
+
+//
+// Same as utf8_seq_histogram_sse(), by 2 ymm registers per round.
+//
+static inline
+void utf8_seq_histogram_avx2(const char * src, size_t len, size_t counts[4])
+{
+    const char * end = src + len;
+    size_t ascii = 0, mb2_above = 0, mb3_above = 0, mb4_above = 0;
+
+    __m256i mb2_min = _mm256_set1_epi8((char)0xBFu);
+    __m256i mb3_min = _mm256_set1_epi8((char)0xDFu);
+    __m256i mb4_min = _mm256_set1_epi8((char)0xEFu);
+
+    while ((src + 64) <= end) {
+        __m256i chunk0 = _mm256_loadu_si256((const __m256i *)(src + 0));
+        __m256i chunk1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+        src += 64;
+
+        uint64_t non_ascii = utf8_movemask64_avx2(chunk0, chunk1);
+        if (non_ascii == 0) {
+            ascii += 64;
+            continue;
+        }
+
+        uint64_t mb2_bits = utf8_movemask64_avx2(_mm256_cmpgt_epi8(chunk0, mb2_min),
+                                                 _mm256_cmpgt_epi8(chunk1, mb2_min));
+        uint64_t mb3_bits = utf8_movemask64_avx2(_mm256_cmpgt_epi8(chunk0, mb3_min),
+                                                 _mm256_cmpgt_epi8(chunk1, mb3_min));
+        uint64_t mb4_bits = utf8_movemask64_avx2(_mm256_cmpgt_epi8(chunk0, mb4_min),
+                                                 _mm256_cmpgt_epi8(chunk1, mb4_min));
+
+        ascii     += 64 - bit_popcnt64(non_ascii);
+        mb2_above += bit_popcnt64(mb2_bits & non_ascii);
+        mb3_above += bit_popcnt64(mb3_bits & non_ascii);
+        mb4_above += bit_popcnt64(mb4_bits & non_ascii);
+    }
+
+    counts[0] += ascii;
+    counts[1] += mb2_above - mb3_above;
+    counts[2] += mb3_above - mb4_above;
+    counts[3] += mb4_above;
+
+    utf8_seq_histogram_sse(src, (size_t)(end - src), counts);
+}
+
+#ifdef __cplusplus
+
+template <size_t N>
+static inline
+size_t utf8_decode_avx2(const char * src, size_t len, uint16_t (&dest)[N])
+{
+    return utf8_decode_avx2(src, len, dest);
+}
+
+#endif // __cplusplus
+
+#endif // __AVX2__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_DECODE_AVX2_H
@@ -0,0 +1,224 @@
+#ifndef UTF8_DECODE_AVX512_H
+#define UTF8_DECODE_AVX512_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "utf8-encoding/utf8_decode_sse.h"
+
+//
+// vpermb (AVX512_VBMI) and vpcompressb (AVX512_VBMI2) are only available
+// on Ice Lake and newer, InstructionSet() returns 17 or above for them.
+//
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VBMI__) && defined(__AVX512VBMI2__) \
+ && (defined(_M_X64) || defined(_M_AMD64) || defined(__amd64__) || defined(__x86_64__))
+#define UTF8_HAVE_AVX512_VBMI2  1
+#endif
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if UTF8_HAVE_AVX512_VBMI2
+
+//
+// Every byte is decoded as if it were the last byte of a character, from the
+// byte itself and the two bytes before it (moved in by vpermb). Then the code
+// units which really end a character are packed by vpcompressb, so there is
+// no prefix-sum of the shifts like in utf8_decode_sse(). A 4 bytes sequence
+// ends two code units, the UTF-16 surrogate pair.
+//
+// Only the bytes in valid_bits are decoded, the byte after the last one must
+// be known (or zero), so the byte 63 is never the end of a character in a full
+// block. Returns the bytes consumed, the 64 code units are returned to
+// *utf16_low and *utf16_high, dest_advance of them are decoded.
+//
+static inline
+uint32_t utf8_decode_avx512_block(__m512i chunk, uint64_t valid_bits,
+                                  __m512i * utf16_low, __m512i * utf16_high,
+                                  uint32_t * dest_advance)
+{
+    const __m512i byte_index    = _mm512_set_epi64(0x3F3E3D3C3B3A3938ull, 0x3736353433323130ull,
+                                                   0x2F2E2D2C2B2A2928ull, 0x2726252423222120ull,
+                                                   0x1F1E1D1C1B1A1918ull, 0x1716151413121110ull,
+                                                   0x0F0E0D0C0B0A0908ull, 0x0706050403020100ull);
+    const __m512i prev1_index   = _mm512_sub_epi8(byte_index, _mm512_set1_epi8(1));
+    const __m512i prev2_index   = _mm512_sub_epi8(byte_index, _mm512_set1_epi8(2));
+    // Interleave the low and high bytes: byte (2 * i) = low[i], byte (2 * i + 1) = high[i].
+    const __m512i unpack_lo_index = _mm512_or_si512(
+                                        _mm512_and_si512(_mm512_srli_epi16(byte_index, 1), _mm512_set1_epi8(0x1F)),
+                                        _mm512_and_si512(_mm512_slli_epi16(byte_index, 6), _mm512_set1_epi8(0x40)));
+    const __m512i unpack_hi_index = _mm512_add_epi8(unpack_lo_index, _mm512_set1_epi8(32));
+    const __m512i lead_min      = _mm512_set1_epi8(0xC0u);
+    const __m512i mb4_min       = _mm512_set1_epi8(0xF0u);
+    const __m512i mask_0F       = _mm512_set1_epi8(0x0F);
+    const __m512i mask_1F       = _mm512_set1_epi8(0x1F);
+    const __m512i mask_3F       = _mm512_set1_epi8(0x3F);
+    const __m512i mask_C0       = _mm512_set1_epi8(0xC0u);
+    const __m512i mask_F0       = _mm512_set1_epi8(0xF0u);
+
+    uint64_t ascii_bits = ~(uint64_t)_mm512_movepi8_mask(chunk);
+    uint64_t lead_bits  = (uint64_t)_mm512_cmpge_epu8_mask(chunk, lead_min);
+    uint64_t body_bits  = ~(ascii_bits | lead_bits);
+
+    // A byte is the last byte of a character if the next byte is not a continuation byte.
+    uint64_t tail_bits  = ((~body_bits) >> 1) & valid_bits;
+    assert(tail_bits != 0);
+
+    uint32_t source_advance = (uint32_t)bit_bsr64(tail_bits) + 1;
+
+    __m512i prev1 = _mm512_maskz_permutexvar_epi8(~1ull, prev1_index, chunk);
+    __m512i prev2 = _mm512_maskz_permutexvar_epi8(~3ull, prev2_index, chunk);
+
+    // 0xxxxxxx: 7 bits, 10xxxxxx: 6 bits
+    __m512i bits_0 = _mm512_mask_blend_epi8(ascii_bits, _mm512_and_si512(chunk, mask_3F), chunk);
+    // 110xxxxx 10xxxxxx or 1110xxxx 10xxxxxx 10xxxxxx
+    __m512i bits_1 = _mm512_maskz_mov_epi8(~ascii_bits,
+                        _mm512_and_si512(prev1, _mm512_mask_blend_epi8(lead_bits << 1, mask_3F, mask_1F)));
+    __m512i bits_2 = _mm512_maskz_mov_epi8(~(ascii_bits | (lead_bits << 1)), _mm512_and_si512(prev2, mask_0F));
+
+    __m512i chunk_low  = _mm512_or_si512(bits_0, _mm512_and_si512(_mm512_slli_epi16(bits_1, 6), mask_C0));
+    __m512i chunk_high = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(bits_1, 2), mask_0F),
+                                         _mm512_and_si512(_mm512_slli_epi16(bits_2, 4), mask_F0));
+
+    uint64_t mb4_bits = (uint64_t)_mm512_cmpge_epu8_mask(chunk, mb4_min);
+    if (mb4_bits != 0) {
+        // The 3rd byte of a 4 bytes sequence is the end of the high surrogate,
+        // and the 4th byte is the end of the low surrogate (wwww = uuuuu - 1):
+        //
+        //   11110uuu 10uuzzzz 10yyyyyy 10xxxxxx => 110110ww wwzzzzyy 110111yy yyxxxxxx
+        //
+        uint64_t high_surr_bits = (mb4_bits << 2) & ((1ull << source_advance) - 1);
+        uint64_t low_surr_bits  = (mb4_bits << 3);
+
+        __m512i plane = _mm512_or_si512(_mm512_and_si512(_mm512_slli_epi16(prev2, 2), _mm512_set1_epi8(0x1C)),
+                                        _mm512_and_si512(_mm512_srli_epi16(prev1, 4), _mm512_set1_epi8(0x03)));
+        plane = _mm512_sub_epi8(plane, _mm512_set1_epi8(1));
+
+        __m512i high_surr_low  = _mm512_or_si512(_mm512_and_si512(_mm512_slli_epi16(plane, 6), mask_C0),
+                                 _mm512_or_si512(_mm512_and_si512(_mm512_slli_epi16(prev1, 2), _mm512_set1_epi8(0x3C)),
+                                                 _mm512_and_si512(_mm512_srli_epi16(chunk, 4), _mm512_set1_epi8(0x03))));
+        __m512i high_surr_high = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(plane, 2), _mm512_set1_epi8(0x03)),
+                                                 _mm512_set1_epi8(0xD8u));
+        __m512i low_surr_high  = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(prev1, 2), _mm512_set1_epi8(0x03)),
+                                                 _mm512_set1_epi8(0xDCu));
+
+        chunk_low  = _mm512_mask_blend_epi8(high_surr_bits, chunk_low,  high_surr_low);
+        chunk_high = _mm512_mask_blend_epi8(high_surr_bits, chunk_high, high_surr_high);
+        chunk_high = _mm512_mask_blend_epi8(low_surr_bits,  chunk_high, low_surr_high);
+
+        tail_bits |= high_surr_bits;
+    }
+
+    *dest_advance = (uint32_t)_mm_popcnt_u64(tail_bits);
+
+    // Drop the bytes which are not the end of a code unit
+    chunk_low  = _mm512_maskz_compress_epi8(tail_bits, chunk_low);
+    chunk_high = _mm512_maskz_compress_epi8(tail_bits, chunk_high);
+
+    *utf16_low  = _mm512_permutex2var_epi8(chunk_low, unpack_lo_index, chunk_high);
+    *utf16_high = _mm512_permutex2var_epi8(chunk_low, unpack_hi_index, chunk_high);
+
+    return source_advance;
+}
+
+//
+// Decode the 64 bytes blocks by utf8_decode_avx512_block(), each round consumes
+// 61 ~ 63 bytes. The last 1 ~ 63 bytes, without the character cut by the end,
+// are loaded by a masked load as a zero padded block. Only the code units
+// decoded are stored by the masked stores, in the loop and in the tail, so all
+// the whole characters are decoded and nothing is written beyond the output.
+//
+static inline
+size_t utf8_decode_avx512(const char * src, size_t len, uint16_t * dest)
+{
+    static const size_t kPerLoopBytes = 64;
+
+    const char * end = src + len;
+    const char * tail_end = end - utf8_cut_tail_len(src, end);
+    const uint16_t * dest_first = dest;
+
+    __m512i utf16_low, utf16_high;
+    uint32_t dest_advance;
+
+    while ((src + kPerLoopBytes) <= end) {
+        __m512i chunk = _mm512_loadu_si512((const void *)src);
+
+        // The pure ASCII block, all the 64 sign bits are zero
+        if (_mm512_movepi8_mask(chunk) == 0) {
+            _mm512_storeu_si512((void *)dest,        _mm512_cvtepu8_epi16(_mm512_castsi512_si256(chunk)));
+            _mm512_storeu_si512((void *)(dest + 32), _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(chunk, 1)));
+            dest += kPerLoopBytes;
+            src  += kPerLoopBytes;
+            continue;
+        }
+
+        src += utf8_decode_avx512_block(chunk, ~0ull, &utf16_low, &utf16_high, &dest_advance);
+
+        // Byte 63 never ends a character, dest_advance is 63 at most.
+        uint64_t store_bits = (1ull << dest_advance) - 1;
+        _mm512_mask_storeu_epi16((void *)dest,        (__mmask32)store_bits,         utf16_low);
+        _mm512_mask_storeu_epi16((void *)(dest + 32), (__mmask32)(store_bits >> 32), utf16_high);
+        dest += dest_advance;
+    }
+
+    if (src < tail_end) {
+        size_t tail_len = (size_t)(tail_end - src);
+        assert(tail_len < kPerLoopBytes);
+        uint64_t valid_bits = (1ull << tail_len) - 1;
+        __m512i chunk = _mm512_maskz_loadu_epi8(valid_bits, (const void *)src);
+
+        if (_mm512_movepi8_mask(chunk) == 0) {
+            utf16_low  = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(chunk));
+            utf16_high = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(chunk, 1));
+            dest_advance = (uint32_t)tail_len;
+            src += tail_len;
+        } else {
+            src += utf8_decode_avx512_block(chunk, valid_bits, &utf16_low, &utf16_high, &dest_advance);
+        }
+        assert(src == tail_end);
+
+        uint64_t store_bits = (1ull << dest_advance) - 1;
+        _mm512_mask_storeu_epi16((void *)dest,        (__mmask32)store_bits,         utf16_low);
+        _mm512_mask_storeu_epi16((void *)(dest + 32), (__mmask32)(store_bits >> 32), utf16_high);
+        dest += dest_advance;
+    }
+
+    size_t unicode_len = (size_t)(dest - dest_first);
+    return unicode_len;
+}
+
+#ifdef __cplusplus
+
+template <size_t N>
+static inline
+size_t utf8_decode_avx512(const char * src, size_t len, uint16_t (&dest)[N])
+{
+    return utf8_decode_avx512(src, len, dest);
+}
+
+#endif // __cplusplus
+
+#endif // UTF8_HAVE_AVX512_VBMI2
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_DECODE_AVX512_H
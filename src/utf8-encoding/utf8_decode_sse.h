@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #ifdef __cplusplus
@@ -29,6 +30,14 @@
 
 #endif // _MSC_VER
 
+//
+// MSVC doesn't define __SSE2__, the x64 target and /arch:SSE2 always have it.
+//
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define UTF8_HAVE_SSE2  1
+#include <emmintrin.h>
+#endif
+
 #ifdef __SSE4_1__
 #include <smmintrin.h>
 #endif
@@ -37,6 +46,16 @@
 #endif
 
 //#include "utf8-encoding/BitUtils.h"
+#include "utf8-encoding/utf8_utils.h"
+
+//
+// The tail block of the decoders may read the bytes beyond the buffer in the same page.
+//
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5))
+#define UTF8_NO_SANITIZE_ADDRESS    __attribute__((no_sanitize_address))
+#else
+#define UTF8_NO_SANITIZE_ADDRESS
+#endif
 
 #define USE_NEW_SOURCE_ADVANCE  1
 #define USE_NEW_DEST_ADVANCE    0
@@ -69,6 +88,332 @@ unsigned int bit_bsr32(unsigned int x) {
 #endif
 }
 
+static inline
+unsigned int bit_bsf32(unsigned int x) {
+    assert(x != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    ::_BitScanForward(&index, (unsigned long)x);
+    return (unsigned int)index;
+#else
+    // gcc: __bsfd(x)
+    return (unsigned int)__builtin_ctz(x);
+#endif
+}
+
+#if defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) || defined(__amd64__) || defined(__x86_64__)
+static inline
+unsigned int bit_bsr64(unsigned long long x) {
+    assert(x != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    ::_BitScanReverse64(&index, (unsigned __int64)x);
+    return (unsigned int)index;
+#else
+    // gcc: __bsrq(x)
+    return (unsigned int)(63 - __builtin_clzll(x));
+#endif
+}
+#endif // x86_64
+
+static inline
+unsigned int bit_popcnt32(unsigned int x) {
+#if defined(_MSC_VER)
+    return (unsigned int)::__popcnt(x);
+#else
+    return (unsigned int)__builtin_popcount(x);
+#endif
+}
+
+static inline
+unsigned int bit_popcnt64(unsigned long long x) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+    return (unsigned int)::__popcnt64(x);
+#elif defined(_MSC_VER)
+    return (unsigned int)(::__popcnt((unsigned int)x) + ::__popcnt((unsigned int)(x >> 32)));
+#else
+    return (unsigned int)__builtin_popcountll(x);
+#endif
+}
+
+static inline
+unsigned int bit_bsf64(unsigned long long x) {
+    assert(x != 0);
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+    unsigned long index;
+    ::_BitScanForward64(&index, (unsigned __int64)x);
+    return (unsigned int)index;
+#elif defined(_MSC_VER)
+    if ((unsigned int)x != 0)
+        return bit_bsf32((unsigned int)x);
+    else
+        return (32 + bit_bsf32((unsigned int)(x >> 32)));
+#else
+    // gcc: __bsfq(x)
+    return (unsigned int)__builtin_ctzll(x);
+#endif
+}
+
+#if UTF8_HAVE_SSE2
+
+//
+// Widen the pure ASCII run at the beginning of [src, end) to UTF-16. The sign
+// bits of 64 bytes are checked at once, then 16 bytes at the end of the run.
+// The first 16 bytes must be ASCII, returns the bytes (and the code units)
+// done, a multiple of 16.
+//
+static inline
+size_t utf8_decode_sse_ascii(const char * src, const char * end, uint16_t * dest)
+{
+    const char * first = src;
+    __m128i all_zeros = _mm_setzero_si128();
+
+    while ((src + 64) <= end) {
+        __m128i chunk0 = _mm_loadu_si128((const __m128i *)(src + 0));
+        __m128i chunk1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i chunk2 = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i chunk3 = _mm_loadu_si128((const __m128i *)(src + 48));
+        __m128i sign_bits = _mm_or_si128(_mm_or_si128(chunk0, chunk1), _mm_or_si128(chunk2, chunk3));
+        if (_mm_movemask_epi8(sign_bits) != 0)
+            break;
+
+        _mm_storeu_si128((__m128i *)(dest + 0),  _mm_unpacklo_epi8(chunk0, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 8),  _mm_unpackhi_epi8(chunk0, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpacklo_epi8(chunk1, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 24), _mm_unpackhi_epi8(chunk1, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 32), _mm_unpacklo_epi8(chunk2, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 40), _mm_unpackhi_epi8(chunk2, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 48), _mm_unpacklo_epi8(chunk3, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 56), _mm_unpackhi_epi8(chunk3, all_zeros));
+        src  += 64;
+        dest += 64;
+    }
+
+    while ((src + 16) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+        if (_mm_movemask_epi8(chunk) != 0)
+            break;
+
+        _mm_storeu_si128((__m128i *)dest,       _mm_unpacklo_epi8(chunk, all_zeros));
+        _mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi8(chunk, all_zeros));
+        src  += 16;
+        dest += 16;
+    }
+
+    return (size_t)(src - first);
+}
+
+//
+// Load the last len (1 ~ 15) bytes of the input as a block, the bytes after
+// them are zeros, they are decoded to the NUL code units and dropped by the
+// caller. The 16 bytes at src are read at once if they are in the same page,
+// it never faults (but it's beyond the buffer, so it's not sanitized), else
+// the bytes are copied.
+//
+UTF8_NO_SANITIZE_ADDRESS
+static inline
+__m128i utf8_load_tail_sse(const char * src, size_t len)
+{
+    static const size_t kPageSize = 4096;
+
+    assert(len > 0 && len < 16);
+    __m128i chunk;
+    if (((size_t)(uintptr_t)src & (kPageSize - 1)) <= (kPageSize - 16)) {
+        chunk = _mm_loadu_si128((const __m128i *)src);
+    } else {
+        char block[16] = { 0 };
+        memcpy(block, src, len);
+        chunk = _mm_loadu_si128((const __m128i *)block);
+    }
+
+    __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i inside = _mm_cmpgt_epi8(_mm_set1_epi8((char)len), index);
+    return _mm_and_si128(chunk, inside);
+}
+
+//
+// Same as utf16_length_from_utf8_scalar(), 64 bytes per round. The compare masks
+// (0 or -1) of the bytes which are not the continuation bytes and of the 4 bytes
+// lead bytes are subtracted from the byte counters, at most 8 per round, and the
+// counters are summed by psadbw every 31 rounds, before they overflow.
+//
+static inline
+size_t utf16_length_from_utf8_sse(const char * src, size_t len)
+{
+    static const size_t kMaxRounds = 31;
+
+    const char * end = src + len;
+    size_t units = 0;
+
+    // The continuation bytes are [-128, -65] as the signed bytes.
+    __m128i body_max = _mm_set1_epi8(-65);
+    __m128i mb4_min  = _mm_set1_epi8((char)0xF0u);
+    __m128i zeros    = _mm_setzero_si128();
+
+    while ((src + 64) <= end) {
+        size_t rounds = (size_t)(end - src) / 64;
+        if (rounds > kMaxRounds)
+            rounds = kMaxRounds;
+
+        __m128i counts = _mm_setzero_si128();
+        for (size_t i = 0; i < rounds; i++) {
+            __m128i chunk0 = _mm_loadu_si128((const __m128i *)(src + 0));
+            __m128i chunk1 = _mm_loadu_si128((const __m128i *)(src + 16));
+            __m128i chunk2 = _mm_loadu_si128((const __m128i *)(src + 32));
+            __m128i chunk3 = _mm_loadu_si128((const __m128i *)(src + 48));
+
+            counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(chunk0, body_max));
+            counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(chunk1, body_max));
+            counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(chunk2, body_max));
+            counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(chunk3, body_max));
+
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_max_epu8(chunk0, mb4_min), chunk0));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_max_epu8(chunk1, mb4_min), chunk1));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_max_epu8(chunk2, mb4_min), chunk2));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_max_epu8(chunk3, mb4_min), chunk3));
+            src += 64;
+        }
+
+        __m128i sums = _mm_sad_epu8(counts, zeros);
+        units += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+
+    units += utf16_length_from_utf8_scalar(src, (size_t)(end - src));
+    return units;
+}
+
+// The sign bits of the 64 bytes of 4 blocks, bit i is the byte i.
+static inline
+uint64_t utf8_movemask64_sse(__m128i mask0, __m128i mask1, __m128i mask2, __m128i mask3)
+{
+    return  (uint64_t)(uint32_t)_mm_movemask_epi8(mask0)         |
+           ((uint64_t)(uint32_t)_mm_movemask_epi8(mask1) << 16u) |
+           ((uint64_t)(uint32_t)_mm_movemask_epi8(mask2) << 32u) |
+           ((uint64_t)(uint32_t)_mm_movemask_epi8(mask3) << 48u);
+}
+
+//
+// The bytes which are not the continuation bytes (the ASCII and the lead bytes)
+// of the 64 bytes at src, bit i is the byte i.
+//
+static inline
+uint64_t utf8_lead_mask64_sse(const char * src)
+{
+    // The continuation bytes are [-128, -65] as the signed bytes.
+    __m128i body_max = _mm_set1_epi8(-65);
+
+    __m128i chunk0 = _mm_loadu_si128((const __m128i *)(src + 0));
+    __m128i chunk1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i chunk2 = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i chunk3 = _mm_loadu_si128((const __m128i *)(src + 48));
+
+    return utf8_movemask64_sse(_mm_cmpgt_epi8(chunk0, body_max),
+                               _mm_cmpgt_epi8(chunk1, body_max),
+                               _mm_cmpgt_epi8(chunk2, body_max),
+                               _mm_cmpgt_epi8(chunk3, body_max));
+}
+
+//
+// The 4 bytes lead bytes (0xF0 - 0xFF, the surrogate pairs) of the 64 bytes at src.
+//
+static inline
+uint64_t utf8_mb4_mask64_sse(const char * src)
+{
+    __m128i mb4_min = _mm_set1_epi8((char)0xEFu);
+
+    __m128i chunk0 = _mm_loadu_si128((const __m128i *)(src + 0));
+    __m128i chunk1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i chunk2 = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i chunk3 = _mm_loadu_si128((const __m128i *)(src + 48));
+
+    // The ASCII bytes are also greater, as the signed bytes.
+    uint64_t mb4_bits = utf8_movemask64_sse(_mm_cmpgt_epi8(chunk0, mb4_min),
+                                            _mm_cmpgt_epi8(chunk1, mb4_min),
+                                            _mm_cmpgt_epi8(chunk2, mb4_min),
+                                            _mm_cmpgt_epi8(chunk3, mb4_min));
+    return (mb4_bits & utf8_movemask64_sse(chunk0, chunk1, chunk2, chunk3));
+}
+
+//
+// Same as count_code_points_scalar(), the bytes which are not the continuation
+// bytes of a 64 bytes block are gathered to a 64 bits mask, and counted by popcnt.
+//
+static inline
+size_t count_code_points_sse(const char * src, size_t len)
+{
+    const char * end = src + len;
+    size_t count = 0;
+
+    while ((src + 64) <= end) {
+        count += bit_popcnt64(utf8_lead_mask64_sse(src));
+        src += 64;
+    }
+
+    count += count_code_points_scalar(src, (size_t)(end - src));
+    return count;
+}
+
+//
+// Same as utf8_seq_histogram_scalar(), 64 bytes per round. The lead bytes of
+// 2, 3 and 4 bytes and above are the non-ASCII bytes greater than 0xBF, 0xDF
+// and 0xEF, the masks of them are counted by popcnt, and the histogram is the
+// differences of the counts. The ASCII only blocks are counted at once.
+//
+static inline
+void utf8_seq_histogram_sse(const char * src, size_t len, size_t counts[4])
+{
+    const char * end = src + len;
+    size_t ascii = 0, mb2_above = 0, mb3_above = 0, mb4_above = 0;
+
+    __m128i mb2_min = _mm_set1_epi8((char)0xBFu);
+    __m128i mb3_min = _mm_set1_epi8((char)0xDFu);
+    __m128i mb4_min = _mm_set1_epi8((char)0xEFu);
+
+    while ((src + 64) <= end) {
+        __m128i chunk0 = _mm_loadu_si128((const __m128i *)(src + 0));
+        __m128i chunk1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i chunk2 = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i chunk3 = _mm_loadu_si128((const __m128i *)(src + 48));
+        src += 64;
+
+        uint64_t non_ascii = utf8_movemask64_sse(chunk0, chunk1, chunk2, chunk3);
+        if (non_ascii == 0) {
+            ascii += 64;
+            continue;
+        }
+
+        // The ASCII bytes are also greater, as the signed bytes.
+        uint64_t mb2_bits = utf8_movemask64_sse(_mm_cmpgt_epi8(chunk0, mb2_min),
+                                                _mm_cmpgt_epi8(chunk1, mb2_min),
+                                                _mm_cmpgt_epi8(chunk2, mb2_min),
+                                                _mm_cmpgt_epi8(chunk3, mb2_min));
+        uint64_t mb3_bits = utf8_movemask64_sse(_mm_cmpgt_epi8(chunk0, mb3_min),
+                                                _mm_cmpgt_epi8(chunk1, mb3_min),
+                                                _mm_cmpgt_epi8(chunk2, mb3_min),
+                                                _mm_cmpgt_epi8(chunk3, mb3_min));
+        uint64_t mb4_bits = utf8_movemask64_sse(_mm_cmpgt_epi8(chunk0, mb4_min),
+                                                _mm_cmpgt_epi8(chunk1, mb4_min),
+                                                _mm_cmpgt_epi8(chunk2, mb4_min),
+                                                _mm_cmpgt_epi8(chunk3, mb4_min));
+
+        ascii     += 64 - bit_popcnt64(non_ascii);
+        mb2_above += bit_popcnt64(mb2_bits & non_ascii);
+        mb3_above += bit_popcnt64(mb3_bits & non_ascii);
+        mb4_above += bit_popcnt64(mb4_bits & non_ascii);
+    }
+
+    counts[0] += ascii;
+    counts[1] += mb2_above - mb3_above;
+    counts[2] += mb3_above - mb4_above;
+    counts[3] += mb4_above;
+
+    utf8_seq_histogram_scalar(src, (size_t)(end - src), counts);
+}
+
+#endif // UTF8_HAVE_SSE2
+
+#if defined(__SSE4_1__)
+
 /*******************************************************************************
 
     UTF-8 encoding
@@ -95,200 +440,649 @@ unsigned int bit_bsr32(unsigned int x) {
 *******************************************************************************/
 
 //
-// "x\e2\89\a4(\ce\b1+\ce\b2)\c2\b2\ce\b3\c2\b2"
+// Decode a 16 bytes chunk which contains some 4 bytes sequences, the chunk must
+// begin at a character boundary. Return the source advance (12 ~ 15 bytes).
+//
+// Each byte is decoded as if it were the end of a UTF-16 code unit, using the
+// byte itself and the bytes before it. A 4 bytes sequence ends two code units:
+//
+//   11110uuu 10uuzzzz 10yyyyyy 10xxxxxx  (wwww = uuuuu - 1)
+//
+//   high surrogate (at the 3rd byte): 110110ww wwzzzzyy
+//   low surrogate  (at the 4th byte): 110111yy yyxxxxxx
+//
+// The byte 15 is never an end, because we don't know the next byte.
 //
 static inline
-size_t utf8_decode_sse(const char * src, size_t len, uint16_t * dest)
+uint32_t utf8_decode_sse_mb4_block(__m128i chunk, uint16_t * dest, uint32_t * dest_advance)
 {
-    static const size_t kPerLoopBytes = 16;
+    const __m128i shuffle_base  = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i all_zeros     = _mm_setzero_si128();
+    const __m128i ones_mask     = _mm_set1_epi8(0x01);
+
+    __m128i prev1 = _mm_slli_si128(chunk, 1);
+    __m128i prev2 = _mm_slli_si128(chunk, 2);
+
+    __m128i ascii_mask = _mm_cmpgt_epi8(chunk, _mm_set1_epi8(-1));
+    __m128i body_mask  = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0x80u));
+    __m128i mb3_mask   = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF0u)), _mm_set1_epi8(0xE0u));
+    __m128i mb4_mask   = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF8u)), _mm_set1_epi8(0xF0u));
+
+    // The prev2 is a 3 bytes lead, prev2 or prev3 is a 4 bytes lead
+    __m128i tail_mb3_mask  = _mm_slli_si128(mb3_mask, 2);
+    __m128i high_surr_mask = _mm_slli_si128(mb4_mask, 2);
+    __m128i low_surr_mask  = _mm_slli_si128(mb4_mask, 3);
+
+    // A byte is the end of a character if the next byte is not a continuation byte.
+    __m128i tail_chars_mask = _mm_srli_si128(_mm_cmpeq_epi8(body_mask, all_zeros), 1);
+    __m128i tail_units_mask = _mm_or_si128(tail_chars_mask, high_surr_mask);
+
+    uint32_t tail_chars = (uint32_t)_mm_movemask_epi8(tail_chars_mask);
+    assert(tail_chars != 0);
+    uint32_t source_advance = (uint32_t)bit_bsr32(tail_chars) + 1;
+    uint32_t tail_units = (uint32_t)_mm_movemask_epi8(tail_units_mask) & ((1u << source_advance) - 1);
+    *dest_advance = bit_popcnt32(tail_units);
+
+    // The low byte: 0xxxxxxx or yyxxxxxx
+    __m128i chunk_low = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev1, 6), _mm_set1_epi8(0xC0u)),
+                                     _mm_and_si128(chunk, _mm_set1_epi8(0x3Fu)));
+    chunk_low = _mm_blendv_epi8(chunk_low, chunk, ascii_mask);
+
+    // The high byte: 00000yyy (2 bytes), zzzzyyyy (3 bytes) or 110111yy (low surrogate)
+    __m128i chunk_high = _mm_and_si128(_mm_srli_epi16(prev1, 2), _mm_set1_epi8(0x0Fu));
+    chunk_high = _mm_or_si128(chunk_high, _mm_and_si128(_mm_and_si128(_mm_slli_epi16(prev2, 4),
+                                                                      _mm_set1_epi8(0xF0u)), tail_mb3_mask));
+    chunk_high = _mm_blendv_epi8(chunk_high, _mm_or_si128(_mm_and_si128(chunk_high, _mm_set1_epi8(0x03)),
+                                                          _mm_set1_epi8(0xDCu)), low_surr_mask);
+    chunk_high = _mm_andnot_si128(ascii_mask, chunk_high);
+
+    // The high surrogate: wwww = uuuuu - 1
+    __m128i plane = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev2, 2), _mm_set1_epi8(0x1C)),
+                                 _mm_and_si128(_mm_srli_epi16(prev1, 4), _mm_set1_epi8(0x03)));
+    plane = _mm_sub_epi8(plane, ones_mask);
+
+    __m128i high_surr_low  = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(plane, 6), _mm_set1_epi8(0xC0u)),
+                             _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev1, 2), _mm_set1_epi8(0x3C)),
+                                          _mm_and_si128(_mm_srli_epi16(chunk, 4), _mm_set1_epi8(0x03))));
+    __m128i high_surr_high = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(plane, 2), _mm_set1_epi8(0x03)),
+                                          _mm_set1_epi8(0xD8u));
+
+    chunk_low  = _mm_blendv_epi8(chunk_low,  high_surr_low,  high_surr_mask);
+    chunk_high = _mm_blendv_epi8(chunk_high, high_surr_high, high_surr_mask);
+
+    // The shifts are the prefix-sum of the bytes which are not the end of a code unit.
+    __m128i shifts = _mm_andnot_si128(tail_units_mask, ones_mask);
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 1));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 2));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 4));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 8));
+
+    shifts = _mm_and_si128(shifts, tail_units_mask);
+
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 1),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 7), 1));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 2),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 6), 2));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 4),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 5), 4));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 8),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 4), 8));
+
+    __m128i shift_and_shuffle = _mm_add_epi8(shifts, shuffle_base);
+
+    // Remove the gaps by shuffling
+    chunk_low  = _mm_shuffle_epi8(chunk_low,  shift_and_shuffle);
+    chunk_high = _mm_shuffle_epi8(chunk_high, shift_and_shuffle);
+
+    // Now we can unpack and store
+    __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
+    __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),     utf16_low);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), utf16_high);
+
+    return source_advance;
+}
+
+//
+// The shuffle masks to pack the selected UTF-16 code units of 8 to the front,
+// indexed by the 8 bits mask of the code units to keep, and the count of them.
+//
+struct utf8_pack_u16_table_t {
+    uint8_t shuffle[256][16];
+    uint8_t length[256];
+};
+
+static inline
+utf8_pack_u16_table_t utf8_make_pack_u16_table()
+{
+    utf8_pack_u16_table_t table;
+    for (uint32_t keep = 0; keep < 256; keep++) {
+        uint32_t length = 0;
+        for (uint32_t i = 0; i < 8; i++) {
+            if ((keep & (1u << i)) != 0) {
+                table.shuffle[keep][length * 2 + 0] = (uint8_t)(i * 2 + 0);
+                table.shuffle[keep][length * 2 + 1] = (uint8_t)(i * 2 + 1);
+                length++;
+            }
+        }
+        table.length[keep] = (uint8_t)length;
+        for (uint32_t i = length; i < 8; i++) {
+            table.shuffle[keep][i * 2 + 0] = 0x80u;
+            table.shuffle[keep][i * 2 + 1] = 0x80u;
+        }
+    }
+    return table;
+}
+
+static inline
+const utf8_pack_u16_table_t & utf8_pack_u16_table()
+{
+    static const utf8_pack_u16_table_t table = utf8_make_pack_u16_table();
+    return table;
+}
 
-    const __m128i popcnt_lookup_4
-                                = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+//
+// Decode a 16 bytes chunk which only contains ASCII and 2 bytes sequences (no
+// byte >= 0xE0), the chunk must begin at a character boundary. Return the
+// source advance (15 or 16 bytes).
+//
+// Each byte is decoded as if it were the end of a character, the lead bytes
+// are the only ones to drop. So the two halves of the chunk can be packed by
+// the 8 bits masks independently, no prefix-sum of the shifts is required.
+//
+// The packed code units are returned in *utf16_low and *utf16_high, the counts
+// of them in *low_len and *high_len, utf8_decode_sse_mb2_block() stores them.
+//
+static inline
+uint32_t utf8_decode_sse_mb2_units(__m128i chunk, __m128i * utf16_low, __m128i * utf16_high,
+                                   uint32_t * low_len, uint32_t * high_len,
+                                   const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i prev1 = _mm_slli_si128(chunk, 1);
+
+    __m128i ascii_mask = _mm_cmpgt_epi8(chunk, _mm_set1_epi8(-1));
+    __m128i first_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0xC0u));
+
+    // The low byte: 0xxxxxxx or yyxxxxxx, the high byte: 00000yyy
+    __m128i chunk_low = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev1, 6), _mm_set1_epi8(0xC0u)),
+                                     _mm_and_si128(chunk, _mm_set1_epi8(0x3Fu)));
+    chunk_low = _mm_blendv_epi8(chunk_low, chunk, ascii_mask);
+
+    __m128i chunk_high = _mm_and_si128(_mm_srli_epi16(prev1, 2), _mm_set1_epi8(0x07u));
+    chunk_high = _mm_andnot_si128(ascii_mask, chunk_high);
+
+    // The lead byte at the byte 15 is left to the next chunk.
+    uint32_t keep_units = (~(uint32_t)_mm_movemask_epi8(first_mask)) & 0xFFFFu;
+    uint32_t source_advance = 15 + (keep_units >> 15);
+    uint32_t keep_low  = keep_units & 0xFFu;
+    uint32_t keep_high = keep_units >> 8;
+
+    *utf16_low  = _mm_shuffle_epi8(_mm_unpacklo_epi8(chunk_low, chunk_high),
+                                   _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep_low]));
+    *utf16_high = _mm_shuffle_epi8(_mm_unpackhi_epi8(chunk_low, chunk_high),
+                                   _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep_high]));
+
+    *low_len  = pack_table.length[keep_low];
+    *high_len = pack_table.length[keep_high];
+    return source_advance;
+}
+
+static inline
+uint32_t utf8_decode_sse_mb2_block(__m128i chunk, uint16_t * dest, uint32_t * dest_advance,
+                                   const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i utf16_low, utf16_high;
+    uint32_t low_len, high_len;
+    uint32_t source_advance = utf8_decode_sse_mb2_units(chunk, &utf16_low, &utf16_high,
+                                                        &low_len, &high_len, pack_table);
+
+    _mm_storeu_si128((__m128i *)dest,             utf16_low);
+    _mm_storeu_si128((__m128i *)(dest + low_len), utf16_high);
+
+    *dest_advance = low_len + high_len;
+    return source_advance;
+}
+
+//
+// Decode a 16 bytes chunk which begins with five 3 bytes sequences (CJK), the
+// lead bytes are at the bytes 0, 3, 6, 9 and 12. Return the source advance (15 bytes).
+//
+// The positions are fixed, so the 3 bytes of every character are gathered into
+// a 32 bits lane by a constant shuffle: 00000000 1110zzzz 10yyyyyy 10xxxxxx,
+// no shifts prefix-sum and no gap removing are required.
+//
+static inline
+uint32_t utf8_decode_sse_mb3_only_block(__m128i chunk, uint16_t * dest, uint32_t * dest_advance)
+{
+    const __m128i gather_0_3 = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i gather_4   = _mm_setr_epi8(14, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i mask_x     = _mm_set1_epi32(0x0000003F);
+    const __m128i mask_y     = _mm_set1_epi32(0x00000FC0);
+    const __m128i mask_z     = _mm_set1_epi32(0x0000F000);
+
+    __m128i chars_0_3 = _mm_shuffle_epi8(chunk, gather_0_3);
+    __m128i chars_4   = _mm_shuffle_epi8(chunk, gather_4);
+
+    __m128i units_0_3 = _mm_or_si128(_mm_and_si128(chars_0_3, mask_x),
+                        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(chars_0_3, 2), mask_y),
+                                     _mm_and_si128(_mm_srli_epi32(chars_0_3, 4), mask_z)));
+    __m128i units_4   = _mm_or_si128(_mm_and_si128(chars_4, mask_x),
+                        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(chars_4, 2), mask_y),
+                                     _mm_and_si128(_mm_srli_epi32(chars_4, 4), mask_z)));
+
+    _mm_storeu_si128((__m128i *)dest, _mm_packus_epi32(units_0_3, units_4));
+
+    *dest_advance = 5;
+    return 15;
+}
+
+//
+// Decode a 16 bytes chunk which only contains ASCII and 3 bytes sequences, the
+// chunk must begin at a character boundary. Return the source advance (14 ~ 16 bytes).
+//
+// Each byte is decoded as if it were the end of a character, the ends are the
+// ASCII bytes and the bytes 2 after the lead bytes. Same as the 2 bytes chunk,
+// the two halves are packed by the 8 bits masks of the ends.
+//
+// The packed code units are returned the same as utf8_decode_sse_mb2_units(),
+// utf8_decode_sse_ascii_mb3_block() stores them.
+//
+static inline
+uint32_t utf8_decode_sse_ascii_mb3_units(__m128i chunk, __m128i * utf16_low, __m128i * utf16_high,
+                                         uint32_t * low_len, uint32_t * high_len,
+                                         uint32_t ascii_bits, uint32_t mb3_bits,
+                                         const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i prev1 = _mm_slli_si128(chunk, 1);
+    __m128i prev2 = _mm_slli_si128(chunk, 2);
+
+    __m128i ascii_mask = _mm_cmpgt_epi8(chunk, _mm_set1_epi8(-1));
+
+    // The low byte: 0xxxxxxx or yyxxxxxx, the high byte: zzzzyyyy
+    __m128i chunk_low = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev1, 6), _mm_set1_epi8(0xC0u)),
+                                     _mm_and_si128(chunk, _mm_set1_epi8(0x3Fu)));
+    chunk_low = _mm_blendv_epi8(chunk_low, chunk, ascii_mask);
+
+    __m128i chunk_high = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev2, 4), _mm_set1_epi8(0xF0u)),
+                                      _mm_and_si128(_mm_srli_epi16(prev1, 2), _mm_set1_epi8(0x0Fu)));
+    chunk_high = _mm_andnot_si128(ascii_mask, chunk_high);
+
+    // The characters cut by the end of the chunk are left to the next chunk.
+    uint32_t keep_units = (ascii_bits | (mb3_bits << 2)) & 0xFFFFu;
+    assert(keep_units != 0);
+    uint32_t source_advance = (uint32_t)bit_bsr32(keep_units) + 1;
+    uint32_t keep_low  = keep_units & 0xFFu;
+    uint32_t keep_high = keep_units >> 8;
+
+    *utf16_low  = _mm_shuffle_epi8(_mm_unpacklo_epi8(chunk_low, chunk_high),
+                                   _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep_low]));
+    *utf16_high = _mm_shuffle_epi8(_mm_unpackhi_epi8(chunk_low, chunk_high),
+                                   _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep_high]));
+
+    *low_len  = pack_table.length[keep_low];
+    *high_len = pack_table.length[keep_high];
+    return source_advance;
+}
+
+static inline
+uint32_t utf8_decode_sse_ascii_mb3_block(__m128i chunk, uint16_t * dest, uint32_t * dest_advance,
+                                         uint32_t ascii_bits, uint32_t mb3_bits,
+                                         const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i utf16_low, utf16_high;
+    uint32_t low_len, high_len;
+    uint32_t source_advance = utf8_decode_sse_ascii_mb3_units(chunk, &utf16_low, &utf16_high,
+                                                              &low_len, &high_len,
+                                                              ascii_bits, mb3_bits, pack_table);
+
+    _mm_storeu_si128((__m128i *)dest,             utf16_low);
+    _mm_storeu_si128((__m128i *)(dest + low_len), utf16_high);
+
+    *dest_advance = low_len + high_len;
+    return source_advance;
+}
+
+//
+// The number of the 16 bytes blocks decoded by each kernel of utf8_decode_sse().
+//
+struct utf8_block_stats_t {
+    size_t ascii_blocks;
+    size_t mb2_blocks;
+    size_t mb3_only_blocks;
+    size_t ascii_mb3_blocks;
+    size_t mb4_blocks;
+    size_t generic_blocks;
+};
+
+//
+// Decode a block of mixed 1, 2 and 3 bytes sequences, the gaps are removed by
+// the shifts prefix-sum. mb_mask_4 is the high 4 bits of the lead bytes.
+//
+static inline
+uint32_t utf8_decode_sse_generic_block(__m128i chunk, __m128i mb_mask_4,
+                                       uint16_t * dest, uint32_t * dest_advance)
+{
     const __m128i reverse_contiguous_1_lookup
                                 = _mm_setr_epi8(0, 1, 1, 2, 1, 1, 2, 3, 1, 1, 1, 1, 2, 2, 3, 4);
     const __m128i shuffle_base  = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
-    const __m128i head_mask     = _mm_set1_epi8(0xC0u);
-    const __m128i body_mask     = _mm_set1_epi8(0x80u);
-    const __m128i sign_mask     = _mm_set1_epi8(0x80u);
-    const __m128i mask4         = _mm_set1_epi8(0x0F);
     const __m128i ones_mask     = _mm_set1_epi8(0x01);
     const __m128i twos_mask     = _mm_set1_epi8(0x02);
     const __m128i threes_mask   = _mm_set1_epi8(0x03);
 
-    const char * end = src + len;
-    const uint16_t * dest_first = dest;
-
     __m128i all_zeros = _mm_setzero_si128();
-    __m128i all_ones  = _mm_cmpeq_epi8(all_zeros, all_zeros);
-
-    while ((src + kPerLoopBytes) <= end) {
-        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
-
-        __m128i chunk_is_first  = _mm_and_si128(chunk, head_mask);
-//      __m128i chunk_is_signed = _mm_and_si128(chunk, sign_mask);
 
-//      __m128i ascii_mask     = _mm_cmpeq_epi8(chunk_is_signed, all_zeros);
-//      __m128i non_ascii_mask = _mm_cmplt_epi8(chunk_is_signed, all_zeros);
-        __m128i is_first_mask  = _mm_cmpeq_epi8(chunk_is_first,  head_mask);
-//      __m128i is_body_mask   = _mm_cmpeq_epi8(chunk_is_first,  body_mask);
+    __m128i count = _mm_shuffle_epi8(reverse_contiguous_1_lookup, mb_mask_4);
 
-//      __m128i non_ascii_chunk = _mm_and_si128(chunk, non_ascii_mask);
-        __m128i is_first_chunk  = _mm_and_si128(chunk, is_first_mask);
-//      __m128i is_body_chunk   = _mm_and_si128(chunk, is_body_mask);
-//      __m128i body_counts = _mm_and_si128(ones_mask, is_body_mask);
+    __m128i count_sub1 = _mm_subs_epu8(count, ones_mask);
+    __m128i counts = _mm_or_si128(count, _mm_slli_si128(count_sub1, 1));
+    __m128i count_sub2_shift2 = _mm_slli_si128(_mm_subs_epu8(count, twos_mask), 2);
+    counts = _mm_or_si128(counts, count_sub2_shift2);
 
-        __m128i mb_mask_high4 = _mm_srli_epi16(is_first_chunk, 4);
-        __m128i mb_mask_4 = _mm_and_si128(mb_mask_high4, mask4);
-        __m128i count = _mm_shuffle_epi8(reverse_contiguous_1_lookup, mb_mask_4);
+    __m128i shifts = count_sub1;
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 1));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 2));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 4));
+    shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 8));
 
-        __m128i count_sub1 = _mm_subs_epu8(count, ones_mask);
-        __m128i counts = _mm_or_si128(count, _mm_slli_si128(count_sub1, 1));
-        __m128i count_sub2_shift2 = _mm_slli_si128(_mm_subs_epu8(count, twos_mask), 2);
-        counts = _mm_or_si128(counts, count_sub2_shift2);
+    __m128i tail_chars_mask = _mm_cmplt_epi8(counts, _mm_set1_epi8(0x02));
 
-        __m128i shifts = count_sub1;
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 1));
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 2));
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 4));
-        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 8));
-
-        __m128i tail_chars_mask = _mm_cmplt_epi8(counts, _mm_set1_epi8(0x02));
-
-        shifts = _mm_and_si128(shifts, tail_chars_mask);
+    shifts = _mm_and_si128(shifts, tail_chars_mask);
 
 #if USE_NEW_SOURCE_ADVANCE
-        uint32_t tail_chars = (uint32_t)_mm_movemask_epi8(tail_chars_mask);
-        assert(tail_chars != 0);
-        //uint32_t source_advance = jstd::BitUtils::bsr32(tail_chars) + 1;
-        uint32_t source_advance = (uint32_t)bit_bsr32(tail_chars) + 1;
-        assert(source_advance >= 14 && source_advance <= 16);
+    uint32_t tail_chars = (uint32_t)_mm_movemask_epi8(tail_chars_mask);
+    assert(tail_chars != 0);
+    //uint32_t source_advance = jstd::BitUtils::bsr32(tail_chars) + 1;
+    uint32_t source_advance = (uint32_t)bit_bsr32(tail_chars) + 1;
+    assert(source_advance >= 14 && source_advance <= 16);
 #else
-        uint32_t c = (uint32_t)_mm_extract_epi16(counts, 7);
+    uint32_t c = (uint32_t)_mm_extract_epi16(counts, 7);
 #endif
 
 #if defined(__SSE4_1__)
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 1),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 7), 1));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 1),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 7), 1));
 #else
-        __m128i shifts_1          = _mm_srli_si128(shifts, 1);
-        __m128i shifts_1_bytes    = _mm_and_si128(shifts_1, _mm_set1_epi8(0x01));
-        __m128i shifts_1_mask     = _mm_cmpgt_epi8(shifts_1_bytes, all_zeros);
-        __m128i shifts_1_mask_rev = _mm_cmpeq_epi8(shifts_1_bytes, all_zeros);
+    __m128i shifts_1          = _mm_srli_si128(shifts, 1);
+    __m128i shifts_1_bytes    = _mm_and_si128(shifts_1, _mm_set1_epi8(0x01));
+    __m128i shifts_1_mask     = _mm_cmpgt_epi8(shifts_1_bytes, all_zeros);
+    __m128i shifts_1_mask_rev = _mm_cmpeq_epi8(shifts_1_bytes, all_zeros);
 
-        shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_1_mask_rev), _mm_and_si128(shifts_1, shifts_1_mask));
+    shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_1_mask_rev), _mm_and_si128(shifts_1, shifts_1_mask));
 #endif
 
 #if USE_NEW_SOURCE_ADVANCE
-        // Do nothing !!
+    // Do nothing !!
 #else
-        uint32_t source_advance = ((c & 0x0200u) == 0) ? 16 : (((c & 0x02u) == 0) ? 15 : 14);
+    uint32_t source_advance = ((c & 0x0200u) == 0) ? 16 : (((c & 0x02u) == 0) ? 15 : 14);
 #endif
 
 #if USE_NEW_DEST_ADVANCE
-        uint32_t tail_chars_shifts = (source_advance - 16 + 3) * 8;
-        __m128i tail_chars_shift = _mm_cvtsi32_si128(tail_chars_shifts);
+    uint32_t tail_chars_shifts = (source_advance - 16 + 3) * 8;
+    __m128i tail_chars_shift = _mm_cvtsi32_si128(tail_chars_shifts);
 #endif
 
 #if defined(__SSE4_1__)
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 2),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 6), 2));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 2),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 6), 2));
 #else
-        __m128i shifts_2          = _mm_srli_si128(shifts, 2);
-        __m128i shifts_2_bytes    = _mm_and_si128(shifts_2, _mm_set1_epi8(0x02));
-        __m128i shifts_2_mask     = _mm_cmpgt_epi8(shifts_2_bytes, all_zeros);
-        __m128i shifts_2_mask_rev = _mm_cmpeq_epi8(shifts_2_bytes, all_zeros);
+    __m128i shifts_2          = _mm_srli_si128(shifts, 2);
+    __m128i shifts_2_bytes    = _mm_and_si128(shifts_2, _mm_set1_epi8(0x02));
+    __m128i shifts_2_mask     = _mm_cmpgt_epi8(shifts_2_bytes, all_zeros);
+    __m128i shifts_2_mask_rev = _mm_cmpeq_epi8(shifts_2_bytes, all_zeros);
 
-        shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_2_mask_rev), _mm_and_si128(shifts_2, shifts_2_mask));
+    shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_2_mask_rev), _mm_and_si128(shifts_2, shifts_2_mask));
 #endif
 
-        __m128i ascii_mask  = _mm_cmpeq_epi8(counts, all_zeros);
-        __m128i chunk_ascii = _mm_and_si128(chunk, ascii_mask);
+    __m128i ascii_mask  = _mm_cmpeq_epi8(counts, all_zeros);
+    __m128i chunk_ascii = _mm_and_si128(chunk, ascii_mask);
 
-        __m128i mb_1_mask  = _mm_cmpeq_epi8(counts, ones_mask);
-        __m128i chunk_mb_1 = _mm_and_si128(chunk, mb_1_mask);
-        __m128i chunk_low_05 = _mm_and_si128(chunk_mb_1, _mm_set1_epi8(0x3Fu));
+    __m128i mb_1_mask  = _mm_cmpeq_epi8(counts, ones_mask);
+    __m128i chunk_mb_1 = _mm_and_si128(chunk, mb_1_mask);
+    __m128i chunk_low_05 = _mm_and_si128(chunk_mb_1, _mm_set1_epi8(0x3Fu));
 
 #if defined(__SSE4_1__)
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 4),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 5), 4));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 4),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 5), 4));
 #else
-        __m128i shifts_4          = _mm_srli_si128(shifts, 4);
-        __m128i shifts_4_bytes    = _mm_and_si128(shifts_4, _mm_set1_epi8(0x04));
-        __m128i shifts_4_mask     = _mm_cmpgt_epi8(shifts_4_bytes, all_zeros);
-        __m128i shifts_4_mask_rev = _mm_cmpeq_epi8(shifts_4_bytes, all_zeros);
+    __m128i shifts_4          = _mm_srli_si128(shifts, 4);
+    __m128i shifts_4_bytes    = _mm_and_si128(shifts_4, _mm_set1_epi8(0x04));
+    __m128i shifts_4_mask     = _mm_cmpgt_epi8(shifts_4_bytes, all_zeros);
+    __m128i shifts_4_mask_rev = _mm_cmpeq_epi8(shifts_4_bytes, all_zeros);
 
-        shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_4_mask_rev), _mm_and_si128(shifts_4, shifts_4_mask));
+    shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_4_mask_rev), _mm_and_si128(shifts_4, shifts_4_mask));
 #endif
 
-        __m128i mb_2_mask  = _mm_cmpeq_epi8(counts, twos_mask);
-        __m128i chunk_mb_2 = _mm_slli_si128(_mm_and_si128(chunk, mb_2_mask), 1);
-        __m128i chunk_low_67 = _mm_and_si128(_mm_slli_epi16(chunk_mb_2, 6), _mm_set1_epi8(0xC0u));
+    __m128i mb_2_mask  = _mm_cmpeq_epi8(counts, twos_mask);
+    __m128i chunk_mb_2 = _mm_slli_si128(_mm_and_si128(chunk, mb_2_mask), 1);
+    __m128i chunk_low_67 = _mm_and_si128(_mm_slli_epi16(chunk_mb_2, 6), _mm_set1_epi8(0xC0u));
 
-        __m128i chunk_low = _mm_or_si128(_mm_or_si128(chunk_low_05, chunk_low_67), chunk_ascii);
+    __m128i chunk_low = _mm_or_si128(_mm_or_si128(chunk_low_05, chunk_low_67), chunk_ascii);
 
 #if defined(__SSE4_1__)
-        shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 8),
-                                 _mm_srli_si128(_mm_slli_epi16(shifts, 4), 8));
+    shifts = _mm_blendv_epi8(shifts, _mm_srli_si128(shifts, 8),
+                             _mm_srli_si128(_mm_slli_epi16(shifts, 4), 8));
 #else
-        __m128i shifts_8          = _mm_srli_si128(shifts, 8);
-        __m128i shifts_8_bytes    = _mm_and_si128(shifts_8, _mm_set1_epi8(0x08));
-        __m128i shifts_8_mask     = _mm_cmpgt_epi8(shifts_8_bytes, all_zeros);
-        __m128i shifts_8_mask_rev = _mm_cmpeq_epi8(shifts_8_bytes, all_zeros);
+    __m128i shifts_8          = _mm_srli_si128(shifts, 8);
+    __m128i shifts_8_bytes    = _mm_and_si128(shifts_8, _mm_set1_epi8(0x08));
+    __m128i shifts_8_mask     = _mm_cmpgt_epi8(shifts_8_bytes, all_zeros);
+    __m128i shifts_8_mask_rev = _mm_cmpeq_epi8(shifts_8_bytes, all_zeros);
 
-        shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_8_mask_rev), _mm_and_si128(shifts_8, shifts_8_mask));
+    shifts = _mm_or_si128(_mm_and_si128(shifts, shifts_8_mask_rev), _mm_and_si128(shifts_8, shifts_8_mask));
 #endif
 
-        __m128i mb_3_mask  = _mm_cmpeq_epi8(counts, threes_mask);
-        __m128i chunk_mb_3 = _mm_slli_si128(_mm_and_si128(chunk, mb_3_mask), 2);
+    __m128i mb_3_mask  = _mm_cmpeq_epi8(counts, threes_mask);
+    __m128i chunk_mb_3 = _mm_slli_si128(_mm_and_si128(chunk, mb_3_mask), 2);
 
-        __m128i chunk_high_03 = _mm_and_si128(_mm_srli_epi16(chunk_mb_2, 2), _mm_set1_epi8(0x0Fu));
-        __m128i chunk_high_47 = _mm_and_si128(_mm_slli_epi16(chunk_mb_3, 4), _mm_set1_epi8(0xF0u));
+    __m128i chunk_high_03 = _mm_and_si128(_mm_srli_epi16(chunk_mb_2, 2), _mm_set1_epi8(0x0Fu));
+    __m128i chunk_high_47 = _mm_and_si128(_mm_slli_epi16(chunk_mb_3, 4), _mm_set1_epi8(0xF0u));
 
-        __m128i chunk_high = _mm_or_si128(chunk_high_03, chunk_high_47);
+    __m128i chunk_high = _mm_or_si128(chunk_high_03, chunk_high_47);
 
 #if USE_NEW_DEST_ADVANCE
-        __m128i dest_advance_16 = _mm_srl_epi64(shifts, tail_chars_shift);
+    __m128i dest_advance_16 = _mm_srl_epi64(shifts, tail_chars_shift);
 #if defined(__SSE4_1__)
-        uint32_t dest_advance_offset = (uint32_t)_mm_extract_epi8(dest_advance_16, 12);
+    uint32_t dest_advance_offset = (uint32_t)_mm_extract_epi8(dest_advance_16, 12);
 #else
-        uint32_t dest_advance_offset = ((uint32_t)_mm_extract_epi16(dest_advance_16, 6) & 0xFFu);
+    uint32_t dest_advance_offset = ((uint32_t)_mm_extract_epi16(dest_advance_16, 6) & 0xFFu);
 #endif
 #else
 #if defined(__SSE4_1__)
-        uint32_t s = _mm_extract_epi32(shifts, 3);
+    uint32_t s = _mm_extract_epi32(shifts, 3);
 #else
-        uint32_t s0 = _mm_extract_epi16(shifts, 6);
-        uint32_t s1 = _mm_extract_epi16(shifts, 7);
-        uint32_t s  = ((uint32_t)s1 << 16u) | (uint32_t)s0;
+    uint32_t s0 = _mm_extract_epi16(shifts, 6);
+    uint32_t s1 = _mm_extract_epi16(shifts, 7);
+    uint32_t s  = ((uint32_t)s1 << 16u) | (uint32_t)s0;
 #endif
 #endif // USE_NEW_DEST_ADVANCE
-        __m128i shift_and_shuffle = _mm_add_epi8(shifts, shuffle_base);
+    __m128i shift_and_shuffle = _mm_add_epi8(shifts, shuffle_base);
 
-        // Remove the gaps by shuffling
-        chunk_low  = _mm_shuffle_epi8(chunk_low,  shift_and_shuffle);
-        chunk_high = _mm_shuffle_epi8(chunk_high, shift_and_shuffle);
+    // Remove the gaps by shuffling
+    chunk_low  = _mm_shuffle_epi8(chunk_low,  shift_and_shuffle);
+    chunk_high = _mm_shuffle_epi8(chunk_high, shift_and_shuffle);
 
 #if USE_NEW_DEST_ADVANCE
-        uint32_t dest_advance = source_advance - dest_advance_offset;
+    *dest_advance = source_advance - dest_advance_offset;
 #else
-        uint32_t dest_advance = (uint32_t)(source_advance - (0xFFu & (s >> 8 * (3 - 16 + source_advance))));
+    *dest_advance = (uint32_t)(source_advance - (0xFFu & (s >> 8 * (3 - 16 + source_advance))));
 #endif
 
-        // Now we can unpack and store
-        __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
-        __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
+    // Now we can unpack and store
+    __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
+    __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
 
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),     utf16_low);
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), utf16_high);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),     utf16_low);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), utf16_high);
+
+
+    return source_advance;
+}
+
+//
+// Decode a 16 bytes block which is not pure ASCII (sign_bits != 0) by the kernel
+// picked from the lead bytes. Returns the source advance, the count of the code
+// units written is stored to *dest_advance.
+//
+template <bool kStats>
+static inline
+uint32_t utf8_decode_sse_block(__m128i chunk, uint32_t sign_bits, uint16_t * dest, uint32_t * dest_advance,
+                               const utf8_pack_u16_table_t & pack_table, utf8_block_stats_t * stats)
+{
+    const __m128i head_mask     = _mm_set1_epi8(0xC0u);
+//  const __m128i body_mask     = _mm_set1_epi8(0x80u);
+//  const __m128i sign_mask     = _mm_set1_epi8(0x80u);
+    const __m128i mask4         = _mm_set1_epi8(0x0F);
+
+    // Only ASCII and 2 bytes sequences (Latin, Greek, Cyrillic, ...)
+    __m128i mb34_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xE0u)), _mm_set1_epi8(0xE0u));
+    if (_mm_movemask_epi8(mb34_mask) == 0) {
+        if (kStats) stats->mb2_blocks++;
+        return utf8_decode_sse_mb2_block(chunk, dest, dest_advance, pack_table);
+    }
+
+    // Only ASCII and 3 bytes sequences (CJK), all the lead bytes are 1110xxxx.
+    __m128i first_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0xC0u));
+    __m128i mb3_mask   = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF0u)), _mm_set1_epi8(0xE0u));
+    uint32_t mb3_bits = (uint32_t)_mm_movemask_epi8(mb3_mask);
+    if ((uint32_t)_mm_movemask_epi8(first_mask) == mb3_bits) {
+        if ((mb3_bits & 0x7FFFu) == 0x1249u && (sign_bits & 0x7FFFu) == 0x7FFFu) {
+            if (kStats) stats->mb3_only_blocks++;
+            return utf8_decode_sse_mb3_only_block(chunk, dest, dest_advance);
+        } else {
+            if (kStats) stats->ascii_mb3_blocks++;
+            return utf8_decode_sse_ascii_mb3_block(chunk, dest, dest_advance,
+                                                   ~sign_bits, mb3_bits, pack_table);
+        }
+    }
+
+    __m128i chunk_is_first  = _mm_and_si128(chunk, head_mask);
+//      __m128i chunk_is_signed = _mm_and_si128(chunk, sign_mask);
+
+//      __m128i ascii_mask     = _mm_cmpeq_epi8(chunk_is_signed, all_zeros);
+//      __m128i non_ascii_mask = _mm_cmplt_epi8(chunk_is_signed, all_zeros);
+    __m128i is_first_mask  = _mm_cmpeq_epi8(chunk_is_first,  head_mask);
+//      __m128i is_body_mask   = _mm_cmpeq_epi8(chunk_is_first,  body_mask);
+
+//      __m128i non_ascii_chunk = _mm_and_si128(chunk, non_ascii_mask);
+    __m128i is_first_chunk  = _mm_and_si128(chunk, is_first_mask);
+//      __m128i is_body_chunk   = _mm_and_si128(chunk, is_body_mask);
+//      __m128i body_counts = _mm_and_si128(ones_mask, is_body_mask);
+
+    __m128i mb_mask_high4 = _mm_srli_epi16(is_first_chunk, 4);
+    __m128i mb_mask_4 = _mm_and_si128(mb_mask_high4, mask4);
+
+    // Have any 4 bytes sequences, output the UTF-16 surrogate pairs.
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(mb_mask_4, mask4)) != 0) {
+        if (kStats) stats->mb4_blocks++;
+        return utf8_decode_sse_mb4_block(chunk, dest, dest_advance);
+    }
+
+    if (kStats) stats->generic_blocks++;
+    return utf8_decode_sse_generic_block(chunk, mb_mask_4, dest, dest_advance);
+}
+
+//
+// "x\e2\89\a4(\ce\b1+\ce\b2)\c2\b2\ce\b3\c2\b2"
+//
+template <bool kStats>
+static inline
+size_t utf8_decode_sse_impl(const char * src, size_t len, uint16_t * dest,
+                            utf8_block_stats_t * stats, size_t * consumed = nullptr)
+{
+    static const size_t kPerLoopBytes = 16;
 
+    const char * src_first = src;
+    const char * end = src + len;
+    const char * tail_end = end - utf8_cut_tail_len(src, end);
+    const uint16_t * dest_first = dest;
+
+    const utf8_pack_u16_table_t & pack_table = utf8_pack_u16_table();
+
+    while ((src + kPerLoopBytes) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        // The pure ASCII run
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits == 0) {
+            size_t ascii_len = utf8_decode_sse_ascii(src, end, dest);
+            src  += ascii_len;
+            dest += ascii_len;
+            if (kStats) stats->ascii_blocks += ascii_len / kPerLoopBytes;
+            continue;
+        }
+
+        uint32_t dest_advance;
+        src  += utf8_decode_sse_block<kStats>(chunk, sign_bits, dest, &dest_advance, pack_table, stats);
         dest += dest_advance;
-        src  += source_advance;
     }
 
+    // The last 1 ~ 15 bytes, without the character cut by the end, are padded
+    // with the zeros to a block and decoded by the same kernels.
+    while (src < tail_end) {
+        __m128i chunk = utf8_load_tail_sse(src, (size_t)(tail_end - src));
+
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits == 0) {
+            __m128i zeros = _mm_setzero_si128();
+            _mm_storeu_si128((__m128i *)dest,       _mm_unpacklo_epi8(chunk, zeros));
+            _mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi8(chunk, zeros));
+            src  += kPerLoopBytes;
+            dest += kPerLoopBytes;
+            if (kStats) stats->ascii_blocks++;
+            continue;
+        }
+
+        uint32_t dest_advance;
+        src  += utf8_decode_sse_block<kStats>(chunk, sign_bits, dest, &dest_advance, pack_table, stats);
+        dest += dest_advance;
+    }
+
+    // Drop the NUL code units of the padding, one for each byte.
+    if (src > tail_end) {
+        dest -= (size_t)(src - tail_end);
+        src = tail_end;
+    }
+
+    if (consumed != nullptr)
+        *consumed = (size_t)(src - src_first);
+
     size_t unicode_len = (size_t)(dest - dest_first);
     return unicode_len;
 }
 
+//
+// Decode all the whole characters of the buffer to UTF-16, the last bytes are
+// decoded as a zero padded block, an incomplete character at the end is not
+// decoded. The input must be valid UTF-8 (see utf8::validate()), it's not
+// checked, the dest must have room for (len + 16) code units.
+//
+static inline
+size_t utf8_decode_sse(const char * src, size_t len, uint16_t * dest)
+{
+    return utf8_decode_sse_impl<false>(src, len, dest, nullptr);
+}
+
+//
+// Same as utf8_decode_sse(), and the bytes decoded are returned to *consumed,
+// the character cut by the end (3 bytes at most) is left to the caller.
+//
+static inline
+size_t utf8_decode_sse_partial(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    assert(consumed != nullptr);
+    return utf8_decode_sse_impl<false>(src, len, dest, nullptr, consumed);
+}
+
+//
+// Same as utf8_decode_sse(), and count the blocks decoded by each kernel to *stats.
+//
+static inline
+size_t utf8_decode_sse_stats(const char * src, size_t len, uint16_t * dest, utf8_block_stats_t * stats)
+{
+    assert(stats != nullptr);
+    return utf8_decode_sse_impl<true>(src, len, dest, stats);
+}
+
 #ifdef __cplusplus
 
 template <size_t N>
@@ -334,11 +1128,13 @@ std::size_t fromUtf8_sse_save(const char * src, std::size_t len, unsigned short
         state = _mm_blendv_epi8(state, _mm_set1_epi8(0x03u | 0xE0u), cond3);
         __m128i mask3 = _mm_slli_si128(cond3, 1);
 
-        // In this version I do not handle sequences of 4 bytes. So if there is one
-        // we break and do a classic processing byte per byte.
+        // The sequences of 4 bytes are handled by utf8_decode_sse_mb4_block().
         __m128i cond4 = _mm_cmplt_epi8(_mm_set1_epi8(0xF0u - 1 - 0x80u), chunk_signed);
         if (_mm_movemask_epi8(cond4)) {
-            break;
+            uint32_t dest_advance;
+            src  += utf8_decode_sse_mb4_block(chunk, dest, &dest_advance);
+            dest += dest_advance;
+            continue;
         }
 
         // Separate the count and mask from the state vector
@@ -445,6 +1241,8 @@ std::size_t fromUtf8_sse_save(const char * src, std::size_t len, unsigned short
     return size;
 }
 
+#endif // __SSE4_1__
+
 #ifdef __cplusplus
 } // namespace utf8
 #endif
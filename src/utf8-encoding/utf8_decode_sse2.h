@@ -0,0 +1,196 @@
+#ifndef UTF8_DECODE_SSE2_H
+#define UTF8_DECODE_SSE2_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_decode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if UTF8_HAVE_SSE2
+
+//
+// Move the bytes whose shift has the bit N down by N bytes, the bit is tested
+// on the incoming byte, same as the _mm_blendv_epi8() steps in utf8_decode_sse().
+//
+template <int N>
+static inline
+void utf8_decode_sse2_compact(__m128i & shifts, __m128i & chunk_low, __m128i & chunk_high)
+{
+    const __m128i bit_mask = _mm_set1_epi8((char)N);
+
+    __m128i shifts_n = _mm_srli_si128(shifts, N);
+    __m128i move_mask = _mm_cmpeq_epi8(_mm_and_si128(shifts_n, bit_mask), bit_mask);
+
+    shifts     = _mm_or_si128(_mm_andnot_si128(move_mask, shifts),
+                              _mm_and_si128(move_mask, shifts_n));
+    chunk_low  = _mm_or_si128(_mm_andnot_si128(move_mask, chunk_low),
+                              _mm_and_si128(move_mask, _mm_srli_si128(chunk_low, N)));
+    chunk_high = _mm_or_si128(_mm_andnot_si128(move_mask, chunk_high),
+                              _mm_and_si128(move_mask, _mm_srli_si128(chunk_high, N)));
+}
+
+//
+// The SSE2 baseline of utf8_decode_sse(), for the CPUs (or the VMs) without SSSE3.
+//
+// The length of the characters is got by compares instead of a pshufb lookup,
+// and the gaps are removed by moving the code unit bytes themselves through
+// the 1, 2, 4, 8 bytes steps, instead of shuffling by the moved shifts.
+// The blocks with any 4 bytes sequences are decoded by utf8_decode_scalar(),
+// the pure ASCII runs are widened by utf8_decode_sse_ascii().
+//
+// Same as utf8_decode_sse(), the last 0 ~ 15 bytes are decoded by
+// utf8_decode_scalar(), so all the whole characters are decoded.
+//
+static inline
+size_t utf8_decode_sse2(const char * src, size_t len, uint16_t * dest)
+{
+    static const size_t kPerLoopBytes = 16;
+
+    const __m128i mask_80       = _mm_set1_epi8(0x80u);
+    const __m128i mask_C0       = _mm_set1_epi8(0xC0u);
+    const __m128i mask_E0       = _mm_set1_epi8(0xE0u);
+    const __m128i mask_F0       = _mm_set1_epi8(0xF0u);
+    const __m128i mask_0F       = _mm_set1_epi8(0x0F);
+    const __m128i mask_3F       = _mm_set1_epi8(0x3F);
+    const __m128i ones_mask     = _mm_set1_epi8(0x01);
+    const __m128i twos_mask     = _mm_set1_epi8(0x02);
+    const __m128i threes_mask   = _mm_set1_epi8(0x03);
+
+    const char * end = src + len;
+    const uint16_t * dest_first = dest;
+
+    __m128i all_zeros = _mm_setzero_si128();
+
+    while ((src + kPerLoopBytes) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        // The pure ASCII run
+        if (_mm_movemask_epi8(chunk) == 0) {
+            size_t ascii_len = utf8_decode_sse_ascii(src, end, dest);
+            src  += ascii_len;
+            dest += ascii_len;
+            continue;
+        }
+
+        __m128i is_mb4_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, mask_F0), mask_F0);
+        if (_mm_movemask_epi8(is_mb4_mask) != 0) {
+            // A byte is the last byte of a character if the next byte is not a continuation byte.
+            __m128i is_body_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, mask_C0), mask_80);
+            uint32_t tail_chars = ((~(uint32_t)_mm_movemask_epi8(is_body_mask)) >> 1) & 0x7FFFu;
+            assert(tail_chars != 0);
+            uint32_t source_advance = (uint32_t)bit_bsr32(tail_chars) + 1;
+
+            dest += utf8_decode_scalar(src, source_advance, dest);
+            src  += source_advance;
+            continue;
+        }
+
+        // count = 2 for 110xxxxx, 3 for 1110xxxx, otherwise 0.
+        __m128i is_first_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, mask_C0), mask_C0);
+        __m128i is_mb3_mask   = _mm_cmpeq_epi8(_mm_and_si128(chunk, mask_E0), mask_E0);
+        __m128i count = _mm_or_si128(_mm_and_si128(is_first_mask, twos_mask),
+                                     _mm_and_si128(is_mb3_mask, ones_mask));
+
+        __m128i count_sub1 = _mm_subs_epu8(count, ones_mask);
+        __m128i counts = _mm_or_si128(count, _mm_slli_si128(count_sub1, 1));
+        __m128i count_sub2_shift2 = _mm_slli_si128(_mm_subs_epu8(count, twos_mask), 2);
+        counts = _mm_or_si128(counts, count_sub2_shift2);
+
+        __m128i shifts = count_sub1;
+        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 1));
+        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 2));
+        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 4));
+        shifts = _mm_add_epi8(shifts, _mm_slli_si128(shifts, 8));
+
+        __m128i tail_chars_mask = _mm_cmplt_epi8(counts, twos_mask);
+        shifts = _mm_and_si128(shifts, tail_chars_mask);
+
+        uint32_t tail_chars = (uint32_t)_mm_movemask_epi8(tail_chars_mask);
+        assert(tail_chars != 0);
+        uint32_t source_advance = (uint32_t)bit_bsr32(tail_chars) + 1;
+        assert(source_advance >= 14 && source_advance <= 16);
+
+        // The shift of the last tail char is the number of the dropped bytes.
+        uint8_t tail_shifts[16];
+        _mm_storeu_si128((__m128i *)tail_shifts, shifts);
+        uint32_t dest_advance = source_advance - tail_shifts[source_advance - 1];
+
+        __m128i ascii_mask  = _mm_cmpeq_epi8(counts, all_zeros);
+        __m128i chunk_ascii = _mm_and_si128(chunk, ascii_mask);
+
+        __m128i mb_1_mask  = _mm_cmpeq_epi8(counts, ones_mask);
+        __m128i chunk_mb_1 = _mm_and_si128(chunk, mb_1_mask);
+        __m128i chunk_low_05 = _mm_and_si128(chunk_mb_1, mask_3F);
+
+        __m128i mb_2_mask  = _mm_cmpeq_epi8(counts, twos_mask);
+        __m128i chunk_mb_2 = _mm_slli_si128(_mm_and_si128(chunk, mb_2_mask), 1);
+        __m128i chunk_low_67 = _mm_and_si128(_mm_slli_epi16(chunk_mb_2, 6), mask_C0);
+
+        __m128i chunk_low = _mm_or_si128(_mm_or_si128(chunk_low_05, chunk_low_67), chunk_ascii);
+
+        __m128i mb_3_mask  = _mm_cmpeq_epi8(counts, threes_mask);
+        __m128i chunk_mb_3 = _mm_slli_si128(_mm_and_si128(chunk, mb_3_mask), 2);
+
+        __m128i chunk_high_03 = _mm_and_si128(_mm_srli_epi16(chunk_mb_2, 2), mask_0F);
+        __m128i chunk_high_47 = _mm_and_si128(_mm_slli_epi16(chunk_mb_3, 4), mask_F0);
+
+        __m128i chunk_high = _mm_or_si128(chunk_high_03, chunk_high_47);
+
+        // Remove the gaps without pshufb
+        utf8_decode_sse2_compact<1>(shifts, chunk_low, chunk_high);
+        utf8_decode_sse2_compact<2>(shifts, chunk_low, chunk_high);
+        utf8_decode_sse2_compact<4>(shifts, chunk_low, chunk_high);
+        utf8_decode_sse2_compact<8>(shifts, chunk_low, chunk_high);
+
+        // Now we can unpack and store
+        __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
+        __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
+
+        _mm_storeu_si128((__m128i *)dest,       utf16_low);
+        _mm_storeu_si128((__m128i *)(dest + 8), utf16_high);
+
+        dest += dest_advance;
+        src  += source_advance;
+    }
+
+    dest += utf8_decode_scalar(src, (size_t)(end - src), dest);
+
+    size_t unicode_len = (size_t)(dest - dest_first);
+    return unicode_len;
+}
+
+#ifdef __cplusplus
+
+template <size_t N>
+static inline
+size_t utf8_decode_sse2(const char * src, size_t len, uint16_t (&dest)[N])
+{
+    return utf8_decode_sse2(src, len, dest);
+}
+
+#endif // __cplusplus
+
+#endif // UTF8_HAVE_SSE2
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_DECODE_SSE2_H
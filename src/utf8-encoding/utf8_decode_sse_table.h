@@ -0,0 +1,246 @@
+#ifndef UTF8_DECODE_SSE_TABLE_H
+#define UTF8_DECODE_SSE_TABLE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_decode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__SSE4_1__)
+
+//
+// The shuffle table of utf8_decode_sse_table(), indexed by the 12 bits mask
+// of the lead (not continuation) bytes 1 ~ 12 of a block. The bit n is set
+// if the byte n is the end of a character, the shuffle moves the ends to the
+// front, "consumed" is the bytes up to the last end, "produced" is the count
+// of the ends (the code units).
+//
+struct utf8_shuffle_entry_t {
+    uint8_t shuffle[16];
+    uint8_t consumed;
+    uint8_t produced;
+};
+
+static const uint32_t kShuffleTableBits = 12;
+static const uint32_t kShuffleTableSize = 1u << kShuffleTableBits;
+
+struct utf8_shuffle_table_t {
+    utf8_shuffle_entry_t entries[kShuffleTableSize];
+};
+
+namespace detail {
+
+template <size_t... I>
+struct index_seq {};
+
+template <typename Seq1, typename Seq2>
+struct concat_index_seq;
+
+template <size_t... I1, size_t... I2>
+struct concat_index_seq<index_seq<I1...>, index_seq<I2...>> {
+    typedef index_seq<I1..., (sizeof...(I1) + I2)...> type;
+};
+
+// The depth of the instantiations is log2(N), 4096 is beyond -ftemplate-depth.
+template <size_t N>
+struct make_index_seq {
+    typedef typename concat_index_seq<typename make_index_seq<N / 2>::type,
+                                      typename make_index_seq<N - N / 2>::type>::type type;
+};
+
+template <>
+struct make_index_seq<0> {
+    typedef index_seq<> type;
+};
+
+template <>
+struct make_index_seq<1> {
+    typedef index_seq<0> type;
+};
+
+// The position of the n-th set bit, or 0x80 (clear the byte) if there is none.
+static constexpr
+uint8_t shuffle_nth_end(uint32_t mask, uint32_t n, uint32_t pos = 0)
+{
+    return (pos >= kShuffleTableBits) ? uint8_t(0x80u) :
+           (((mask >> pos) & 1u) == 0) ? shuffle_nth_end(mask, n, pos + 1) :
+           (n == 0) ? uint8_t(pos) : shuffle_nth_end(mask, n - 1, pos + 1);
+}
+
+static constexpr
+uint8_t shuffle_ends(uint32_t mask)
+{
+    return (mask == 0) ? uint8_t(0) : uint8_t((mask & 1u) + shuffle_ends(mask >> 1));
+}
+
+static constexpr
+uint8_t shuffle_last_end(uint32_t mask)
+{
+    return (mask <= 1u) ? uint8_t(0) : uint8_t(1 + shuffle_last_end(mask >> 1));
+}
+
+// A block without any end is invalid (a sequence longer than 12 bytes), skip it.
+static constexpr
+utf8_shuffle_entry_t make_shuffle_entry(uint32_t mask)
+{
+    return utf8_shuffle_entry_t {
+        {
+            shuffle_nth_end(mask, 0),  shuffle_nth_end(mask, 1),  shuffle_nth_end(mask, 2),  shuffle_nth_end(mask, 3),
+            shuffle_nth_end(mask, 4),  shuffle_nth_end(mask, 5),  shuffle_nth_end(mask, 6),  shuffle_nth_end(mask, 7),
+            shuffle_nth_end(mask, 8),  shuffle_nth_end(mask, 9),  shuffle_nth_end(mask, 10), shuffle_nth_end(mask, 11),
+            shuffle_nth_end(mask, 12), shuffle_nth_end(mask, 13), shuffle_nth_end(mask, 14), shuffle_nth_end(mask, 15)
+        },
+        (mask != 0) ? uint8_t(shuffle_last_end(mask) + 1) : uint8_t(kShuffleTableBits),
+        shuffle_ends(mask)
+    };
+}
+
+template <size_t... I>
+static constexpr
+utf8_shuffle_table_t make_shuffle_table(index_seq<I...>)
+{
+    return utf8_shuffle_table_t { { make_shuffle_entry((uint32_t)I)... } };
+}
+
+} // namespace detail
+
+//
+// Decode a block like utf8_decode_sse_block(), except the gaps are removed by
+// a shuffle mask from the compile time table instead of the shifts prefix-sum
+// and the four dependent _mm_blendv_epi8() steps. Up to 12 bytes are decoded
+// per block, returns the bytes consumed.
+//
+static inline
+uint32_t utf8_decode_sse_table_block(__m128i chunk, uint16_t * dest, uint32_t * dest_advance)
+{
+    static constexpr utf8_shuffle_table_t kShuffleTable =
+        detail::make_shuffle_table(detail::make_index_seq<kShuffleTableSize>::type());
+
+    // Have any 4 bytes sequences, output the UTF-16 surrogate pairs.
+    __m128i mb4_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF0u)), _mm_set1_epi8(0xF0u));
+    if (_mm_movemask_epi8(mb4_mask) != 0) {
+        return utf8_decode_sse_mb4_block(chunk, dest, dest_advance);
+    }
+
+    __m128i body_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0x80u));
+    uint32_t end_bits = ((~(uint32_t)_mm_movemask_epi8(body_mask)) >> 1) & (kShuffleTableSize - 1);
+    const utf8_shuffle_entry_t & entry = kShuffleTable.entries[end_bits];
+
+    __m128i prev1 = _mm_slli_si128(chunk, 1);
+    __m128i prev2 = _mm_slli_si128(chunk, 2);
+
+    __m128i ascii_mask    = _mm_cmpgt_epi8(chunk, _mm_set1_epi8(-1));
+    __m128i mb3_mask      = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF0u)), _mm_set1_epi8(0xE0u));
+    __m128i tail_mb3_mask = _mm_slli_si128(mb3_mask, 2);
+
+    // The low byte: 0xxxxxxx or yyxxxxxx, the high byte: 00000yyy or zzzzyyyy
+    __m128i chunk_low = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev1, 6), _mm_set1_epi8(0xC0u)),
+                                     _mm_and_si128(chunk, _mm_set1_epi8(0x3Fu)));
+    chunk_low = _mm_blendv_epi8(chunk_low, chunk, ascii_mask);
+
+    __m128i chunk_high = _mm_and_si128(_mm_srli_epi16(prev1, 2), _mm_set1_epi8(0x0Fu));
+    chunk_high = _mm_or_si128(chunk_high, _mm_and_si128(_mm_and_si128(_mm_slli_epi16(prev2, 4),
+                                                                      _mm_set1_epi8(0xF0u)), tail_mb3_mask));
+    chunk_high = _mm_andnot_si128(ascii_mask, chunk_high);
+
+    // Remove the gaps by the shuffle from the table
+    __m128i shuffle = _mm_loadu_si128((const __m128i *)entry.shuffle);
+    chunk_low  = _mm_shuffle_epi8(chunk_low,  shuffle);
+    chunk_high = _mm_shuffle_epi8(chunk_high, shuffle);
+
+    // Now we can unpack and store
+    __m128i utf16_low  = _mm_unpacklo_epi8(chunk_low, chunk_high);
+    __m128i utf16_high = _mm_unpackhi_epi8(chunk_low, chunk_high);
+
+    _mm_storeu_si128((__m128i *)dest,       utf16_low);
+    _mm_storeu_si128((__m128i *)(dest + 8), utf16_high);
+
+    *dest_advance = entry.produced;
+    return entry.consumed;
+}
+
+//
+// The same as utf8_decode_sse(), the blocks are decoded by
+// utf8_decode_sse_table_block(), and the last 1 ~ 15 bytes are decoded as
+// the zero padded blocks, so all the whole characters are decoded. The dest
+// must have room for (len + 16) code units.
+//
+static inline
+size_t utf8_decode_sse_table(const char * src, size_t len, uint16_t * dest)
+{
+    static const size_t kPerLoopBytes = 16;
+
+    const char * end = src + len;
+    const char * tail_end = end - utf8_cut_tail_len(src, end);
+    const uint16_t * dest_first = dest;
+
+    while ((src + kPerLoopBytes) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        // The pure ASCII run
+        if (_mm_movemask_epi8(chunk) == 0) {
+            size_t ascii_len = utf8_decode_sse_ascii(src, end, dest);
+            src  += ascii_len;
+            dest += ascii_len;
+            continue;
+        }
+
+        uint32_t dest_advance;
+        src  += utf8_decode_sse_table_block(chunk, dest, &dest_advance);
+        dest += dest_advance;
+    }
+
+    // The last 1 ~ 15 bytes, without the character cut by the end.
+    while (src < tail_end) {
+        __m128i chunk = utf8_load_tail_sse(src, (size_t)(tail_end - src));
+
+        uint32_t dest_advance;
+        src  += utf8_decode_sse_table_block(chunk, dest, &dest_advance);
+        dest += dest_advance;
+    }
+
+    // Drop the NUL code units of the padding, one for each byte.
+    if (src > tail_end) {
+        dest -= (size_t)(src - tail_end);
+        src = tail_end;
+    }
+
+    size_t unicode_len = (size_t)(dest - dest_first);
+    return unicode_len;
+}
+
+#ifdef __cplusplus
+
+template <size_t N>
+static inline
+size_t utf8_decode_sse_table(const char * src, size_t len, uint16_t (&dest)[N])
+{
+    return utf8_decode_sse_table(src, len, dest);
+}
+
+#endif // __cplusplus
+
+#endif // __SSE4_1__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_DECODE_SSE_TABLE_H
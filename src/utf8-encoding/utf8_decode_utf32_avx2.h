@@ -0,0 +1,102 @@
+#ifndef UTF8_DECODE_UTF32_AVX2_H
+#define UTF8_DECODE_UTF32_AVX2_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "utf8-encoding/utf8_decode_utf32_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__AVX2__)
+
+//
+// Same as utf8_to_utf32_sse(), and the pure ASCII is widened by vpmovzxbd,
+// 32 bytes per round.
+//
+// Returns the code points written, the dest must have room for (len + 16).
+//
+static inline
+size_t utf8_to_utf32_avx2(const char * src, size_t len, uint32_t * dest)
+{
+    static const size_t kPerLoopBytes = 16;
+
+    const char * end = src + len;
+    const uint32_t * dest_first = dest;
+
+    const utf8_pack_u16_table_t & pack_table = utf8_pack_u16_table();
+
+    alignas(16) uint16_t units[16];
+
+    while ((src + kPerLoopBytes) <= end) {
+        // The pure ASCII, 32 bytes
+        if ((src + 32) <= end) {
+            __m256i whole = _mm256_loadu_si256((const __m256i *)src);
+            if (_mm256_movemask_epi8(whole) == 0) {
+                __m128i lane0 = _mm256_castsi256_si128(whole);
+                __m128i lane1 = _mm256_extracti128_si256(whole, 1);
+                _mm256_storeu_si256((__m256i *)(dest + 0),  _mm256_cvtepu8_epi32(lane0));
+                _mm256_storeu_si256((__m256i *)(dest + 8),  _mm256_cvtepu8_epi32(_mm_srli_si128(lane0, 8)));
+                _mm256_storeu_si256((__m256i *)(dest + 16), _mm256_cvtepu8_epi32(lane1));
+                _mm256_storeu_si256((__m256i *)(dest + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(lane1, 8)));
+                src  += 32;
+                dest += 32;
+                continue;
+            }
+        }
+
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits == 0) {
+            utf8_to_utf32_sse_ascii(chunk, dest);
+            src  += kPerLoopBytes;
+            dest += kPerLoopBytes;
+            continue;
+        }
+
+        uint32_t dest_advance;
+        src  += utf8_to_utf32_sse_block(chunk, sign_bits, dest, &dest_advance, units, pack_table);
+        dest += dest_advance;
+    }
+
+    dest += utf8_to_utf32_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+#ifdef __cplusplus
+
+template <size_t N>
+static inline
+size_t utf8_to_utf32_avx2(const char * src, size_t len, uint32_t (&dest)[N])
+{
+    return utf8_to_utf32_avx2(src, len, dest);
+}
+
+#endif // __cplusplus
+
+#endif // __AVX2__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_DECODE_UTF32_AVX2_H
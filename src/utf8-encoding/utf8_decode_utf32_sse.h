@@ -0,0 +1,219 @@
+#ifndef UTF8_DECODE_UTF32_SSE_H
+#define UTF8_DECODE_UTF32_SSE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_decode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__SSE4_1__)
+
+//
+// Widen 16 ASCII bytes to 16 code points.
+//
+static inline
+void utf8_to_utf32_sse_ascii(__m128i chunk, uint32_t * dest)
+{
+    _mm_storeu_si128((__m128i *)(dest + 0),  _mm_cvtepu8_epi32(chunk));
+    _mm_storeu_si128((__m128i *)(dest + 4),  _mm_cvtepu8_epi32(_mm_srli_si128(chunk, 4)));
+    _mm_storeu_si128((__m128i *)(dest + 8),  _mm_cvtepu8_epi32(_mm_srli_si128(chunk, 8)));
+    _mm_storeu_si128((__m128i *)(dest + 12), _mm_cvtepu8_epi32(_mm_srli_si128(chunk, 12)));
+}
+
+//
+// Widen 8 code units to the code points, the high surrogates are combined with
+// the next units, the low surrogates are removed. Returns the code points written.
+//
+static inline
+uint32_t utf8_to_utf32_sse_pairs8(__m128i units, __m128i next_units, uint32_t keep,
+                                  uint32_t * dest, const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i high_surr_mask = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short)0xFC00)),
+                                             _mm_set1_epi16((short)0xD800));
+
+    // (high - 0xD800) << 10) + (low - 0xDC00) + 0x10000, the low and high 16 bits.
+    __m128i pair_low  = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(units, _mm_set1_epi16(0x003F)), 10),
+                                     _mm_and_si128(next_units, _mm_set1_epi16(0x03FF)));
+    __m128i pair_high = _mm_add_epi16(_mm_and_si128(_mm_srli_epi16(units, 6), _mm_set1_epi16(0x000F)),
+                                      _mm_set1_epi16(0x0001));
+
+    __m128i code_low  = _mm_blendv_epi8(units, pair_low, high_surr_mask);
+    __m128i code_high = _mm_and_si128(pair_high, high_surr_mask);
+
+    __m128i shuffle = _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep]);
+    code_low  = _mm_shuffle_epi8(code_low,  shuffle);
+    code_high = _mm_shuffle_epi8(code_high, shuffle);
+
+    _mm_storeu_si128((__m128i *)(dest + 0), _mm_unpacklo_epi16(code_low, code_high));
+    _mm_storeu_si128((__m128i *)(dest + 4), _mm_unpackhi_epi16(code_low, code_high));
+    return pack_table.length[keep];
+}
+
+//
+// Widen the code units decoded from a block with any 4 bytes sequences, the
+// surrogate pairs are always whole. Returns the code points written.
+//
+static inline
+uint32_t utf8_to_utf32_sse_pairs(const uint16_t * units, uint32_t count, uint32_t * dest,
+                                 const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i units0 = _mm_load_si128((const __m128i *)(units + 0));
+    __m128i units1 = _mm_load_si128((const __m128i *)(units + 8));
+
+    __m128i low_surr_mask0 = _mm_cmpeq_epi16(_mm_and_si128(units0, _mm_set1_epi16((short)0xFC00)),
+                                             _mm_set1_epi16((short)0xDC00));
+    __m128i low_surr_mask1 = _mm_cmpeq_epi16(_mm_and_si128(units1, _mm_set1_epi16((short)0xFC00)),
+                                             _mm_set1_epi16((short)0xDC00));
+    uint32_t low_surr_bits = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(low_surr_mask0, low_surr_mask1));
+    uint32_t keep = ~low_surr_bits & ((1u << count) - 1);
+
+    uint32_t len = utf8_to_utf32_sse_pairs8(units0, _mm_alignr_epi8(units1, units0, 2),
+                                            keep & 0xFFu, dest, pack_table);
+    len += utf8_to_utf32_sse_pairs8(units1, _mm_srli_si128(units1, 2),
+                                    keep >> 8, dest + len, pack_table);
+    return len;
+}
+
+//
+// Widen the two halves of the packed code units, see utf8_decode_sse_mb2_units().
+//
+static inline
+uint32_t utf8_to_utf32_sse_widen(__m128i utf16_low, uint32_t low_len,
+                                 __m128i utf16_high, uint32_t high_len, uint32_t * dest)
+{
+    _mm_storeu_si128((__m128i *)(dest + 0), _mm_cvtepu16_epi32(utf16_low));
+    _mm_storeu_si128((__m128i *)(dest + 4), _mm_cvtepu16_epi32(_mm_srli_si128(utf16_low, 8)));
+    dest += low_len;
+    _mm_storeu_si128((__m128i *)(dest + 0), _mm_cvtepu16_epi32(utf16_high));
+    _mm_storeu_si128((__m128i *)(dest + 4), _mm_cvtepu16_epi32(_mm_srli_si128(utf16_high, 8)));
+    return low_len + high_len;
+}
+
+//
+// Decode a 16 bytes block which is not pure ASCII (sign_bits != 0) to UTF-32,
+// classified by the lead bytes the same as utf8_decode_sse_block(). The 2 bytes
+// and the ASCII + 3 bytes blocks are widened from the packed code units in the
+// registers, the others are decoded to the 16 code units of *units first.
+// Returns the source advance, the code points written are stored to *dest_advance.
+//
+static inline
+uint32_t utf8_to_utf32_sse_block(__m128i chunk, uint32_t sign_bits, uint32_t * dest, uint32_t * dest_advance,
+                                 uint16_t * units, const utf8_pack_u16_table_t & pack_table)
+{
+    __m128i utf16_low, utf16_high;
+    uint32_t low_len, high_len;
+    uint32_t source_advance;
+
+    // Have any 4 bytes sequences, combine the surrogate pairs.
+    __m128i mb4_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF0u)), _mm_set1_epi8(0xF0u));
+    if (_mm_movemask_epi8(mb4_mask) != 0) {
+        uint32_t units_len;
+        source_advance = utf8_decode_sse_mb4_block(chunk, units, &units_len);
+        *dest_advance = utf8_to_utf32_sse_pairs(units, units_len, dest, pack_table);
+        return source_advance;
+    }
+
+    // Only ASCII and 2 bytes sequences
+    __m128i mb3_mask  = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xF0u)), _mm_set1_epi8(0xE0u));
+    uint32_t mb3_bits = (uint32_t)_mm_movemask_epi8(mb3_mask);
+    if (mb3_bits == 0) {
+        source_advance = utf8_decode_sse_mb2_units(chunk, &utf16_low, &utf16_high,
+                                                   &low_len, &high_len, pack_table);
+        *dest_advance = utf8_to_utf32_sse_widen(utf16_low, low_len, utf16_high, high_len, dest);
+        return source_advance;
+    }
+
+    // Only ASCII and 3 bytes sequences
+    __m128i first_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0xC0u));
+    if ((uint32_t)_mm_movemask_epi8(first_mask) == mb3_bits) {
+        source_advance = utf8_decode_sse_ascii_mb3_units(chunk, &utf16_low, &utf16_high,
+                                                         &low_len, &high_len,
+                                                         ~sign_bits, mb3_bits, pack_table);
+        *dest_advance = utf8_to_utf32_sse_widen(utf16_low, low_len, utf16_high, high_len, dest);
+        return source_advance;
+    }
+
+    __m128i mb_mask_4 = _mm_and_si128(_mm_srli_epi16(_mm_and_si128(chunk, first_mask), 4), _mm_set1_epi8(0x0F));
+    source_advance = utf8_decode_sse_generic_block(chunk, mb_mask_4, units, dest_advance);
+
+    utf16_low  = _mm_load_si128((const __m128i *)(units + 0));
+    utf16_high = _mm_load_si128((const __m128i *)(units + 8));
+    utf8_to_utf32_sse_widen(utf16_low, 8, utf16_high, 8, dest);
+    return source_advance;
+}
+
+//
+// Decode UTF-8 to UTF-32 by the same kernels as utf8_decode_sse(), the code
+// units are widened to the code points by pmovzxwd. The bytes after the last
+// whole block are decoded by utf8_to_utf32_scalar().
+//
+// Returns the code points written, the dest must have room for (len + 16).
+//
+static inline
+size_t utf8_to_utf32_sse(const char * src, size_t len, uint32_t * dest)
+{
+    static const size_t kPerLoopBytes = 16;
+
+    const char * end = src + len;
+    const uint32_t * dest_first = dest;
+
+    const utf8_pack_u16_table_t & pack_table = utf8_pack_u16_table();
+
+    alignas(16) uint16_t units[16];
+
+    while ((src + kPerLoopBytes) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        // The pure ASCII
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits == 0) {
+            utf8_to_utf32_sse_ascii(chunk, dest);
+            src  += kPerLoopBytes;
+            dest += kPerLoopBytes;
+            continue;
+        }
+
+        uint32_t dest_advance;
+        src  += utf8_to_utf32_sse_block(chunk, sign_bits, dest, &dest_advance, units, pack_table);
+        dest += dest_advance;
+    }
+
+    dest += utf8_to_utf32_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+#ifdef __cplusplus
+
+template <size_t N>
+static inline
+size_t utf8_to_utf32_sse(const char * src, size_t len, uint32_t (&dest)[N])
+{
+    return utf8_to_utf32_sse(src, len, dest);
+}
+
+#endif // __cplusplus
+
+#endif // __SSE4_1__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_DECODE_UTF32_SSE_H
@@ -0,0 +1,532 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <atomic>
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_validate.h"
+#include "utf8-encoding/utf8_dispatch.h"
+#include "utf8-encoding/asm/asmlib.h"
+
+static size_t utf8_decode_kernel_scalar(const char * src, size_t len, uint16_t * dest)
+{
+    return utf8::utf8_decode_scalar(src, len, dest);
+}
+
+static size_t utf8_decode_resolve(const char * src, size_t len, uint16_t * dest);
+
+// Initially points to the resolver, it's replaced by the selected kernel at the first call.
+// The pointers are atomic, the threads may call them while they are being replaced.
+static std::atomic<utf8_decode_func_t> utf8DecodeDispatch(utf8_decode_resolve);
+static std::atomic<int> utf8DecodeKernel(-1);
+
+static const char * const utf8KernelNames[UTF8_KERNEL_MAX] = {
+    "scalar",
+    "sse2",
+    "sse4.1",
+    "avx2",
+    "avx512"
+};
+
+// The minimum InstructionSet() level of each kernel
+static const int utf8KernelLevels[UTF8_KERNEL_MAX] = {
+    0,      // scalar
+    4,      // SSE2
+    8,      // SSE4.1
+    13,     // AVX2
+    17      // AVX512VBMI, AVX512VBMI2
+};
+
+static utf8_decode_func_t utf8_decode_entry(int kernel)
+{
+    switch (kernel) {
+        case UTF8_KERNEL_SCALAR:
+            return utf8_decode_kernel_scalar;
+        case UTF8_KERNEL_SSE2:
+            return utf8_decode_entry_sse2();
+        case UTF8_KERNEL_SSE41:
+            return utf8_decode_entry_sse41();
+        case UTF8_KERNEL_AVX2:
+            return utf8_decode_entry_avx2();
+        case UTF8_KERNEL_AVX512:
+            return utf8_decode_entry_avx512();
+        default:
+            return nullptr;
+    }
+}
+
+utf8_decode_func_t utf8_decode_get_kernel(int kernel)
+{
+    if (kernel < 0 || kernel >= UTF8_KERNEL_MAX)
+        return nullptr;
+    if (InstructionSet() < utf8KernelLevels[kernel])
+        return nullptr;
+    return utf8_decode_entry(kernel);
+}
+
+//
+// Select the widest kernel which is compiled in and supported by the CPU.
+// It's executed once, or by each thread in the race of the first calls, and
+// they all store the same values.
+//
+static utf8_decode_func_t utf8_decode_select(void)
+{
+    int iset = InstructionSet();
+    for (int kernel = UTF8_KERNEL_MAX - 1; kernel >= UTF8_KERNEL_SCALAR; kernel--) {
+        if (iset >= utf8KernelLevels[kernel]) {
+            utf8_decode_func_t decode_func = utf8_decode_entry(kernel);
+            if (decode_func != nullptr) {
+                utf8DecodeKernel.store(kernel, std::memory_order_release);
+                utf8DecodeDispatch.store(decode_func, std::memory_order_release);
+                return decode_func;
+            }
+        }
+    }
+
+    utf8DecodeKernel.store(UTF8_KERNEL_SCALAR, std::memory_order_release);
+    utf8DecodeDispatch.store(utf8_decode_kernel_scalar, std::memory_order_release);
+    return utf8_decode_kernel_scalar;
+}
+
+static size_t utf8_decode_resolve(const char * src, size_t len, uint16_t * dest)
+{
+    utf8_decode_func_t decode_func = utf8_decode_select();
+    return decode_func(src, len, dest);
+}
+
+size_t utf8_decode_dispatch(const char * src, size_t len, uint16_t * dest)
+{
+    utf8_decode_func_t decode_func = utf8DecodeDispatch.load(std::memory_order_acquire);
+    return decode_func(src, len, dest);
+}
+
+size_t utf8_decode_partial_dispatch(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    // All the kernels decode all the whole characters.
+    *consumed = len - utf8::utf8_cut_tail_len(src, src + len);
+    return utf8_decode_dispatch(src, len, dest);
+}
+
+int utf8_decode_kernel(void)
+{
+    if (utf8DecodeKernel.load(std::memory_order_acquire) < 0) {
+        utf8_decode_select();
+    }
+    return utf8DecodeKernel.load(std::memory_order_acquire);
+}
+
+const char * utf8_kernel_name(int kernel)
+{
+    if (kernel >= 0 && kernel < UTF8_KERNEL_MAX)
+        return utf8KernelNames[kernel];
+    else
+        return "unknown";
+}
+
+static size_t utf16_encode_kernel_scalar(const uint16_t * src, size_t len, char * dest)
+{
+    return utf8::utf16_to_utf8_scalar(src, len, dest);
+}
+
+static size_t utf16_encode_resolve(const uint16_t * src, size_t len, char * dest);
+
+// Initially points to the resolver, same as utf8DecodeDispatch.
+static std::atomic<utf16_encode_func_t> utf16EncodeDispatch(utf16_encode_resolve);
+static std::atomic<int> utf16EncodeKernel(-1);
+
+static utf16_encode_func_t utf16_encode_entry(int kernel)
+{
+    switch (kernel) {
+        case UTF8_KERNEL_SCALAR:
+            return utf16_encode_kernel_scalar;
+        case UTF8_KERNEL_SSE41:
+            return utf16_encode_entry_sse41();
+        case UTF8_KERNEL_AVX2:
+            return utf16_encode_entry_avx2();
+        default:
+            return nullptr;
+    }
+}
+
+utf16_encode_func_t utf16_encode_get_kernel(int kernel)
+{
+    if (kernel < 0 || kernel >= UTF8_KERNEL_MAX)
+        return nullptr;
+    if (InstructionSet() < utf8KernelLevels[kernel])
+        return nullptr;
+    return utf16_encode_entry(kernel);
+}
+
+static utf16_encode_func_t utf16_encode_select(void)
+{
+    int iset = InstructionSet();
+    for (int kernel = UTF8_KERNEL_MAX - 1; kernel >= UTF8_KERNEL_SCALAR; kernel--) {
+        if (iset >= utf8KernelLevels[kernel]) {
+            utf16_encode_func_t encode_func = utf16_encode_entry(kernel);
+            if (encode_func != nullptr) {
+                utf16EncodeKernel.store(kernel, std::memory_order_release);
+                utf16EncodeDispatch.store(encode_func, std::memory_order_release);
+                return encode_func;
+            }
+        }
+    }
+
+    utf16EncodeKernel.store(UTF8_KERNEL_SCALAR, std::memory_order_release);
+    utf16EncodeDispatch.store(utf16_encode_kernel_scalar, std::memory_order_release);
+    return utf16_encode_kernel_scalar;
+}
+
+static size_t utf16_encode_resolve(const uint16_t * src, size_t len, char * dest)
+{
+    utf16_encode_func_t encode_func = utf16_encode_select();
+    return encode_func(src, len, dest);
+}
+
+size_t utf16_to_utf8(const uint16_t * src, size_t len, char * dest)
+{
+    utf16_encode_func_t encode_func = utf16EncodeDispatch.load(std::memory_order_acquire);
+    return encode_func(src, len, dest);
+}
+
+int utf16_encode_kernel(void)
+{
+    if (utf16EncodeKernel.load(std::memory_order_acquire) < 0) {
+        utf16_encode_select();
+    }
+    return utf16EncodeKernel.load(std::memory_order_acquire);
+}
+
+static size_t utf16_length_kernel_scalar(const char * src, size_t len)
+{
+    return utf8::utf16_length_from_utf8_scalar(src, len);
+}
+
+static size_t utf16_length_resolve(const char * src, size_t len);
+
+// Initially points to the resolver, same as utf8DecodeDispatch.
+static std::atomic<utf16_length_func_t> utf16LengthDispatch(utf16_length_resolve);
+
+static utf16_length_func_t utf16_length_entry(int kernel)
+{
+    switch (kernel) {
+        case UTF8_KERNEL_SCALAR:
+            return utf16_length_kernel_scalar;
+        case UTF8_KERNEL_SSE2:
+            return utf16_length_entry_sse2();
+        case UTF8_KERNEL_AVX2:
+            return utf16_length_entry_avx2();
+        default:
+            return nullptr;
+    }
+}
+
+static utf16_length_func_t utf16_length_select(void)
+{
+    int iset = InstructionSet();
+    for (int kernel = UTF8_KERNEL_MAX - 1; kernel >= UTF8_KERNEL_SCALAR; kernel--) {
+        if (iset >= utf8KernelLevels[kernel]) {
+            utf16_length_func_t length_func = utf16_length_entry(kernel);
+            if (length_func != nullptr) {
+                utf16LengthDispatch.store(length_func, std::memory_order_release);
+                return length_func;
+            }
+        }
+    }
+
+    utf16LengthDispatch.store(utf16_length_kernel_scalar, std::memory_order_release);
+    return utf16_length_kernel_scalar;
+}
+
+static size_t utf16_length_resolve(const char * src, size_t len)
+{
+    utf16_length_func_t length_func = utf16_length_select();
+    return length_func(src, len);
+}
+
+size_t utf16_length_from_utf8(const char * src, size_t len)
+{
+    utf16_length_func_t length_func = utf16LengthDispatch.load(std::memory_order_acquire);
+    return length_func(src, len);
+}
+
+static size_t utf8_count_kernel_scalar(const char * src, size_t len)
+{
+    return utf8::count_code_points_scalar(src, len);
+}
+
+static void utf8_histogram_kernel_scalar(const char * src, size_t len, size_t histogram[4])
+{
+    utf8::utf8_seq_histogram_scalar(src, len, histogram);
+}
+
+static size_t utf8_count_resolve(const char * src, size_t len);
+static void utf8_histogram_resolve(const char * src, size_t len, size_t histogram[4]);
+
+// Initially point to the resolvers, same as utf8DecodeDispatch.
+static std::atomic<utf8_count_func_t> utf8CountDispatch(utf8_count_resolve);
+static std::atomic<utf8_histogram_func_t> utf8HistogramDispatch(utf8_histogram_resolve);
+
+static utf8_count_func_t utf8_count_entry(int kernel)
+{
+    switch (kernel) {
+        case UTF8_KERNEL_SCALAR:
+            return utf8_count_kernel_scalar;
+        case UTF8_KERNEL_SSE2:
+            return utf8_count_entry_sse2();
+        case UTF8_KERNEL_AVX2:
+            return utf8_count_entry_avx2();
+        default:
+            return nullptr;
+    }
+}
+
+static utf8_histogram_func_t utf8_histogram_entry(int kernel)
+{
+    switch (kernel) {
+        case UTF8_KERNEL_SCALAR:
+            return utf8_histogram_kernel_scalar;
+        case UTF8_KERNEL_SSE2:
+            return utf8_histogram_entry_sse2();
+        case UTF8_KERNEL_AVX2:
+            return utf8_histogram_entry_avx2();
+        default:
+            return nullptr;
+    }
+}
+
+static void utf8_count_select(void)
+{
+    int iset = InstructionSet();
+    utf8_count_func_t count_func = utf8_count_kernel_scalar;
+    utf8_histogram_func_t histogram_func = utf8_histogram_kernel_scalar;
+
+    // The counter and the histogram kernels always come in pairs.
+    for (int kernel = UTF8_KERNEL_MAX - 1; kernel >= UTF8_KERNEL_SCALAR; kernel--) {
+        if (iset >= utf8KernelLevels[kernel]) {
+            utf8_count_func_t count_entry = utf8_count_entry(kernel);
+            utf8_histogram_func_t histogram_entry = utf8_histogram_entry(kernel);
+            if (count_entry != nullptr && histogram_entry != nullptr) {
+                count_func = count_entry;
+                histogram_func = histogram_entry;
+                break;
+            }
+        }
+    }
+
+    utf8CountDispatch.store(count_func, std::memory_order_release);
+    utf8HistogramDispatch.store(histogram_func, std::memory_order_release);
+}
+
+static size_t utf8_count_resolve(const char * src, size_t len)
+{
+    utf8_count_select();
+    return count_code_points(src, len);
+}
+
+static void utf8_histogram_resolve(const char * src, size_t len, size_t histogram[4])
+{
+    utf8_count_select();
+    utf8_histogram_func_t histogram_func = utf8HistogramDispatch.load(std::memory_order_acquire);
+    histogram_func(src, len, histogram);
+}
+
+size_t count_code_points(const char * src, size_t len)
+{
+    utf8_count_func_t count_func = utf8CountDispatch.load(std::memory_order_acquire);
+    return count_func(src, len);
+}
+
+void utf8_seq_histogram(const char * src, size_t len, size_t histogram[4])
+{
+    histogram[0] = 0;
+    histogram[1] = 0;
+    histogram[2] = 0;
+    histogram[3] = 0;
+    utf8_histogram_func_t histogram_func = utf8HistogramDispatch.load(std::memory_order_acquire);
+    histogram_func(src, len, histogram);
+}
+
+bool utf8_code_points_within(const char * src, size_t len, size_t max_code_points)
+{
+    // A code point is 1 to 4 bytes.
+    if (len <= max_code_points)
+        return true;
+    if ((len / 4) > max_code_points)
+        return false;
+    return (count_code_points(src, len) <= max_code_points);
+}
+
+static bool utf8_validate_kernel_scalar(const char * src, size_t len)
+{
+    return utf8::utf8_validate_scalar(src, len);
+}
+
+static bool utf8_validate_resolve(const char * src, size_t len);
+
+// Initially points to the resolver, same as utf8DecodeDispatch.
+static std::atomic<utf8_validate_func_t> utf8ValidateDispatch(utf8_validate_resolve);
+
+static utf8_validate_func_t utf8_validate_entry(int kernel)
+{
+    switch (kernel) {
+        case UTF8_KERNEL_SCALAR:
+            return utf8_validate_kernel_scalar;
+        case UTF8_KERNEL_SSE41:
+            return utf8_validate_entry_sse41();
+        case UTF8_KERNEL_AVX2:
+            return utf8_validate_entry_avx2();
+        case UTF8_KERNEL_AVX512:
+            return utf8_validate_entry_avx512();
+        default:
+            return nullptr;
+    }
+}
+
+static utf8_validate_func_t utf8_validate_select(void)
+{
+    int iset = InstructionSet();
+    for (int kernel = UTF8_KERNEL_MAX - 1; kernel >= UTF8_KERNEL_SCALAR; kernel--) {
+        if (iset >= utf8KernelLevels[kernel]) {
+            utf8_validate_func_t validate_func = utf8_validate_entry(kernel);
+            if (validate_func != nullptr) {
+                utf8ValidateDispatch.store(validate_func, std::memory_order_release);
+                return validate_func;
+            }
+        }
+    }
+
+    utf8ValidateDispatch.store(utf8_validate_kernel_scalar, std::memory_order_release);
+    return utf8_validate_kernel_scalar;
+}
+
+static bool utf8_validate_resolve(const char * src, size_t len)
+{
+    utf8_validate_func_t validate_func = utf8_validate_select();
+    return validate_func(src, len);
+}
+
+bool utf8_validate_dispatch(const char * src, size_t len)
+{
+    utf8_validate_func_t validate_func = utf8ValidateDispatch.load(std::memory_order_acquire);
+    return validate_func(src, len);
+}
+
+static size_t fromutf8_decode_valid_kernel_scalar(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    (void)src;
+    (void)len;
+    (void)dest;
+    *consumed = 0;
+    return 0;
+}
+
+static size_t latin1_encode_kernel_scalar(const char * src, size_t len, char * dest)
+{
+    return utf8::latin1_to_utf8_scalar(src, len, dest);
+}
+
+static size_t latin1_decode_kernel_scalar(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    return utf8::utf8_to_latin1_scalar(src, len, dest, consumed);
+}
+
+static size_t fromutf8_decode_resolve(const char * src, size_t len, uint16_t * dest);
+static size_t fromutf8_decode_valid_resolve(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+static size_t fromutf8_decode_wellformed_resolve(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+static size_t latin1_encode_resolve(const char * src, size_t len, char * dest);
+static size_t latin1_decode_resolve(const char * src, size_t len, char * dest, size_t * consumed);
+
+// Initially point to the resolvers, same as utf8DecodeDispatch.
+static std::atomic<utf8_decode_func_t> fromutf8DecodeDispatch(fromutf8_decode_resolve);
+static std::atomic<utf8_decode_valid_func_t> fromutf8DecodeValidDispatch(fromutf8_decode_valid_resolve);
+static std::atomic<utf8_decode_valid_func_t> fromutf8DecodeWellformedDispatch(fromutf8_decode_wellformed_resolve);
+static std::atomic<latin1_encode_func_t> latin1EncodeDispatch(latin1_encode_resolve);
+static std::atomic<latin1_decode_func_t> latin1DecodeDispatch(latin1_decode_resolve);
+
+//
+// The five kernels only exist for SSE4.1, they are selected together.
+//
+static void fromutf8_select(void)
+{
+    utf8_decode_func_t decode_func = utf8_decode_kernel_scalar;
+    utf8_decode_valid_func_t decode_valid_func = fromutf8_decode_valid_kernel_scalar;
+    utf8_decode_valid_func_t decode_wellformed_func = fromutf8_decode_valid_kernel_scalar;
+    latin1_encode_func_t encode_latin1_func = latin1_encode_kernel_scalar;
+    latin1_decode_func_t decode_latin1_func = latin1_decode_kernel_scalar;
+
+    if (InstructionSet() >= utf8KernelLevels[UTF8_KERNEL_SSE41] &&
+        fromutf8_decode_entry_sse41() != nullptr) {
+        decode_func = fromutf8_decode_entry_sse41();
+        decode_valid_func = fromutf8_decode_valid_entry_sse41();
+        decode_wellformed_func = fromutf8_decode_wellformed_entry_sse41();
+        encode_latin1_func = latin1_encode_entry_sse41();
+        decode_latin1_func = latin1_decode_entry_sse41();
+    }
+
+    fromutf8DecodeDispatch.store(decode_func, std::memory_order_release);
+    fromutf8DecodeValidDispatch.store(decode_valid_func, std::memory_order_release);
+    fromutf8DecodeWellformedDispatch.store(decode_wellformed_func, std::memory_order_release);
+    latin1EncodeDispatch.store(encode_latin1_func, std::memory_order_release);
+    latin1DecodeDispatch.store(decode_latin1_func, std::memory_order_release);
+}
+
+static size_t fromutf8_decode_resolve(const char * src, size_t len, uint16_t * dest)
+{
+    fromutf8_select();
+    return fromutf8_decode_dispatch(src, len, dest);
+}
+
+static size_t fromutf8_decode_valid_resolve(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    fromutf8_select();
+    return fromutf8_decode_valid_dispatch(src, len, dest, consumed);
+}
+
+static size_t fromutf8_decode_wellformed_resolve(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    fromutf8_select();
+    return fromutf8_decode_wellformed_dispatch(src, len, dest, consumed);
+}
+
+static size_t latin1_encode_resolve(const char * src, size_t len, char * dest)
+{
+    fromutf8_select();
+    return latin1_encode_dispatch(src, len, dest);
+}
+
+static size_t latin1_decode_resolve(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    fromutf8_select();
+    return latin1_decode_dispatch(src, len, dest, consumed);
+}
+
+size_t fromutf8_decode_dispatch(const char * src, size_t len, uint16_t * dest)
+{
+    utf8_decode_func_t decode_func = fromutf8DecodeDispatch.load(std::memory_order_acquire);
+    return decode_func(src, len, dest);
+}
+
+size_t fromutf8_decode_valid_dispatch(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    utf8_decode_valid_func_t decode_valid_func = fromutf8DecodeValidDispatch.load(std::memory_order_acquire);
+    return decode_valid_func(src, len, dest, consumed);
+}
+
+size_t fromutf8_decode_wellformed_dispatch(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    utf8_decode_valid_func_t decode_valid_func = fromutf8DecodeWellformedDispatch.load(std::memory_order_acquire);
+    return decode_valid_func(src, len, dest, consumed);
+}
+
+size_t latin1_encode_dispatch(const char * src, size_t len, char * dest)
+{
+    latin1_encode_func_t encode_func = latin1EncodeDispatch.load(std::memory_order_acquire);
+    return encode_func(src, len, dest);
+}
+
+size_t latin1_decode_dispatch(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    latin1_decode_func_t decode_func = latin1DecodeDispatch.load(std::memory_order_acquire);
+    return decode_func(src, len, dest, consumed);
+}
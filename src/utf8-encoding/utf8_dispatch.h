@@ -0,0 +1,174 @@
+#ifndef UTF8_DISPATCH_H
+#define UTF8_DISPATCH_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//
+// Runtime CPU dispatch of the UTF-8 to UTF-16 decoders.
+//
+// Every SIMD kernel is compiled in its own translation unit with its own
+// instruction set flags, so the library can be built without -march=native.
+// The kernel is selected by InstructionSet() at the first call, and the
+// function pointer is resolved only once, like utf8Dispatch in the asm code.
+//
+// All the kernels decode all the whole characters, an incomplete character at
+// the end is not decoded, so the result doesn't depend on the CPU.
+//
+// The input must be valid UTF-8, check it by utf8::validate() (utf8_validate.h)
+// first. The kernels don't check it, and the SIMD ones may write beyond the
+// dest on the invalid input. The dest must have room for the units counted by
+// utf16_length_from_utf8() and 16 units more ((len + 16) is always enough):
+//
+//   scalar, AVX-512        nothing is written beyond the output.
+//   SSE2, SSE4.1, AVX2     a block of 16 code units is stored beyond the output.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef size_t (*utf8_decode_func_t)(const char * src, size_t len, uint16_t * dest);
+
+enum utf8_kernel_t {
+    UTF8_KERNEL_SCALAR = 0,
+    UTF8_KERNEL_SSE2,
+    UTF8_KERNEL_SSE41,
+    UTF8_KERNEL_AVX2,
+    UTF8_KERNEL_AVX512,
+    UTF8_KERNEL_MAX
+};
+
+// Decode with the best kernel of the running CPU.
+size_t utf8_decode_dispatch(const char * src, size_t len, uint16_t * dest);
+
+// Same as utf8_decode_dispatch(), *consumed is the bytes decoded, only the
+// character cut by the end (1 ~ 3 bytes) is left, e.g. to the next chunk.
+size_t utf8_decode_partial_dispatch(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+
+// The selected kernel (UTF8_KERNEL_xxxx) and its name, select it if not yet.
+int utf8_decode_kernel(void);
+const char * utf8_kernel_name(int kernel);
+
+// Returns the entry of a kernel, or NULL if it's not compiled in or not supported by the CPU.
+utf8_decode_func_t utf8_decode_get_kernel(int kernel);
+
+// The entries of the kernels, NULL if the kernel is not compiled in.
+// They are defined in utf8_dispatch_xxxx.cc and don't check the CPU.
+utf8_decode_func_t utf8_decode_entry_sse2(void);
+utf8_decode_func_t utf8_decode_entry_sse41(void);
+utf8_decode_func_t utf8_decode_entry_avx2(void);
+utf8_decode_func_t utf8_decode_entry_avx512(void);
+
+//
+// Runtime CPU dispatch of the UTF-16 to UTF-8 encoders, the same way.
+//
+// Unlike the decoders, all the kernels encode the whole buffer, the dest
+// must have room for (len * 3 + 8) bytes. Only the scalar, SSE4.1 and AVX2
+// kernels exist, a level without its kernel falls back to the lower one.
+//
+
+typedef size_t (*utf16_encode_func_t)(const uint16_t * src, size_t len, char * dest);
+
+// Encode with the best kernel of the running CPU, returns the bytes written.
+size_t utf16_to_utf8(const uint16_t * src, size_t len, char * dest);
+
+// The selected encoder kernel (UTF8_KERNEL_xxxx), select it if not yet.
+int utf16_encode_kernel(void);
+
+// Returns the encoder entry of a kernel, or NULL if it's not compiled in or not supported by the CPU.
+utf16_encode_func_t utf16_encode_get_kernel(int kernel);
+
+utf16_encode_func_t utf16_encode_entry_sse41(void);
+utf16_encode_func_t utf16_encode_entry_avx2(void);
+
+//
+// The UTF-16 code units of a UTF-8 buffer, counted without decoding, to
+// allocate the output of the decoders (and the block they store beyond it).
+// The input is not validated, the count is exact for the valid input only,
+// which the decoders need anyway, check it by utf8::validate() first. The SSE2
+// and AVX2 kernels are selected the same way, they count at the memory bandwidth.
+//
+
+typedef size_t (*utf16_length_func_t)(const char * src, size_t len);
+
+size_t utf16_length_from_utf8(const char * src, size_t len);
+
+utf16_length_func_t utf16_length_entry_sse2(void);
+utf16_length_func_t utf16_length_entry_avx2(void);
+
+//
+// The code points of a UTF-8 buffer, and its sequences counted by their length
+// (histogram[n - 1] is set to the n bytes sequences), in one pass without
+// decoding, e.g. for the quota of the title length. The input is not validated.
+// The SSE2 and AVX2 kernels count the masks of 64 bytes by popcnt.
+//
+
+typedef size_t (*utf8_count_func_t)(const char * src, size_t len);
+typedef void (*utf8_histogram_func_t)(const char * src, size_t len, size_t histogram[4]);
+
+size_t count_code_points(const char * src, size_t len);
+void utf8_seq_histogram(const char * src, size_t len, size_t histogram[4]);
+
+// Returns true if the buffer has no more than max_code_points code points,
+// the short and the long buffers are decided by the length only.
+bool utf8_code_points_within(const char * src, size_t len, size_t max_code_points);
+
+utf8_count_func_t utf8_count_entry_sse2(void);
+utf8_count_func_t utf8_count_entry_avx2(void);
+utf8_histogram_func_t utf8_histogram_entry_sse2(void);
+utf8_histogram_func_t utf8_histogram_entry_avx2(void);
+
+//
+// UTF-8 validation (see utf8_validate.h), selected the same way, utf8::validate()
+// calls utf8_validate_dispatch(). The SSE4.1, AVX2 and AVX-512 kernels exist,
+// the AVX-512 one is selected at the same level as the AVX-512 decoder.
+//
+
+typedef bool (*utf8_validate_func_t)(const char * src, size_t len);
+
+bool utf8_validate_dispatch(const char * src, size_t len);
+
+utf8_validate_func_t utf8_validate_entry_sse41(void);
+utf8_validate_func_t utf8_validate_entry_avx2(void);
+utf8_validate_func_t utf8_validate_entry_avx512(void);
+
+//
+// The SSE4.1 kernels of fromutf8-sse.cc (fromutf8-sse-kernel.h) and of the
+// Latin-1 converters (utf8_latin1_sse.h), selected the same way, so the public
+// functions of fromutf8-sse.h are compiled with the default flags. Without
+// SSE4.1, each one falls back to its scalar version.
+//
+// fromutf8_decode_valid_dispatch() decodes the blocks before the block of the
+// first invalid sequence (the noncharacters are invalid), *consumed is the
+// bytes decoded, the rest is left to the caller. The scalar version decodes
+// nothing. fromutf8_decode_wellformed_dispatch() is the same, except the
+// noncharacters are valid, the policy of fromUtf8().
+//
+
+typedef size_t (*utf8_decode_valid_func_t)(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+typedef size_t (*latin1_encode_func_t)(const char * src, size_t len, char * dest);
+typedef size_t (*latin1_decode_func_t)(const char * src, size_t len, char * dest, size_t * consumed);
+
+size_t fromutf8_decode_dispatch(const char * src, size_t len, uint16_t * dest);
+size_t fromutf8_decode_valid_dispatch(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+size_t fromutf8_decode_wellformed_dispatch(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+size_t latin1_encode_dispatch(const char * src, size_t len, char * dest);
+size_t latin1_decode_dispatch(const char * src, size_t len, char * dest, size_t * consumed);
+
+utf8_decode_func_t fromutf8_decode_entry_sse41(void);
+utf8_decode_valid_func_t fromutf8_decode_valid_entry_sse41(void);
+utf8_decode_valid_func_t fromutf8_decode_wellformed_entry_sse41(void);
+latin1_encode_func_t latin1_encode_entry_sse41(void);
+latin1_decode_func_t latin1_decode_entry_sse41(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTF8_DISPATCH_H
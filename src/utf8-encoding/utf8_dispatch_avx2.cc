@@ -0,0 +1,112 @@
+//
+// Compiled with -mavx2, see CMakeLists.txt
+//
+
+#include "utf8-encoding/utf8_decode_avx2.h"
+#include "utf8-encoding/utf8_encode_avx2.h"
+#include "utf8-encoding/utf8_validate.h"
+#include "utf8-encoding/utf8_dispatch.h"
+
+#if defined(__AVX2__)
+
+static size_t utf8_decode_kernel_avx2(const char * src, size_t len, uint16_t * dest)
+{
+    return utf8::utf8_decode_avx2(src, len, dest);
+}
+
+#endif // __AVX2__
+
+utf8_decode_func_t utf8_decode_entry_avx2(void)
+{
+#if defined(__AVX2__)
+    return utf8_decode_kernel_avx2;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__AVX2__)
+
+static size_t utf16_encode_kernel_avx2(const uint16_t * src, size_t len, char * dest)
+{
+    return utf8::utf16_to_utf8_avx2(src, len, dest);
+}
+
+#endif // __AVX2__
+
+utf16_encode_func_t utf16_encode_entry_avx2(void)
+{
+#if defined(__AVX2__)
+    return utf16_encode_kernel_avx2;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__AVX2__)
+
+static size_t utf16_length_kernel_avx2(const char * src, size_t len)
+{
+    return utf8::utf16_length_from_utf8_avx2(src, len);
+}
+
+#endif // __AVX2__
+
+utf16_length_func_t utf16_length_entry_avx2(void)
+{
+#if defined(__AVX2__)
+    return utf16_length_kernel_avx2;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__AVX2__)
+
+static size_t utf8_count_kernel_avx2(const char * src, size_t len)
+{
+    return utf8::count_code_points_avx2(src, len);
+}
+
+static void utf8_histogram_kernel_avx2(const char * src, size_t len, size_t histogram[4])
+{
+    utf8::utf8_seq_histogram_avx2(src, len, histogram);
+}
+
+#endif // __AVX2__
+
+utf8_count_func_t utf8_count_entry_avx2(void)
+{
+#if defined(__AVX2__)
+    return utf8_count_kernel_avx2;
+#else
+    return nullptr;
+#endif
+}
+
+utf8_histogram_func_t utf8_histogram_entry_avx2(void)
+{
+#if defined(__AVX2__)
+    return utf8_histogram_kernel_avx2;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__AVX2__)
+
+static bool utf8_validate_kernel_avx2(const char * src, size_t len)
+{
+    return utf8::utf8_validate_avx2(src, len);
+}
+
+#endif // __AVX2__
+
+utf8_validate_func_t utf8_validate_entry_avx2(void)
+{
+#if defined(__AVX2__)
+    return utf8_validate_kernel_avx2;
+#else
+    return nullptr;
+#endif
+}
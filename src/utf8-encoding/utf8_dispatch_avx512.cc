@@ -0,0 +1,43 @@
+//
+// Compiled with -mavx512bw -mavx512vbmi -mavx512vbmi2, see CMakeLists.txt
+//
+
+#include "utf8-encoding/utf8_decode_avx512.h"
+#include "utf8-encoding/utf8_validate.h"
+#include "utf8-encoding/utf8_dispatch.h"
+
+#if UTF8_HAVE_AVX512_VBMI2
+
+static size_t utf8_decode_kernel_avx512(const char * src, size_t len, uint16_t * dest)
+{
+    return utf8::utf8_decode_avx512(src, len, dest);
+}
+
+#endif // UTF8_HAVE_AVX512_VBMI2
+
+utf8_decode_func_t utf8_decode_entry_avx512(void)
+{
+#if UTF8_HAVE_AVX512_VBMI2
+    return utf8_decode_kernel_avx512;
+#else
+    return nullptr;
+#endif
+}
+
+#if UTF8_HAVE_AVX512_BW
+
+static bool utf8_validate_kernel_avx512(const char * src, size_t len)
+{
+    return utf8::utf8_validate_avx512(src, len);
+}
+
+#endif // UTF8_HAVE_AVX512_BW
+
+utf8_validate_func_t utf8_validate_entry_avx512(void)
+{
+#if UTF8_HAVE_AVX512_BW
+    return utf8_validate_kernel_avx512;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,74 @@
+//
+// Compiled with -msse2, see CMakeLists.txt
+//
+
+#include "utf8-encoding/utf8_decode_sse2.h"
+#include "utf8-encoding/utf8_dispatch.h"
+
+#if UTF8_HAVE_SSE2
+
+static size_t utf8_decode_kernel_sse2(const char * src, size_t len, uint16_t * dest)
+{
+    return utf8::utf8_decode_sse2(src, len, dest);
+}
+
+#endif // UTF8_HAVE_SSE2
+
+utf8_decode_func_t utf8_decode_entry_sse2(void)
+{
+#if UTF8_HAVE_SSE2
+    return utf8_decode_kernel_sse2;
+#else
+    return nullptr;
+#endif
+}
+
+#if UTF8_HAVE_SSE2
+
+static size_t utf16_length_kernel_sse2(const char * src, size_t len)
+{
+    return utf8::utf16_length_from_utf8_sse(src, len);
+}
+
+#endif // UTF8_HAVE_SSE2
+
+utf16_length_func_t utf16_length_entry_sse2(void)
+{
+#if UTF8_HAVE_SSE2
+    return utf16_length_kernel_sse2;
+#else
+    return nullptr;
+#endif
+}
+
+#if UTF8_HAVE_SSE2
+
+static size_t utf8_count_kernel_sse2(const char * src, size_t len)
+{
+    return utf8::count_code_points_sse(src, len);
+}
+
+static void utf8_histogram_kernel_sse2(const char * src, size_t len, size_t histogram[4])
+{
+    utf8::utf8_seq_histogram_sse(src, len, histogram);
+}
+
+#endif // UTF8_HAVE_SSE2
+
+utf8_count_func_t utf8_count_entry_sse2(void)
+{
+#if UTF8_HAVE_SSE2
+    return utf8_count_kernel_sse2;
+#else
+    return nullptr;
+#endif
+}
+
+utf8_histogram_func_t utf8_histogram_entry_sse2(void)
+{
+#if UTF8_HAVE_SSE2
+    return utf8_histogram_kernel_sse2;
+#else
+    return nullptr;
+#endif
+}
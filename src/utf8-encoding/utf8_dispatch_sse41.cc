@@ -0,0 +1,147 @@
+//
+// Compiled with -msse4.1, see CMakeLists.txt
+//
+
+#include "utf8-encoding/utf8_decode_sse.h"
+#include "utf8-encoding/utf8_encode_sse.h"
+#include "utf8-encoding/utf8_latin1_sse.h"
+#include "utf8-encoding/utf8_validate.h"
+#include "utf8-encoding/fromutf8-sse-kernel.h"
+#include "utf8-encoding/utf8_dispatch.h"
+
+#if defined(__SSE4_1__)
+
+static size_t utf8_decode_kernel_sse41(const char * src, size_t len, uint16_t * dest)
+{
+    return utf8::utf8_decode_sse(src, len, dest);
+}
+
+#endif // __SSE4_1__
+
+utf8_decode_func_t utf8_decode_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return utf8_decode_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__SSE4_1__)
+
+static size_t utf16_encode_kernel_sse41(const uint16_t * src, size_t len, char * dest)
+{
+    return utf8::utf16_to_utf8_sse(src, len, dest);
+}
+
+#endif // __SSE4_1__
+
+utf16_encode_func_t utf16_encode_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return utf16_encode_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__SSE4_1__)
+
+static size_t fromutf8_decode_kernel_sse41(const char * src, size_t len, uint16_t * dest)
+{
+    __m128i error = _mm_setzero_si128();
+    return fromUtf8_sse_impl<false>(src, len, dest, error);
+}
+
+static size_t fromutf8_decode_valid_kernel_sse41(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    const char * cur = src;
+    __m128i error = _mm_setzero_si128();
+    size_t dest_len = fromUtf8_sse_impl<true>(cur, len, dest, error);
+    *consumed = (size_t)(cur - src);
+    return dest_len;
+}
+
+static size_t fromutf8_decode_wellformed_kernel_sse41(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    const char * cur = src;
+    __m128i error = _mm_setzero_si128();
+    size_t dest_len = fromUtf8_sse_impl<true, true>(cur, len, dest, error);
+    *consumed = (size_t)(cur - src);
+    return dest_len;
+}
+
+static size_t latin1_encode_kernel_sse41(const char * src, size_t len, char * dest)
+{
+    return utf8::latin1_to_utf8_sse(src, len, dest);
+}
+
+static size_t latin1_decode_kernel_sse41(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    return utf8::utf8_to_latin1_sse(src, len, dest, consumed);
+}
+
+#endif // __SSE4_1__
+
+utf8_decode_func_t fromutf8_decode_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return fromutf8_decode_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+utf8_decode_valid_func_t fromutf8_decode_valid_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return fromutf8_decode_valid_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+utf8_decode_valid_func_t fromutf8_decode_wellformed_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return fromutf8_decode_wellformed_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+latin1_encode_func_t latin1_encode_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return latin1_encode_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+latin1_decode_func_t latin1_decode_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return latin1_decode_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
+
+#if defined(__SSE4_1__)
+
+static bool utf8_validate_kernel_sse41(const char * src, size_t len)
+{
+    return utf8::utf8_validate_sse41(src, len);
+}
+
+#endif // __SSE4_1__
+
+utf8_validate_func_t utf8_validate_entry_sse41(void)
+{
+#if defined(__SSE4_1__)
+    return utf8_validate_kernel_sse41;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,149 @@
+#ifndef UTF8_ENCODE_AVX2_H
+#define UTF8_ENCODE_AVX2_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "utf8-encoding/utf8_encode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__AVX2__)
+
+//
+// Encode 16 code units below 0x800 (1 or 2 bytes), see utf16_to_utf8_sse_mb2().
+//
+static inline
+uint32_t utf16_to_utf8_avx2_mb2(__m256i units, char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    __m256i mb2_mask = _mm256_cmpgt_epi16(units, _mm256_set1_epi16(0x007F));
+
+    __m256i lead = _mm256_or_si256(_mm256_srli_epi16(units, 6), _mm256_set1_epi16(0x00C0));
+    __m256i body = _mm256_or_si256(_mm256_and_si256(units, _mm256_set1_epi16(0x003F)), _mm256_set1_epi16(0x0080));
+    __m256i mb2  = _mm256_or_si256(lead, _mm256_slli_epi16(body, 8));
+
+    __m256i bytes = _mm256_blendv_epi8(units, mb2, mb2_mask);
+    __m256i keep  = _mm256_or_si256(_mm256_set1_epi16(0x00FF),
+                                    _mm256_and_si256(mb2_mask, _mm256_set1_epi16((short)0xFF00)));
+    uint32_t keep_bytes = (uint32_t)_mm256_movemask_epi8(keep);
+
+    uint32_t len = utf16_to_utf8_sse_pack(_mm256_castsi256_si128(bytes), keep_bytes, dest, pack_table);
+    len += utf16_to_utf8_sse_pack(_mm256_extracti128_si256(bytes, 1), keep_bytes >> 16, dest + len, pack_table);
+    return len;
+}
+
+//
+// Encode 8 code units (1, 2 or 3 bytes, no surrogate), see utf16_to_utf8_sse_mb3().
+//
+static inline
+uint32_t utf16_to_utf8_avx2_mb3(__m256i units, char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    const __m256i mask_3F   = _mm256_set1_epi32(0x0000003F);
+    const __m256i body_mark = _mm256_set1_epi32(0x00000080);
+
+    __m256i mb2_mask = _mm256_cmpgt_epi32(units, _mm256_set1_epi32(0x0000007F));
+    __m256i mb3_mask = _mm256_cmpgt_epi32(units, _mm256_set1_epi32(0x000007FF));
+
+    __m256i body_x = _mm256_or_si256(_mm256_and_si256(units, mask_3F), body_mark);
+    __m256i body_y = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(units, 6), mask_3F), body_mark);
+
+    __m256i mb2 = _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi32(units, 6), _mm256_set1_epi32(0x000000C0)),
+                                  _mm256_slli_epi32(body_x, 8));
+    __m256i mb3 = _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi32(units, 12), _mm256_set1_epi32(0x000000E0)),
+                                  _mm256_or_si256(_mm256_slli_epi32(body_y, 8), _mm256_slli_epi32(body_x, 16)));
+
+    __m256i bytes = _mm256_blendv_epi8(units, mb2, mb2_mask);
+    bytes = _mm256_blendv_epi8(bytes, mb3, mb3_mask);
+
+    __m256i keep = _mm256_or_si256(_mm256_set1_epi32(0x000000FF),
+                   _mm256_or_si256(_mm256_and_si256(mb2_mask, _mm256_set1_epi32(0x0000FF00)),
+                                   _mm256_and_si256(mb3_mask, _mm256_set1_epi32(0x00FF0000))));
+    uint32_t keep_bytes = (uint32_t)_mm256_movemask_epi8(keep);
+
+    uint32_t len = utf16_to_utf8_sse_pack(_mm256_castsi256_si128(bytes), keep_bytes, dest, pack_table);
+    len += utf16_to_utf8_sse_pack(_mm256_extracti128_si256(bytes, 1), keep_bytes >> 16, dest + len, pack_table);
+    return len;
+}
+
+//
+// Same as utf16_to_utf8_sse(), 16 code units per block (32 per block of ASCII),
+// the blocks with any surrogate are encoded by utf16_to_utf8_sse_block().
+//
+// Returns the bytes written, the dest must have room for (len * 3 + 8) bytes.
+//
+static inline
+size_t utf16_to_utf8_avx2(const uint16_t * src, size_t len, char * dest)
+{
+    const uint16_t * end = src + len;
+    const char * dest_first = dest;
+    const utf8_pack_u8_table_t & pack_table = utf8_pack_u8_table();
+
+    while ((src + 16) <= end) {
+        __m256i units = _mm256_loadu_si256((const __m256i *)src);
+
+        // The pure ASCII, 32 code units
+        if ((src + 32) <= end) {
+            __m256i units1 = _mm256_loadu_si256((const __m256i *)(src + 16));
+            if (_mm256_testz_si256(_mm256_or_si256(units, units1), _mm256_set1_epi16((short)0xFF80))) {
+                __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(units, units1), 0xD8);
+                _mm256_storeu_si256((__m256i *)dest, bytes);
+                src  += 32;
+                dest += 32;
+                continue;
+            }
+        }
+
+        // 0xD800 ~ 0xDFFF
+        __m256i surrogate_mask = _mm256_cmpeq_epi16(_mm256_and_si256(units, _mm256_set1_epi16((short)0xF800)),
+                                                     _mm256_set1_epi16((short)0xD800));
+        if (_mm256_movemask_epi8(surrogate_mask) != 0) {
+            uint32_t src_advance;
+            dest += utf16_to_utf8_sse_block(src, end, dest, &src_advance, pack_table);
+            src  += src_advance;
+            continue;
+        }
+
+        if (_mm256_testz_si256(units, _mm256_set1_epi16((short)0xF800))) {
+            dest += utf16_to_utf8_avx2_mb2(units, dest, pack_table);
+        } else {
+            dest += utf16_to_utf8_avx2_mb3(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(units)), dest, pack_table);
+            dest += utf16_to_utf8_avx2_mb3(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(units, 1)), dest, pack_table);
+        }
+        src += 16;
+    }
+
+    while ((src + 8) <= end) {
+        uint32_t src_advance;
+        dest += utf16_to_utf8_sse_block(src, end, dest, &src_advance, pack_table);
+        src  += src_advance;
+    }
+
+    dest += utf16_to_utf8_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+#endif // __AVX2__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_ENCODE_AVX2_H
@@ -0,0 +1,300 @@
+#ifndef UTF8_ENCODE_SSE_H
+#define UTF8_ENCODE_SSE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_decode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__SSE4_1__)
+
+//
+// The shuffle masks to pack the selected bytes of 8 to the front, indexed by
+// the 8 bits mask of the bytes to keep, and the count of them.
+//
+struct utf8_pack_u8_table_t {
+    uint8_t shuffle[256][16];
+    uint8_t length[256];
+};
+
+static inline
+utf8_pack_u8_table_t utf8_make_pack_u8_table()
+{
+    utf8_pack_u8_table_t table;
+    for (uint32_t keep = 0; keep < 256; keep++) {
+        uint32_t length = 0;
+        for (uint32_t i = 0; i < 8; i++) {
+            if ((keep & (1u << i)) != 0) {
+                table.shuffle[keep][length] = (uint8_t)i;
+                length++;
+            }
+        }
+        table.length[keep] = (uint8_t)length;
+        for (uint32_t i = length; i < 16; i++) {
+            table.shuffle[keep][i] = 0x80u;
+        }
+    }
+    return table;
+}
+
+static inline
+const utf8_pack_u8_table_t & utf8_pack_u8_table()
+{
+    static const utf8_pack_u8_table_t table = utf8_make_pack_u8_table();
+    return table;
+}
+
+//
+// Store the bytes selected by the 16 bits keep mask, in order, returns the
+// bytes stored. Each 8 bytes half is packed by itself and stored by an 8 bytes
+// store, so up to 8 bytes after the end may be written.
+//
+static inline
+uint32_t utf16_to_utf8_sse_pack(__m128i bytes, uint32_t keep_bytes, char * dest,
+                                const utf8_pack_u8_table_t & pack_table)
+{
+    uint32_t keep_low  = keep_bytes & 0xFFu;
+    uint32_t keep_high = (keep_bytes >> 8) & 0xFFu;
+
+    __m128i bytes_low  = _mm_shuffle_epi8(bytes,
+                                          _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep_low]));
+    __m128i bytes_high = _mm_shuffle_epi8(_mm_unpackhi_epi64(bytes, bytes),
+                                          _mm_loadu_si128((const __m128i *)pack_table.shuffle[keep_high]));
+
+    uint32_t low_len = pack_table.length[keep_low];
+    _mm_storel_epi64((__m128i *)dest,             bytes_low);
+    _mm_storel_epi64((__m128i *)(dest + low_len), bytes_high);
+
+    return low_len + pack_table.length[keep_high];
+}
+
+//
+// Encode 8 code units below 0x800 (1 or 2 bytes), one 16 bits lane per unit:
+//
+//   00000yyy yyxxxxxx  -->  110yyyyy 10xxxxxx (the lead byte is the low byte)
+//
+static inline
+uint32_t utf16_to_utf8_sse_mb2(__m128i units, char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    __m128i mb2_mask = _mm_cmpgt_epi16(units, _mm_set1_epi16(0x007F));
+
+    __m128i lead = _mm_or_si128(_mm_srli_epi16(units, 6), _mm_set1_epi16(0x00C0));
+    __m128i body = _mm_or_si128(_mm_and_si128(units, _mm_set1_epi16(0x003F)), _mm_set1_epi16(0x0080));
+    __m128i mb2  = _mm_or_si128(lead, _mm_slli_epi16(body, 8));
+
+    __m128i bytes = _mm_blendv_epi8(units, mb2, mb2_mask);
+    __m128i keep  = _mm_or_si128(_mm_set1_epi16(0x00FF), _mm_and_si128(mb2_mask, _mm_set1_epi16((short)0xFF00)));
+
+    return utf16_to_utf8_sse_pack(bytes, (uint32_t)_mm_movemask_epi8(keep), dest, pack_table);
+}
+
+//
+// Encode 4 code units (1, 2 or 3 bytes, no surrogate), one 32 bits lane per unit:
+//
+//   zzzzyyyy yyxxxxxx  -->  1110zzzz 10yyyyyy 10xxxxxx (the lead byte is the lowest byte)
+//
+static inline
+uint32_t utf16_to_utf8_sse_mb3(__m128i units, char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    const __m128i mask_3F   = _mm_set1_epi32(0x0000003F);
+    const __m128i body_mark = _mm_set1_epi32(0x00000080);
+
+    __m128i mb2_mask = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x0000007F));
+    __m128i mb3_mask = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x000007FF));
+
+    __m128i body_x = _mm_or_si128(_mm_and_si128(units, mask_3F), body_mark);
+    __m128i body_y = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(units, 6), mask_3F), body_mark);
+
+    __m128i mb2 = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(units, 6), _mm_set1_epi32(0x000000C0)),
+                               _mm_slli_epi32(body_x, 8));
+    __m128i mb3 = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(units, 12), _mm_set1_epi32(0x000000E0)),
+                               _mm_or_si128(_mm_slli_epi32(body_y, 8), _mm_slli_epi32(body_x, 16)));
+
+    __m128i bytes = _mm_blendv_epi8(units, mb2, mb2_mask);
+    bytes = _mm_blendv_epi8(bytes, mb3, mb3_mask);
+
+    __m128i keep = _mm_or_si128(_mm_set1_epi32(0x000000FF),
+                   _mm_or_si128(_mm_and_si128(mb2_mask, _mm_set1_epi32(0x0000FF00)),
+                                _mm_and_si128(mb3_mask, _mm_set1_epi32(0x00FF0000))));
+
+    return utf16_to_utf8_sse_pack(bytes, (uint32_t)_mm_movemask_epi8(keep), dest, pack_table);
+}
+
+//
+// Encode 4 code units with some surrogates, one 32 bits lane per unit, the
+// next_units are the units after them. A high surrogate followed by a low
+// surrogate (pair_high_mask) is encoded as the 4 bytes sequence, and the low
+// surrogate (pair_low_mask) is dropped, the unpaired surrogates are 3 bytes.
+//
+//   110110ww wwzzzzyy 110111yy yyxxxxxx  (uuuuu = wwww + 1)
+//
+//   -->  11110uuu 10uuzzzz 10yyyyyy 10xxxxxx (the lead byte is the lowest byte)
+//
+static inline
+uint32_t utf16_to_utf8_sse_mb4(__m128i units, __m128i next_units,
+                               __m128i pair_high_mask, __m128i pair_low_mask,
+                               char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    const __m128i mask_3F   = _mm_set1_epi32(0x0000003F);
+    const __m128i body_mark = _mm_set1_epi32(0x00000080);
+
+    __m128i mb2_mask = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x0000007F));
+    __m128i mb3_mask = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x000007FF));
+
+    __m128i body_x = _mm_or_si128(_mm_and_si128(units, mask_3F), body_mark);
+    __m128i body_y = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(units, 6), mask_3F), body_mark);
+
+    __m128i mb2 = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(units, 6), _mm_set1_epi32(0x000000C0)),
+                               _mm_slli_epi32(body_x, 8));
+    __m128i mb3 = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(units, 12), _mm_set1_epi32(0x000000E0)),
+                               _mm_or_si128(_mm_slli_epi32(body_y, 8), _mm_slli_epi32(body_x, 16)));
+
+    // ((high - 0xD800) << 10) + (low - 0xDC00) + 0x10000
+    __m128i code_point = _mm_sub_epi32(_mm_add_epi32(_mm_slli_epi32(units, 10), next_units),
+                                       _mm_set1_epi32((0xD800 << 10) + 0xDC00 - 0x10000));
+    __m128i mb4 = _mm_or_si128(_mm_srli_epi32(code_point, 18), _mm_set1_epi32(0x000000F0));
+    mb4 = _mm_or_si128(mb4, _mm_slli_epi32(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_point, 12), mask_3F),
+                                                        body_mark), 8));
+    mb4 = _mm_or_si128(mb4, _mm_slli_epi32(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_point, 6), mask_3F),
+                                                        body_mark), 16));
+    mb4 = _mm_or_si128(mb4, _mm_slli_epi32(_mm_or_si128(_mm_and_si128(code_point, mask_3F), body_mark), 24));
+
+    __m128i bytes = _mm_blendv_epi8(units, mb2, mb2_mask);
+    bytes = _mm_blendv_epi8(bytes, mb3, mb3_mask);
+    bytes = _mm_blendv_epi8(bytes, mb4, pair_high_mask);
+
+    // The surrogates are above 0x7FF, so mb2_mask and mb3_mask are set for them.
+    __m128i keep = _mm_or_si128(_mm_set1_epi32(0x000000FF),
+                   _mm_or_si128(_mm_and_si128(mb2_mask, _mm_set1_epi32(0x0000FF00)),
+                                _mm_and_si128(mb3_mask, _mm_set1_epi32(0x00FF0000))));
+    keep = _mm_or_si128(keep, _mm_and_si128(pair_high_mask, _mm_set1_epi32((int)0xFF000000)));
+    keep = _mm_andnot_si128(pair_low_mask, keep);
+
+    return utf16_to_utf8_sse_pack(bytes, (uint32_t)_mm_movemask_epi8(keep), dest, pack_table);
+}
+
+//
+// Encode 8 code units. If the last unit is the high surrogate of a pair, the
+// low surrogate after the block is encoded too. *src_advance is 8 or 9,
+// returns the bytes written.
+//
+static inline
+uint32_t utf16_to_utf8_sse_block(const uint16_t * src, const uint16_t * end, char * dest,
+                                 uint32_t * src_advance, const utf8_pack_u8_table_t & pack_table)
+{
+    __m128i units = _mm_loadu_si128((const __m128i *)src);
+
+    // 0xD800 ~ 0xDFFF
+    __m128i surrogate_mask = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short)0xF800)),
+                                             _mm_set1_epi16((short)0xD800));
+    if (_mm_movemask_epi8(surrogate_mask) != 0) {
+        // The last block, we can't read the unit after it.
+        if ((src + 9) > end) {
+            *src_advance = 8;
+            return (uint32_t)utf16_to_utf8_scalar(src, 8, dest);
+        }
+
+        __m128i next_units = _mm_loadu_si128((const __m128i *)(src + 1));
+
+        __m128i is_high = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short)0xFC00)),
+                                          _mm_set1_epi16((short)0xD800));
+        __m128i next_is_low = _mm_cmpeq_epi16(_mm_and_si128(next_units, _mm_set1_epi16((short)0xFC00)),
+                                              _mm_set1_epi16((short)0xDC00));
+        __m128i pair_high_mask = _mm_and_si128(is_high, next_is_low);
+        __m128i pair_low_mask  = _mm_slli_si128(pair_high_mask, 2);
+
+        *src_advance = 8 + ((uint32_t)_mm_movemask_epi8(pair_high_mask) >> 15);
+
+        __m128i zeros = _mm_setzero_si128();
+        uint32_t bytes = utf16_to_utf8_sse_mb4(_mm_unpacklo_epi16(units, zeros),
+                                               _mm_unpacklo_epi16(next_units, zeros),
+                                               _mm_unpacklo_epi16(pair_high_mask, pair_high_mask),
+                                               _mm_unpacklo_epi16(pair_low_mask, pair_low_mask),
+                                               dest, pack_table);
+        bytes += utf16_to_utf8_sse_mb4(_mm_unpackhi_epi16(units, zeros),
+                                       _mm_unpackhi_epi16(next_units, zeros),
+                                       _mm_unpackhi_epi16(pair_high_mask, pair_high_mask),
+                                       _mm_unpackhi_epi16(pair_low_mask, pair_low_mask),
+                                       dest + bytes, pack_table);
+        return bytes;
+    }
+
+    *src_advance = 8;
+
+    // The signed compare is not enough for the units >= 0x8000
+    __m128i above_7FF = _mm_and_si128(units, _mm_set1_epi16((short)0xF800));
+    if (_mm_testz_si128(above_7FF, above_7FF)) {
+        return utf16_to_utf8_sse_mb2(units, dest, pack_table);
+    }
+
+    __m128i zeros = _mm_setzero_si128();
+    uint32_t bytes = utf16_to_utf8_sse_mb3(_mm_unpacklo_epi16(units, zeros), dest, pack_table);
+    bytes += utf16_to_utf8_sse_mb3(_mm_unpackhi_epi16(units, zeros), dest + bytes, pack_table);
+    return bytes;
+}
+
+//
+// Encode a UTF-16 buffer to UTF-8, same as utf16_to_utf8_scalar(), 8 code units
+// per block (16 per block of ASCII), the rest is encoded by utf16_to_utf8_scalar().
+//
+// Returns the bytes written, the dest must have room for (len * 3 + 8) bytes.
+//
+static inline
+size_t utf16_to_utf8_sse(const uint16_t * src, size_t len, char * dest)
+{
+    const uint16_t * end = src + len;
+    const char * dest_first = dest;
+    const utf8_pack_u8_table_t & pack_table = utf8_pack_u8_table();
+
+    while ((src + 16) <= end) {
+        __m128i units0 = _mm_loadu_si128((const __m128i *)src);
+        __m128i units1 = _mm_loadu_si128((const __m128i *)(src + 8));
+
+        // The pure ASCII
+        __m128i non_ascii = _mm_and_si128(_mm_or_si128(units0, units1), _mm_set1_epi16((short)0xFF80));
+        if (_mm_testz_si128(non_ascii, non_ascii)) {
+            _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(units0, units1));
+            src  += 16;
+            dest += 16;
+            continue;
+        }
+
+        uint32_t src_advance;
+        dest += utf16_to_utf8_sse_block(src, end, dest, &src_advance, pack_table);
+        src  += src_advance;
+    }
+
+    while ((src + 8) <= end) {
+        uint32_t src_advance;
+        dest += utf16_to_utf8_sse_block(src, end, dest, &src_advance, pack_table);
+        src  += src_advance;
+    }
+
+    dest += utf16_to_utf8_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+#endif // __SSE4_1__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_ENCODE_SSE_H
@@ -0,0 +1,143 @@
+#ifndef UTF8_ENCODE_UTF32_AVX2_H
+#define UTF8_ENCODE_UTF32_AVX2_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "utf8-encoding/utf8_encode_avx2.h"
+#include "utf8-encoding/utf8_encode_utf32_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__AVX2__)
+
+//
+// Encode 8 code points (1 ~ 4 bytes), see utf32_to_utf8_sse_mb4().
+//
+static inline
+uint32_t utf32_to_utf8_avx2_mb4(__m256i code_points, char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    const __m256i mask_3F   = _mm256_set1_epi32(0x0000003F);
+    const __m256i body_mark = _mm256_set1_epi32(0x00000080);
+
+    __m256i mb2_mask = _mm256_cmpeq_epi32(_mm256_max_epu32(code_points, _mm256_set1_epi32(0x00000080)), code_points);
+    __m256i mb3_mask = _mm256_cmpeq_epi32(_mm256_max_epu32(code_points, _mm256_set1_epi32(0x00000800)), code_points);
+    __m256i mb4_mask = _mm256_cmpeq_epi32(_mm256_max_epu32(code_points, _mm256_set1_epi32(0x00010000)), code_points);
+
+    __m256i body_x = _mm256_or_si256(_mm256_and_si256(code_points, mask_3F), body_mark);
+    __m256i body_y = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(code_points, 6), mask_3F), body_mark);
+    __m256i body_z = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(code_points, 12), mask_3F), body_mark);
+
+    __m256i mb2 = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(code_points, 6),
+                                                                   _mm256_set1_epi32(0x0000001F)),
+                                                  _mm256_set1_epi32(0x000000C0)),
+                                  _mm256_slli_epi32(body_x, 8));
+    __m256i mb3 = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(code_points, 12),
+                                                                   _mm256_set1_epi32(0x0000000F)),
+                                                  _mm256_set1_epi32(0x000000E0)),
+                                  _mm256_or_si256(_mm256_slli_epi32(body_y, 8), _mm256_slli_epi32(body_x, 16)));
+    __m256i mb4 = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(code_points, 18),
+                                                                   _mm256_set1_epi32(0x00000007)),
+                                                  _mm256_set1_epi32(0x000000F0)),
+                                  _mm256_slli_epi32(body_z, 8));
+    mb4 = _mm256_or_si256(mb4, _mm256_or_si256(_mm256_slli_epi32(body_y, 16), _mm256_slli_epi32(body_x, 24)));
+
+    __m256i bytes = _mm256_blendv_epi8(code_points, mb2, mb2_mask);
+    bytes = _mm256_blendv_epi8(bytes, mb3, mb3_mask);
+    bytes = _mm256_blendv_epi8(bytes, mb4, mb4_mask);
+
+    __m256i keep = _mm256_or_si256(_mm256_set1_epi32(0x000000FF),
+                   _mm256_or_si256(_mm256_and_si256(mb2_mask, _mm256_set1_epi32(0x0000FF00)),
+                                   _mm256_and_si256(mb3_mask, _mm256_set1_epi32(0x00FF0000))));
+    keep = _mm256_or_si256(keep, _mm256_and_si256(mb4_mask, _mm256_set1_epi32((int)0xFF000000)));
+    uint32_t keep_bytes = (uint32_t)_mm256_movemask_epi8(keep);
+
+    uint32_t len = utf16_to_utf8_sse_pack(_mm256_castsi256_si128(bytes), keep_bytes, dest, pack_table);
+    len += utf16_to_utf8_sse_pack(_mm256_extracti128_si256(bytes, 1), keep_bytes >> 16, dest + len, pack_table);
+    return len;
+}
+
+//
+// Same as utf32_to_utf8_sse(), 8 code points per block (16 per block of 1 or 2
+// bytes, 32 per block of ASCII).
+//
+// Returns the bytes written, the dest must have room for (len * 4 + 8) bytes.
+//
+static inline
+size_t utf32_to_utf8_avx2(const uint32_t * src, size_t len, char * dest)
+{
+    const uint32_t * end = src + len;
+    const char * dest_first = dest;
+    const utf8_pack_u8_table_t & pack_table = utf8_pack_u8_table();
+
+    while ((src + 8) <= end) {
+        __m256i code_points = _mm256_loadu_si256((const __m256i *)src);
+
+        // The pure ASCII, 32 code points
+        if ((src + 32) <= end) {
+            __m256i code_points1 = _mm256_loadu_si256((const __m256i *)(src + 8));
+            __m256i code_points2 = _mm256_loadu_si256((const __m256i *)(src + 16));
+            __m256i code_points3 = _mm256_loadu_si256((const __m256i *)(src + 24));
+            __m256i whole = _mm256_or_si256(_mm256_or_si256(code_points, code_points1),
+                                            _mm256_or_si256(code_points2, code_points3));
+            if (_mm256_testz_si256(whole, _mm256_set1_epi32((int)0xFFFFFF80))) {
+                // The packs work in the 128 bit lanes, gather the dwords 0, 4, 1, 5, 2, 6, 3, 7.
+                __m256i units0 = _mm256_packus_epi32(code_points, code_points1);
+                __m256i units1 = _mm256_packus_epi32(code_points2, code_points3);
+                __m256i bytes  = _mm256_packus_epi16(units0, units1);
+                bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+                _mm256_storeu_si256((__m256i *)dest, bytes);
+                src  += 32;
+                dest += 32;
+                continue;
+            }
+        }
+
+        // 1 or 2 bytes, narrow 16 code points to the code units
+        if ((src + 16) <= end) {
+            __m256i code_points1 = _mm256_loadu_si256((const __m256i *)(src + 8));
+            if (_mm256_testz_si256(_mm256_or_si256(code_points, code_points1), _mm256_set1_epi32((int)0xFFFFF800))) {
+                __m256i units = _mm256_permute4x64_epi64(_mm256_packus_epi32(code_points, code_points1), 0xD8);
+                dest += utf16_to_utf8_avx2_mb2(units, dest, pack_table);
+                src  += 16;
+                continue;
+            }
+        }
+
+        if (_mm256_testz_si256(code_points, _mm256_set1_epi32((int)0xFFFF0000))) {
+            dest += utf16_to_utf8_avx2_mb3(code_points, dest, pack_table);
+        } else {
+            dest += utf32_to_utf8_avx2_mb4(code_points, dest, pack_table);
+        }
+        src += 8;
+    }
+
+    dest += utf32_to_utf8_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+#endif // __AVX2__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_ENCODE_UTF32_AVX2_H
@@ -0,0 +1,146 @@
+#ifndef UTF8_ENCODE_UTF32_SSE_H
+#define UTF8_ENCODE_UTF32_SSE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_encode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__SSE4_1__)
+
+//
+// Encode 4 code points (1 ~ 4 bytes), one 32 bits lane per code point:
+//
+//   000uuuzz zzzzyyyy yyxxxxxx  -->  11110uuu 10zzzzzz 10yyyyyy 10xxxxxx (the lead byte is the lowest byte)
+//
+// The lengths are compared unsigned, the bits above 21 are dropped the same as utf8_encode().
+//
+static inline
+uint32_t utf32_to_utf8_sse_mb4(__m128i code_points, char * dest, const utf8_pack_u8_table_t & pack_table)
+{
+    const __m128i mask_3F   = _mm_set1_epi32(0x0000003F);
+    const __m128i body_mark = _mm_set1_epi32(0x00000080);
+
+    __m128i mb2_mask = _mm_cmpeq_epi32(_mm_max_epu32(code_points, _mm_set1_epi32(0x00000080)), code_points);
+    __m128i mb3_mask = _mm_cmpeq_epi32(_mm_max_epu32(code_points, _mm_set1_epi32(0x00000800)), code_points);
+    __m128i mb4_mask = _mm_cmpeq_epi32(_mm_max_epu32(code_points, _mm_set1_epi32(0x00010000)), code_points);
+
+    __m128i body_x = _mm_or_si128(_mm_and_si128(code_points, mask_3F), body_mark);
+    __m128i body_y = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_points, 6), mask_3F), body_mark);
+    __m128i body_z = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_points, 12), mask_3F), body_mark);
+
+    __m128i mb2 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_points, 6), _mm_set1_epi32(0x0000001F)),
+                                            _mm_set1_epi32(0x000000C0)),
+                               _mm_slli_epi32(body_x, 8));
+    __m128i mb3 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_points, 12), _mm_set1_epi32(0x0000000F)),
+                                            _mm_set1_epi32(0x000000E0)),
+                               _mm_or_si128(_mm_slli_epi32(body_y, 8), _mm_slli_epi32(body_x, 16)));
+    __m128i mb4 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_points, 18), _mm_set1_epi32(0x00000007)),
+                                            _mm_set1_epi32(0x000000F0)),
+                               _mm_slli_epi32(body_z, 8));
+    mb4 = _mm_or_si128(mb4, _mm_or_si128(_mm_slli_epi32(body_y, 16), _mm_slli_epi32(body_x, 24)));
+
+    __m128i bytes = _mm_blendv_epi8(code_points, mb2, mb2_mask);
+    bytes = _mm_blendv_epi8(bytes, mb3, mb3_mask);
+    bytes = _mm_blendv_epi8(bytes, mb4, mb4_mask);
+
+    __m128i keep = _mm_or_si128(_mm_set1_epi32(0x000000FF),
+                   _mm_or_si128(_mm_and_si128(mb2_mask, _mm_set1_epi32(0x0000FF00)),
+                                _mm_and_si128(mb3_mask, _mm_set1_epi32(0x00FF0000))));
+    keep = _mm_or_si128(keep, _mm_and_si128(mb4_mask, _mm_set1_epi32((int)0xFF000000)));
+
+    return utf16_to_utf8_sse_pack(bytes, (uint32_t)_mm_movemask_epi8(keep), dest, pack_table);
+}
+
+//
+// Encode 8 code points, the longest of them picks the kernel, the bytes are
+// packed by the shuffles of utf16_to_utf8_sse_pack().
+//
+static inline
+uint32_t utf32_to_utf8_sse_block(__m128i code_points0, __m128i code_points1, char * dest,
+                                 const utf8_pack_u8_table_t & pack_table)
+{
+    __m128i code_points = _mm_or_si128(code_points0, code_points1);
+
+    // 1 or 2 bytes, narrow to the code units
+    if (_mm_testz_si128(code_points, _mm_set1_epi32((int)0xFFFFF800))) {
+        return utf16_to_utf8_sse_mb2(_mm_packus_epi32(code_points0, code_points1), dest, pack_table);
+    }
+
+    // 1 ~ 3 bytes
+    if (_mm_testz_si128(code_points, _mm_set1_epi32((int)0xFFFF0000))) {
+        uint32_t bytes = utf16_to_utf8_sse_mb3(code_points0, dest, pack_table);
+        bytes += utf16_to_utf8_sse_mb3(code_points1, dest + bytes, pack_table);
+        return bytes;
+    }
+
+    uint32_t bytes = utf32_to_utf8_sse_mb4(code_points0, dest, pack_table);
+    bytes += utf32_to_utf8_sse_mb4(code_points1, dest + bytes, pack_table);
+    return bytes;
+}
+
+//
+// Encode a UTF-32 buffer to UTF-8, same as utf32_to_utf8_scalar(), 8 code points
+// per block (16 per block of ASCII), the rest is encoded by utf32_to_utf8_scalar().
+//
+// Returns the bytes written, the dest must have room for (len * 4 + 8) bytes.
+//
+static inline
+size_t utf32_to_utf8_sse(const uint32_t * src, size_t len, char * dest)
+{
+    const uint32_t * end = src + len;
+    const char * dest_first = dest;
+    const utf8_pack_u8_table_t & pack_table = utf8_pack_u8_table();
+
+    while ((src + 8) <= end) {
+        __m128i code_points0 = _mm_loadu_si128((const __m128i *)(src + 0));
+        __m128i code_points1 = _mm_loadu_si128((const __m128i *)(src + 4));
+
+        // The pure ASCII, 16 code points
+        if ((src + 16) <= end) {
+            __m128i code_points2 = _mm_loadu_si128((const __m128i *)(src + 8));
+            __m128i code_points3 = _mm_loadu_si128((const __m128i *)(src + 12));
+            __m128i code_points = _mm_or_si128(_mm_or_si128(code_points0, code_points1),
+                                               _mm_or_si128(code_points2, code_points3));
+            if (_mm_testz_si128(code_points, _mm_set1_epi32((int)0xFFFFFF80))) {
+                __m128i units0 = _mm_packus_epi32(code_points0, code_points1);
+                __m128i units1 = _mm_packus_epi32(code_points2, code_points3);
+                _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(units0, units1));
+                src  += 16;
+                dest += 16;
+                continue;
+            }
+        }
+
+        dest += utf32_to_utf8_sse_block(code_points0, code_points1, dest, pack_table);
+        src  += 8;
+    }
+
+    dest += utf32_to_utf8_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+#endif // __SSE4_1__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_ENCODE_UTF32_SSE_H
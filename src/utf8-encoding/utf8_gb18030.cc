@@ -0,0 +1,441 @@
+//
+// Compiled with the default flags, the SIMD part is only SSE2, see utf8_gb18030.h
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <algorithm>
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_decode_sse.h"
+#include "utf8-encoding/utf8_gb18030.h"
+#include "utf8-encoding/utf8_gb18030_table.h"
+
+namespace utf8 {
+
+//
+// The 4 bytes sequences are numbered by the linear index:
+//
+//   (((b0 - 0x81) * 10 + (b1 - 0x30)) * 126 + (b2 - 0x81)) * 10 + (b3 - 0x30)
+//
+// [0, 39420) is BMP (0x81308130 ~ 0x8431A439), the supplementary planes start
+// from 189000 (0x90308130) one by one.
+//
+static const uint32_t kGb18030_BmpIndexes = 39420;
+static const uint32_t kGb18030_SupplementaryIndex = 189000;
+
+//
+// Copy the ASCII run at the beginning of [src, end) by 16 bytes, the whole
+// block is stored, the bytes after the run are overwritten later.
+// Returns the bytes of the run (only the whole blocks if SSE2 is missing).
+//
+static inline
+size_t gb18030_ascii_copy(const char * src, const char * end, char * dest)
+{
+    const char * first = src;
+#if UTF8_HAVE_SSE2
+    while ((src + 16) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dest, chunk);
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits != 0) {
+            src += bit_bsf32(sign_bits);
+            break;
+        }
+        src  += 16;
+        dest += 16;
+    }
+#else
+    (void)end;
+    (void)dest;
+#endif
+    return (size_t)(src - first);
+}
+
+//
+// Same as gb18030_ascii_copy(), the ASCII run is widened to UTF-16.
+//
+static inline
+size_t gb18030_ascii_widen(const char * src, const char * end, uint16_t * dest)
+{
+    const char * first = src;
+#if UTF8_HAVE_SSE2
+    __m128i zeros = _mm_setzero_si128();
+    while ((src + 16) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dest,       _mm_unpacklo_epi8(chunk, zeros));
+        _mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi8(chunk, zeros));
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits != 0) {
+            src += bit_bsf32(sign_bits);
+            break;
+        }
+        src  += 16;
+        dest += 16;
+    }
+#else
+    (void)end;
+    (void)dest;
+#endif
+    return (size_t)(src - first);
+}
+
+//
+// Decode a GB18030 sequence (not ASCII), returns its length, or 0 if it's
+// invalid, or -1 if it's cut by the end (avail bytes).
+//
+static inline
+int gb18030_decode_char(const uint8_t * src, size_t avail, uint32_t * code_point)
+{
+    uint32_t b0 = src[0];
+    if (b0 == 0x80u || b0 == 0xFFu)
+        return 0;
+    if (avail < 2)
+        return -1;
+
+    uint32_t b1 = src[1];
+    if (b1 >= 0x40u && b1 != 0x7Fu && b1 != 0xFFu) {
+        uint32_t cp = gb18030_2bytes_table[b0 - 0x81u][b1 - 0x40u];
+        if ((cp - 0xD800u) < 2048u)
+            cp = gb18030_supplementary_2bytes[cp - 0xD800u][0];
+        *code_point = cp;
+        return 2;
+    }
+
+    // 4 bytes: [81, FE] [30, 39] [81, FE] [30, 39]
+    if ((b1 - 0x30u) >= 10u)
+        return 0;
+    if (avail < 3)
+        return -1;
+    uint32_t b2 = src[2];
+    if ((b2 - 0x81u) >= 126u)
+        return 0;
+    if (avail < 4)
+        return -1;
+    uint32_t b3 = src[3];
+    if ((b3 - 0x30u) >= 10u)
+        return 0;
+
+    uint32_t index = (((b0 - 0x81u) * 10u + (b1 - 0x30u)) * 126u + (b2 - 0x81u)) * 10u + (b3 - 0x30u);
+    if (index < kGb18030_BmpIndexes) {
+        // The last range whose first index is not above the index
+        const gb18030_range_t * range = std::upper_bound(
+            gb18030_4bytes_ranges, gb18030_4bytes_ranges + GB18030_4BYTES_RANGES, index,
+            [](uint32_t value, const gb18030_range_t & r) { return value < r.index; });
+        if (range == gb18030_4bytes_ranges)
+            return 0;
+        range--;
+        if ((index - range->index) >= range->count)
+            return 0;
+        *code_point = range->code_point + (index - range->index);
+        return 4;
+    }
+
+    index -= kGb18030_SupplementaryIndex;
+    if (index >= 0x100000u)
+        return 0;
+    *code_point = 0x10000u + index;
+    return 4;
+}
+
+//
+// Encode a code point (not ASCII) to GB18030, returns the bytes written,
+// or 0 if it has no mapping.
+//
+static inline
+int gb18030_encode_char(uint32_t code_point, uint8_t * dest)
+{
+    uint32_t index;
+    if (code_point <= 0xFFFFu) {
+        uint32_t code = gb18030_encode_pages[gb18030_encode_page_index[code_point >> 8]][code_point & 0xFFu];
+        if (code != 0) {
+            dest[0] = (uint8_t)(code >> 8);
+            dest[1] = (uint8_t)(code & 0xFFu);
+            return 2;
+        }
+
+        const gb18030_range_t * range = std::upper_bound(
+            gb18030_4bytes_ranges_by_code_point, gb18030_4bytes_ranges_by_code_point + GB18030_4BYTES_RANGES,
+            code_point, [](uint32_t value, const gb18030_range_t & r) { return value < r.code_point; });
+        if (range == gb18030_4bytes_ranges_by_code_point)
+            return 0;
+        range--;
+        if ((code_point - range->code_point) >= range->count)
+            return 0;
+        index = range->index + (code_point - range->code_point);
+    } else {
+        for (uint32_t i = 0; i < GB18030_SUPPLEMENTARY_2BYTES; i++) {
+            if (gb18030_supplementary_2bytes[i][0] == code_point) {
+                uint32_t code = gb18030_supplementary_2bytes[i][1];
+                dest[0] = (uint8_t)(code >> 8);
+                dest[1] = (uint8_t)(code & 0xFFu);
+                return 2;
+            }
+        }
+        index = kGb18030_SupplementaryIndex + (code_point - 0x10000u);
+    }
+
+    dest[3] = (uint8_t)(0x30u + index % 10u);
+    index /= 10u;
+    dest[2] = (uint8_t)(0x81u + index % 126u);
+    index /= 126u;
+    dest[1] = (uint8_t)(0x30u + index % 10u);
+    dest[0] = (uint8_t)(0x81u + index / 10u);
+    return 4;
+}
+
+} // namespace utf8
+
+size_t gb18030_to_utf8(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    const char * first = src;
+    const char * end = src + len;
+    const char * dest_first = dest;
+
+    while (src < end) {
+        uint8_t ch = (uint8_t)*src;
+        if (ch < 0x80u) {
+            size_t ascii_len = utf8::gb18030_ascii_copy(src, end, dest);
+            if (ascii_len == 0) {
+                *dest++ = (char)ch;
+                ascii_len = 1;
+            } else {
+                dest += ascii_len;
+            }
+            src += ascii_len;
+            continue;
+        }
+
+        // The 2 bytes sequences to 3 bytes, most of the Chinese characters.
+        if ((src + 2) <= end) {
+            uint32_t trail = (uint8_t)src[1];
+            if ((uint32_t)(ch - 0x81u) < 126u && trail >= 0x40u && trail != 0x7Fu && trail != 0xFFu) {
+                uint32_t cp = utf8::gb18030_2bytes_table[ch - 0x81u][trail - 0x40u];
+                if (cp >= 0x0800u && (cp - 0xD800u) >= 2048u) {
+                    dest[0] = (char)((cp >> 12u) | 0xE0u);
+                    dest[1] = (char)(((cp >> 6u) & 0x3Fu) | 0x80u);
+                    dest[2] = (char)((cp & 0x3Fu) | 0x80u);
+                    src  += 2;
+                    dest += 3;
+                    continue;
+                }
+            }
+        }
+
+        uint32_t code_point;
+        int seq_len = utf8::gb18030_decode_char((const uint8_t *)src, (size_t)(end - src), &code_point);
+        if (seq_len <= 0)
+            break;
+        dest += utf8::utf8_encode(code_point, dest);
+        src  += seq_len;
+    }
+
+    *consumed = (size_t)(src - first);
+    return (size_t)(dest - dest_first);
+}
+
+size_t gb18030_to_utf16(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    const char * first = src;
+    const char * end = src + len;
+    const uint16_t * dest_first = dest;
+
+    while (src < end) {
+        uint8_t ch = (uint8_t)*src;
+        if (ch < 0x80u) {
+            size_t ascii_len = utf8::gb18030_ascii_widen(src, end, dest);
+            if (ascii_len == 0) {
+                *dest++ = ch;
+                ascii_len = 1;
+            } else {
+                dest += ascii_len;
+            }
+            src += ascii_len;
+            continue;
+        }
+
+        // The 2 bytes sequences of BMP
+        if ((src + 2) <= end) {
+            uint32_t trail = (uint8_t)src[1];
+            if ((uint32_t)(ch - 0x81u) < 126u && trail >= 0x40u && trail != 0x7Fu && trail != 0xFFu) {
+                uint32_t cp = utf8::gb18030_2bytes_table[ch - 0x81u][trail - 0x40u];
+                if ((cp - 0xD800u) >= 2048u) {
+                    *dest++ = (uint16_t)cp;
+                    src += 2;
+                    continue;
+                }
+            }
+        }
+
+        uint32_t code_point;
+        int seq_len = utf8::gb18030_decode_char((const uint8_t *)src, (size_t)(end - src), &code_point);
+        if (seq_len <= 0)
+            break;
+        if (code_point <= 0xFFFFu) {
+            *dest++ = (uint16_t)code_point;
+        } else {
+            *dest++ = (uint16_t)((code_point >> 10u) + 0xD7C0u);
+            *dest++ = (uint16_t)((code_point & 0x03FFu) + 0xDC00u);
+        }
+        src += seq_len;
+    }
+
+    *consumed = (size_t)(src - first);
+    return (size_t)(dest - dest_first);
+}
+
+size_t utf8_to_gb18030(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    const char * first = src;
+    const char * end = src + len;
+    const char * dest_first = dest;
+
+    while (src < end) {
+        uint8_t ch = (uint8_t)*src;
+        if (ch < 0x80u) {
+            size_t ascii_len = utf8::gb18030_ascii_copy(src, end, dest);
+            if (ascii_len == 0) {
+                *dest++ = (char)ch;
+                ascii_len = 1;
+            } else {
+                dest += ascii_len;
+            }
+            src += ascii_len;
+            continue;
+        }
+
+        // The 3 bytes sequences to 2 bytes, most of the Chinese characters.
+        if ((src + 3) <= end && (ch & 0xF0u) == 0xE0u) {
+            uint32_t body1 = (uint8_t)src[1];
+            uint32_t body2 = (uint8_t)src[2];
+            if (((body1 & 0xC0u) == 0x80u) && ((body2 & 0xC0u) == 0x80u)) {
+                uint32_t cp = ((ch & 0x0Fu) << 12u) | ((body1 & 0x3Fu) << 6u) | (body2 & 0x3Fu);
+                uint32_t code = utf8::gb18030_encode_pages[utf8::gb18030_encode_page_index[cp >> 8]][cp & 0xFFu];
+                if (cp >= 0x0800u && code != 0) {
+                    dest[0] = (char)(code >> 8);
+                    dest[1] = (char)(code & 0xFFu);
+                    src  += 3;
+                    dest += 2;
+                    continue;
+                }
+            }
+        }
+
+        uint32_t code_point;
+        int seq_len = utf8::utf8_decode_checked(src, (size_t)(end - src), &code_point);
+        if (seq_len <= 0)
+            break;
+        int bytes = utf8::gb18030_encode_char(code_point, (uint8_t *)dest);
+        if (bytes == 0)
+            break;
+        dest += bytes;
+        src  += seq_len;
+    }
+
+    *consumed = (size_t)(src - first);
+    return (size_t)(dest - dest_first);
+}
+
+typedef size_t (*gb18030_buffer_func_t)(const char * src, size_t len, char * dest, size_t * consumed);
+typedef int (*gb18030_decode_char_func_t)(const uint8_t * src, size_t avail, uint32_t * code_point);
+typedef size_t (*gb18030_encode_char_func_t)(uint32_t code_point, uint8_t * dest);
+
+static int utf8_decode_utf8_char(const uint8_t * src, size_t avail, uint32_t * code_point)
+{
+    return utf8::utf8_decode_checked((const char *)src, avail, code_point);
+}
+
+static size_t gb18030_encode_utf8_char(uint32_t code_point, uint8_t * dest)
+{
+    return utf8::utf8_encode(code_point, (char *)dest);
+}
+
+static size_t gb18030_encode_gb18030_char(uint32_t code_point, uint8_t * dest)
+{
+    return (size_t)utf8::gb18030_encode_char(code_point, dest);
+}
+
+//
+// The iconv() loop of both directions: the buffer kernel converts the input
+// as long as its output (at most 2x, plus 16 bytes of the ASCII stores) fits,
+// then the characters are converted one by one.
+//
+static size_t gb18030_iconv(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft,
+                            gb18030_buffer_func_t convert, gb18030_decode_char_func_t decode_char,
+                            gb18030_encode_char_func_t encode_char)
+{
+    const char *& src = *in_buf;
+    char *& dest = *out_buf;
+    size_t in_left = *in_bytesleft;
+    size_t out_left = *out_bytesleft;
+    int error = 0;
+
+    while (in_left > 0) {
+        if (out_left >= 18) {
+            size_t len = std::min<size_t>(in_left, (out_left - 16) / 2);
+            size_t consumed;
+            size_t written = convert(src, len, dest, &consumed);
+            src  += consumed;
+            dest += written;
+            in_left  -= consumed;
+            out_left -= written;
+            if (consumed == len)
+                continue;
+        }
+
+        // The character the kernel stopped at, or the last bytes of the output.
+        uint8_t buf[4];
+        size_t seq_len = 1, bytes = 1;
+        uint32_t code_point = (uint8_t)*src;
+        if (code_point < 0x80u) {
+            buf[0] = (uint8_t)code_point;
+        } else {
+            int ret = decode_char((const uint8_t *)src, in_left, &code_point);
+            if (ret <= 0) {
+                error = (ret < 0) ? EINVAL : EILSEQ;
+                break;
+            }
+            seq_len = (size_t)ret;
+            bytes = encode_char(code_point, buf);
+            if (bytes == 0) {
+                error = EILSEQ;
+                break;
+            }
+        }
+        if (bytes > out_left) {
+            error = E2BIG;
+            break;
+        }
+        for (size_t i = 0; i < bytes; i++)
+            dest[i] = (char)buf[i];
+        src  += seq_len;
+        dest += bytes;
+        in_left  -= seq_len;
+        out_left -= bytes;
+    }
+
+    *in_bytesleft = in_left;
+    *out_bytesleft = out_left;
+
+    if (error != 0) {
+        errno = error;
+        return (size_t)-1;
+    }
+    return 0;
+}
+
+size_t gb18030ToUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft)
+{
+    return gb18030_iconv(in_buf, in_bytesleft, out_buf, out_bytesleft,
+                         gb18030_to_utf8, utf8::gb18030_decode_char, gb18030_encode_utf8_char);
+}
+
+size_t utf8ToGb18030(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft)
+{
+    return gb18030_iconv(in_buf, in_bytesleft, out_buf, out_bytesleft,
+                         utf8_to_gb18030, utf8_decode_utf8_char, gb18030_encode_gb18030_char);
+}
@@ -0,0 +1,51 @@
+#ifndef UTF8_GB18030_H
+#define UTF8_GB18030_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//
+// GB18030 (and GBK, GB2312, its subsets) <--> UTF-8, table-driven.
+//
+// The ASCII runs are skipped by 16 bytes with SSE2, the other characters are
+// looked up in the tables of utf8_gb18030_table.h (about 115 KB, it stays in
+// L2): the 2 bytes sequences are a [lead][trail] table, the code points are
+// a [page][low byte] table with a shared empty page, and the 4 bytes sequences
+// of BMP are the ranges of the consecutive code points, by binary search.
+// The mapping is the same as the glibc iconv().
+//
+// The buffer kernels stop at the first sequence they can't convert: invalid,
+// unmappable, or cut by the end of the buffer. *consumed is the bytes of the
+// converted characters, the return value is the bytes (or units) written.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GB18030 to UTF-8, the dest must have room for (len * 2 + 16) bytes.
+size_t gb18030_to_utf8(const char * src, size_t len, char * dest, size_t * consumed);
+
+// GB18030 to UTF-16, returns the code units written, the dest must have room for len units.
+size_t gb18030_to_utf16(const char * src, size_t len, uint16_t * dest, size_t * consumed);
+
+// UTF-8 to GB18030, the dest must have room for (len * 2 + 16) bytes.
+size_t utf8_to_gb18030(const char * src, size_t len, char * dest, size_t * consumed);
+
+//
+// Same as latin1ToUtf8() in fromutf8-sse.h, the signature and the errno of iconv(),
+// the output is never written beyond *out_bytesleft.
+//
+size_t gb18030ToUtf8(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft);
+size_t utf8ToGb18030(const char ** in_buf, size_t * in_bytesleft, char ** out_buf, size_t * out_bytesleft);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTF8_GB18030_H
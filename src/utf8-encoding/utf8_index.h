@@ -0,0 +1,225 @@
+#ifndef UTF8_INDEX_H
+#define UTF8_INDEX_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#include <vector>
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_decode_sse.h"
+
+namespace utf8 {
+
+//
+// Random access to a UTF-8 buffer by the code point index or the UTF-16 index,
+// e.g. the substring of a multi-MB text by the character index.
+//
+// build() records the byte offset of every (stride)th code point, and of the
+// character which contains every (stride)th UTF-16 code unit. The lead bytes
+// of 64 bytes are counted at once by popcnt, the bits are only walked in the
+// blocks which contain a checkpoint. A lookup takes the checkpoint in O(1),
+// then skips less than (stride) code points (or units) by the same masks.
+//
+// The buffer is not copied, it must be kept until the index is rebuilt. The
+// input is not validated, the lead bytes 0xF0 - 0xFF are the surrogate pairs.
+//
+class Utf8CodePointIndex {
+public:
+    static const size_t kDefaultStride = 256;
+
+    explicit Utf8CodePointIndex(size_t stride = kDefaultStride)
+        : src_(nullptr), len_(0), stride_(stride), code_points_(0), utf16_length_(0) {
+        assert(stride != 0);
+    }
+
+    void build(const char * src, size_t len) {
+        src_ = src;
+        len_ = len;
+        cp_offsets_.clear();
+        utf16_checkpoints_.clear();
+        cp_offsets_.reserve(len / stride_ + 1);
+        utf16_checkpoints_.reserve(len / stride_ + 1);
+
+        size_t code_points = 0, units = 0;
+        size_t next_cp = 0, next_unit = 0;
+        size_t pos = 0;
+
+#if UTF8_HAVE_SSE2
+        while ((pos + 64) <= len) {
+            uint64_t lead_bits = utf8_lead_mask64_sse(src + pos);
+            uint64_t mb4_bits  = utf8_mb4_mask64_sse(src + pos);
+            size_t block_cp    = bit_popcnt64(lead_bits);
+            size_t block_units = block_cp + bit_popcnt64(mb4_bits);
+
+            if (next_cp >= (code_points + block_cp) && next_unit >= (units + block_units)) {
+                // No checkpoint in this block.
+                code_points += block_cp;
+                units += block_units;
+            } else {
+                while (lead_bits != 0) {
+                    size_t index = bit_bsf64(lead_bits);
+                    lead_bits &= lead_bits - 1;
+                    size_t width = 1 + (size_t)((mb4_bits >> index) & 1u);
+                    add_checkpoints(pos + index, width, code_points, units, next_cp, next_unit);
+                }
+            }
+            pos += 64;
+        }
+#endif
+
+        for (; pos < len; pos++) {
+            uint8_t ch = (uint8_t)src[pos];
+            if ((ch & 0xC0u) != 0x80u) {
+                size_t width = 1 + (size_t)(ch >= 0xF0u);
+                add_checkpoints(pos, width, code_points, units, next_cp, next_unit);
+            }
+        }
+
+        code_points_ = code_points;
+        utf16_length_ = units;
+    }
+
+    size_t stride() const       { return stride_; }
+    size_t code_points() const  { return code_points_; }
+    size_t utf16_length() const { return utf16_length_; }
+
+    //
+    // The byte offset of the code point, index <= code_points(),
+    // code_points() is the end of the buffer.
+    //
+    size_t offset_of_code_point(size_t index) const {
+        assert(index <= code_points_);
+        if (index >= code_points_)
+            return len_;
+        size_t checkpoint = index / stride_;
+        size_t offset = cp_offsets_[checkpoint];
+        return skip_code_points(offset, index - checkpoint * stride_);
+    }
+
+    //
+    // The byte offset of the character of the UTF-16 code unit, index <= utf16_length(),
+    // a low surrogate is the offset of its surrogate pair.
+    //
+    size_t offset_of_utf16(size_t index) const {
+        assert(index <= utf16_length_);
+        if (index >= utf16_length_)
+            return len_;
+        const utf16_checkpoint_t & checkpoint = utf16_checkpoints_[index / stride_];
+        return skip_utf16_units(checkpoint.offset, index - checkpoint.unit);
+    }
+
+    void clear() {
+        src_ = nullptr;
+        len_ = 0;
+        code_points_ = 0;
+        utf16_length_ = 0;
+        cp_offsets_.clear();
+        utf16_checkpoints_.clear();
+    }
+
+private:
+    struct utf16_checkpoint_t {
+        size_t offset;      // The character which contains the checkpoint unit,
+        size_t unit;        // and its first unit, the checkpoint unit or the one before.
+    };
+
+    // A character of (width) units at offset, it's the code point (code_points) and
+    // begins at the unit (units), the checkpoints can be passed by it.
+    void add_checkpoints(size_t offset, size_t width, size_t & code_points, size_t & units,
+                         size_t & next_cp, size_t & next_unit) {
+        if (code_points == next_cp) {
+            cp_offsets_.push_back(offset);
+            next_cp += stride_;
+        }
+        while (next_unit < (units + width)) {
+            utf16_checkpoint_t checkpoint = { offset, units };
+            utf16_checkpoints_.push_back(checkpoint);
+            next_unit += stride_;
+        }
+        code_points++;
+        units += width;
+    }
+
+    // The offset of the (count)th code point after the one at offset.
+    size_t skip_code_points(size_t offset, size_t count) const {
+        size_t pos = offset;
+#if UTF8_HAVE_SSE2
+        while ((pos + 64) <= len_) {
+            uint64_t lead_bits = utf8_lead_mask64_sse(src_ + pos);
+            size_t block_cp = bit_popcnt64(lead_bits);
+            if (count < block_cp) {
+                for (size_t i = 0; i < count; i++) {
+                    lead_bits &= lead_bits - 1;
+                }
+                return (pos + bit_bsf64(lead_bits));
+            }
+            count -= block_cp;
+            pos += 64;
+        }
+#endif
+        for (; pos < len_; pos++) {
+            if ((src_[pos] & 0xC0) != 0x80) {
+                if (count == 0)
+                    return pos;
+                count--;
+            }
+        }
+        return len_;
+    }
+
+    // The offset of the character of the (count)th unit after the character at offset.
+    size_t skip_utf16_units(size_t offset, size_t count) const {
+        size_t pos = offset;
+#if UTF8_HAVE_SSE2
+        while ((pos + 64) <= len_) {
+            uint64_t lead_bits = utf8_lead_mask64_sse(src_ + pos);
+            uint64_t mb4_bits  = utf8_mb4_mask64_sse(src_ + pos);
+            size_t block_units = bit_popcnt64(lead_bits) + bit_popcnt64(mb4_bits);
+            if (count < block_units) {
+                for (;;) {
+                    size_t index = bit_bsf64(lead_bits);
+                    lead_bits &= lead_bits - 1;
+                    size_t width = 1 + (size_t)((mb4_bits >> index) & 1u);
+                    if (count < width)
+                        return (pos + index);
+                    count -= width;
+                }
+            }
+            count -= block_units;
+            pos += 64;
+        }
+#endif
+        for (; pos < len_; pos++) {
+            uint8_t ch = (uint8_t)src_[pos];
+            if ((ch & 0xC0u) != 0x80u) {
+                size_t width = 1 + (size_t)(ch >= 0xF0u);
+                if (count < width)
+                    return pos;
+                count -= width;
+            }
+        }
+        return len_;
+    }
+
+    const char *                    src_;
+    size_t                          len_;
+    size_t                          stride_;
+    size_t                          code_points_;
+    size_t                          utf16_length_;
+    std::vector<size_t>             cp_offsets_;
+    std::vector<utf16_checkpoint_t> utf16_checkpoints_;
+};
+
+} // namespace utf8
+
+#endif // UTF8_INDEX_H
@@ -0,0 +1,124 @@
+#ifndef UTF8_LATIN1_SSE_H
+#define UTF8_LATIN1_SSE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#endif // __cplusplus
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_encode_sse.h"
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+#if defined(__SSE4_1__)
+
+//
+// Encode a Latin-1 (ISO-8859-1) buffer to UTF-8, 16 bytes per block, the rest
+// is encoded by latin1_to_utf8_scalar(). The bytes of a block are widened to
+// the code units and encoded by utf16_to_utf8_sse_mb2().
+//
+// Returns the bytes written, the dest must have room for (len * 2 + 8) bytes.
+//
+static inline
+size_t latin1_to_utf8_sse(const char * src, size_t len, char * dest)
+{
+    const char * end = src + len;
+    const char * dest_first = dest;
+    const utf8_pack_u8_table_t & pack_table = utf8_pack_u8_table();
+
+    __m128i zeros = _mm_setzero_si128();
+
+    while ((src + 16) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        // The pure ASCII
+        if (_mm_movemask_epi8(chunk) == 0) {
+            _mm_storeu_si128((__m128i *)dest, chunk);
+            src  += 16;
+            dest += 16;
+            continue;
+        }
+
+        dest += utf16_to_utf8_sse_mb2(_mm_unpacklo_epi8(chunk, zeros), dest, pack_table);
+        dest += utf16_to_utf8_sse_mb2(_mm_unpackhi_epi8(chunk, zeros), dest, pack_table);
+        src  += 16;
+    }
+
+    dest += latin1_to_utf8_scalar(src, (size_t)(end - src), dest);
+    return (size_t)(dest - dest_first);
+}
+
+//
+// Decode UTF-8 to Latin-1, same as utf8_to_latin1_scalar(), 16 bytes per block.
+// A block can only contain ASCII, the lead bytes 0xC2, 0xC3 and the continuation
+// bytes after them, else it's left to utf8_to_latin1_scalar(), which stops at
+// the first character it can't convert.
+//
+// Returns the bytes written, *consumed is the bytes of the converted characters,
+// the dest must have room for (len + 8) bytes.
+//
+static inline
+size_t utf8_to_latin1_sse(const char * src, size_t len, char * dest, size_t * consumed)
+{
+    const char * first = src;
+    const char * end = src + len;
+    const char * dest_first = dest;
+    const utf8_pack_u8_table_t & pack_table = utf8_pack_u8_table();
+
+    while ((src + 16) <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)src);
+
+        // The pure ASCII
+        uint32_t sign_bits = (uint32_t)_mm_movemask_epi8(chunk);
+        if (sign_bits == 0) {
+            _mm_storeu_si128((__m128i *)dest, chunk);
+            src  += 16;
+            dest += 16;
+            continue;
+        }
+
+        // Every continuation byte follows a lead byte 0xC2 or 0xC3, and vice versa.
+        __m128i lead_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xFEu)), _mm_set1_epi8(0xC2u));
+        __m128i body_mask = _mm_cmpeq_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0xC0u)), _mm_set1_epi8(0x80u));
+        uint32_t lead_bits = (uint32_t)_mm_movemask_epi8(lead_mask);
+        uint32_t body_bits = (uint32_t)_mm_movemask_epi8(body_mask);
+        if ((lead_bits | body_bits) != sign_bits || body_bits != ((lead_bits << 1) & 0xFFFFu))
+            break;
+
+        // 110000yy 10xxxxxx --> yyxxxxxx
+        __m128i prev1 = _mm_slli_si128(chunk, 1);
+        __m128i chars = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(prev1, 6), _mm_set1_epi8(0xC0u)),
+                                     _mm_and_si128(chunk, _mm_set1_epi8(0x3Fu)));
+        chars = _mm_blendv_epi8(chunk, chars, body_mask);
+
+        // The lead byte at the byte 15 is left to the next block.
+        dest += utf16_to_utf8_sse_pack(chars, ~lead_bits & 0xFFFFu, dest, pack_table);
+        src  += 16 - (lead_bits >> 15);
+    }
+
+    size_t tail_consumed;
+    dest += utf8_to_latin1_scalar(src, (size_t)(end - src), dest, &tail_consumed);
+    *consumed = (size_t)(src - first) + tail_consumed;
+    return (size_t)(dest - dest_first);
+}
+
+#endif // __SSE4_1__
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_LATIN1_SSE_H
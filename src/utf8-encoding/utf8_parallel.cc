@@ -0,0 +1,166 @@
+//
+// Compiled with the default flags, the kernels are taken from utf8_dispatch.h
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <thread>
+#include <vector>
+#include <system_error>
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_dispatch.h"
+#include "utf8-encoding/utf8_parallel.h"
+
+// The smaller chunks are not worth a thread.
+static const size_t kMinChunkSize = 256 * 1024;
+
+// The SSE and AVX2 kernels store a block of 16 units beyond their output, the
+// last 64 bytes (16 characters at least) are decoded by the scalar code, so the
+// block is overwritten by the same chunk. The AVX-512 one stores nothing beyond.
+static const size_t kScalarTailBytes = 64;
+
+struct utf8_chunk_t {
+    const char * src;
+    size_t       len;
+    size_t       units;     // Counted in the first pass
+    bool         valid;     // Validated in the first pass
+    uint16_t *   dest;
+    size_t       written;   // Decoded in the second pass
+};
+
+// The first lead byte at or after pos.
+static size_t utf8_lead_boundary(const char * src, size_t len, size_t pos)
+{
+    while (pos < len && (src[pos] & 0xC0) == 0x80) {
+        pos++;
+    }
+    return pos;
+}
+
+//
+// Decode a chunk of the whole characters, the output is never written beyond
+// the last code unit.
+//
+static size_t utf8_decode_chunk(utf8_decode_func_t decode_func, const char * src, size_t len, uint16_t * dest)
+{
+    size_t body_len = 0;
+    uint16_t * dest_first = dest;
+    if (len > kScalarTailBytes) {
+        // Cut before the lead byte, so the body is the whole characters.
+        body_len = len - kScalarTailBytes;
+        while (body_len > 0 && (src[body_len] & 0xC0) == 0x80) {
+            body_len--;
+        }
+        dest += decode_func(src, body_len, dest);
+    }
+    dest += utf8::utf8_decode_scalar(src + body_len, len - body_len, dest);
+    return (size_t)(dest - dest_first);
+}
+
+//
+// Decode the invalid input by the scalar code, the output is cut at (capacity)
+// code units. The scalar code writes one or two units for 1 ~ 4 bytes, so a
+// round of (room) bytes never writes more than (room) units.
+//
+static size_t utf8_decode_bounded(const char * src, size_t len, uint16_t * dest, size_t capacity)
+{
+    size_t written = 0;
+    while (len > 0 && written < capacity) {
+        size_t round_len = (len < (capacity - written)) ? len : (capacity - written);
+        // Cut before the lead byte, a character cut by the round is dropped by the scalar code.
+        if (round_len < len) {
+            while (round_len > 0 && (src[round_len] & 0xC0) == 0x80) {
+                round_len--;
+            }
+            if (round_len == 0)
+                break;
+        }
+        written += utf8::utf8_decode_scalar(src, round_len, dest + written);
+        src += round_len;
+        len -= round_len;
+    }
+    return written;
+}
+
+//
+// Call func(chunk) for each chunk, the first chunk is done by the calling thread.
+// If a thread can't be created, the chunk is done by the calling thread too.
+//
+template <typename Func>
+static void utf8_chunks_for_each(std::vector<utf8_chunk_t> & chunks, Func func)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(chunks.size());
+    for (size_t i = 1; i < chunks.size(); i++) {
+        utf8_chunk_t * chunk = &chunks[i];
+        try {
+            workers.push_back(std::thread([chunk, &func]() { func(*chunk); }));
+        } catch (const std::system_error &) {
+            func(*chunk);
+        }
+    }
+
+    func(chunks[0]);
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+size_t utf8_decode_parallel(const char * src, size_t len, uint16_t * dest, unsigned int threads)
+{
+    utf8_decode_func_t decode_func = utf8_decode_get_kernel(utf8_decode_kernel());
+    if (decode_func == nullptr)
+        decode_func = utf8_decode_get_kernel(UTF8_KERNEL_SCALAR);
+
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    size_t max_chunks = len / kMinChunkSize;
+    size_t num_chunks = (threads < max_chunks) ? threads : max_chunks;
+    if (num_chunks <= 1) {
+        if (!utf8_validate_dispatch(src, len))
+            return utf8_decode_bounded(src, len, dest, utf16_length_from_utf8(src, len));
+        return utf8_decode_chunk(decode_func, src, len, dest);
+    }
+
+    // Split at the lead bytes, a chunk is never empty, it's kMinChunkSize at least.
+    std::vector<utf8_chunk_t> chunks(num_chunks);
+    size_t first = 0;
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t last = (i + 1 < num_chunks) ? utf8_lead_boundary(src, len, len / num_chunks * (i + 1)) : len;
+        chunks[i].src = src + first;
+        chunks[i].len = last - first;
+        first = last;
+    }
+
+    // A chunk begins with a lead byte, so the buffer is valid if every chunk is.
+    utf8_chunks_for_each(chunks, [](utf8_chunk_t & chunk) {
+        chunk.valid = utf8_validate_dispatch(chunk.src, chunk.len);
+        chunk.units = utf16_length_from_utf8(chunk.src, chunk.len);
+    });
+
+    bool valid = true;
+    size_t total_units = 0;
+    for (size_t i = 0; i < num_chunks; i++) {
+        chunks[i].dest = dest + total_units;
+        total_units += chunks[i].units;
+        valid = valid && chunks[i].valid;
+    }
+
+    // The stray continuation bytes are not counted, but decoded by the kernels.
+    if (!valid)
+        return utf8_decode_bounded(src, len, dest, total_units);
+
+    utf8_chunks_for_each(chunks, [decode_func](utf8_chunk_t & chunk) {
+        chunk.written = utf8_decode_chunk(decode_func, chunk.src, chunk.len, chunk.dest);
+    });
+
+    for (size_t i = 0; i < num_chunks; i++) {
+        assert(chunks[i].written == chunks[i].units);
+    }
+    return total_units;
+}
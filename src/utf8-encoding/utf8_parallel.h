@@ -0,0 +1,45 @@
+#ifndef UTF8_PARALLEL_H
+#define UTF8_PARALLEL_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//
+// Decode a large UTF-8 buffer to UTF-16 by several threads.
+//
+// The buffer is split to the chunks at the lead bytes, the UTF-16 length of
+// every chunk is counted by utf16_length_from_utf8() in the first pass, and
+// the prefix sum of them is the position of each chunk in dest. Every chunk is
+// validated by utf8_validate_dispatch() in the same pass. Then the chunks are
+// decoded to their positions at the same time, by the kernel of utf8_dispatch.h,
+// the last 64 bytes of a chunk are decoded by the scalar code, so the block
+// stored by the kernel beyond its output never crosses the chunk.
+//
+// The invalid input is decoded by the scalar code of the calling thread, and
+// the output is cut at the units counted by utf16_length_from_utf8(), which
+// doesn't count the stray continuation bytes.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Decode with (threads) threads, 0 is the number of the CPU cores. Each thread
+// gets 256 KiB at least, a smaller buffer is decoded by the calling thread.
+// Returns the code units written, the dest must have room for the units of
+// utf16_length_from_utf8() only, nothing is written beyond, even if the input
+// is not valid UTF-8.
+//
+size_t utf8_decode_parallel(const char * src, size_t len, uint16_t * dest, unsigned int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTF8_PARALLEL_H
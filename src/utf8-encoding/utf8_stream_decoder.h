@@ -0,0 +1,100 @@
+#ifndef UTF8_STREAM_DECODER_H
+#define UTF8_STREAM_DECODER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#include <cstring>
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_dispatch.h"
+
+namespace utf8 {
+
+//
+// Decode a UTF-8 stream to UTF-16 chunk by chunk, the chunks can be cut at
+// any byte, e.g. the buffers of read() or recv().
+//
+// A character cut by the end of a chunk (at most 3 bytes) is kept in the
+// decoder, and completed by the first bytes of the next chunk, then the rest
+// of the chunk goes to utf8_decode_partial_dispatch() at once, the kernel of
+// the running CPU. Every byte is only read once, so the chunked decoding is as
+// fast as the one-shot decoding.
+//
+// Same as utf8_decode_dispatch(), the input must be valid UTF-8, it's not checked.
+//
+class Utf8StreamDecoder {
+public:
+    static const size_t kMaxPendingBytes = 3;
+
+    Utf8StreamDecoder() : pending_len_(0) {}
+
+    //
+    // Decode a chunk, returns the code units written.
+    // The dest must have room for (len + 16) units.
+    //
+    size_t decode(const char * src, size_t len, uint16_t * dest) {
+        const char * end = src + len;
+        const uint16_t * dest_first = dest;
+
+        // Complete the pending character first.
+        if (pending_len_ != 0) {
+            size_t need = utf8_decode_len(pending_) - pending_len_;
+            size_t take = (need <= len) ? need : len;
+            std::memcpy(pending_ + pending_len_, src, take);
+            pending_len_ += take;
+            src += take;
+            if (take < need)
+                return 0;
+            dest += utf8_decode_scalar(pending_, pending_len_, dest);
+            pending_len_ = 0;
+        }
+
+        size_t consumed;
+        dest += utf8_decode_partial_dispatch(src, (size_t)(end - src), dest, &consumed);
+        src  += consumed;
+
+        // Keep the incomplete character to the next chunk.
+        pending_len_ = (size_t)(end - src);
+        assert(pending_len_ <= kMaxPendingBytes);
+        std::memcpy(pending_, src, pending_len_);
+
+        return (size_t)(dest - dest_first);
+    }
+
+    // The bytes of the incomplete character kept by the last chunk.
+    size_t pending() const {
+        return pending_len_;
+    }
+
+    //
+    // End of the stream, returns false if it's ended by an incomplete character,
+    // the pending bytes are dropped, and the decoder can be used for a new stream.
+    //
+    bool finish() {
+        bool complete = (pending_len_ == 0);
+        pending_len_ = 0;
+        return complete;
+    }
+
+    void reset() {
+        pending_len_ = 0;
+    }
+
+private:
+    char   pending_[4];
+    size_t pending_len_;
+};
+
+} // namespace utf8
+
+#endif // UTF8_STREAM_DECODER_H
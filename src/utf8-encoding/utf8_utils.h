@@ -84,6 +84,25 @@ std::size_t utf8_decode_len(const char * utf8)
     }
 }
 
+//
+// The bytes of the character cut by the end of [src, end), or 0 if the last
+// character is whole. Only the last 3 bytes are read, same as the kernels,
+// a byte 10xxxxxx is a continuation byte, and the input is not validated.
+//
+static inline
+std::size_t utf8_cut_tail_len(const char * src, const char * end)
+{
+    std::size_t len = (std::size_t)(end - src);
+    for (std::size_t n = 1; n <= 3 && n <= len; n++) {
+        std::uint32_t ch = (std::uint8_t)*(end - n);
+        if ((ch & 0xC0u) != 0x80u) {
+            std::size_t char_len = (ch < 0xC0u) ? 1 : ((ch < 0xE0u) ? 2 : ((ch < 0xF0u) ? 3 : 4));
+            return (char_len > n) ? n : 0;
+        }
+    }
+    return 0;
+}
+
 static inline
 std::size_t unicode_encode_len(std::uint32_t unicode)
 {
@@ -144,7 +163,7 @@ std::size_t utf8_encode(std::uint32_t code_point, char * utf8_output)
             // 0x00010000 - 0x001FFFFF (in fact 0x0010FFFF)
             // 21 bits, 4 bytes: 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
             *(utf8 + 0) = (uint8_t)(((code_point & 0x001C0000u) >> 18u) | 0xF0u);
-            *(utf8 + 1) = (uint8_t)(((code_point & 0x00003F00u) >> 12u) | 0x80u);
+            *(utf8 + 1) = (uint8_t)(((code_point & 0x0003F000u) >> 12u) | 0x80u);
             *(utf8 + 2) = (uint8_t)(((code_point & 0x00000FC0u) >> 6u ) | 0x80u);
             *(utf8 + 3) = (uint8_t)(((code_point & 0x0000003Fu) >> 0u ) | 0x80u);
             return std::size_t(4);
@@ -163,6 +182,254 @@ std::size_t utf8_encode(std::uint32_t code_point, char * utf8_output)
     }
 }
 
+//
+// Decode and validate one character, same as utf8_validate_scalar(). Returns
+// its length, or 0 if it's invalid, or -1 if it's a valid prefix cut by the
+// end (avail bytes, at least 1).
+//
+static inline
+int utf8_decode_checked(const char * src, std::size_t avail, std::uint32_t * code_point)
+{
+    const std::uint8_t * chars = (const std::uint8_t *)src;
+    std::uint32_t ch = chars[0];
+    std::uint32_t cp, min_code_point;
+    std::size_t need;
+    if (ch < 0x80u) {
+        *code_point = ch;
+        return 1;
+    } else if ((ch & 0xE0u) == 0xC0u) {
+        cp = ch & 0x1Fu;
+        need = 1;
+        min_code_point = 0x80u;
+    } else if ((ch & 0xF0u) == 0xE0u) {
+        cp = ch & 0x0Fu;
+        need = 2;
+        min_code_point = 0x800u;
+    } else if ((ch & 0xF8u) == 0xF0u) {
+        cp = ch & 0x07u;
+        need = 3;
+        min_code_point = 0x10000u;
+    } else {
+        return 0;
+    }
+
+    // 0xC0, 0xC1 and [0xF5, 0xF7] are never valid.
+    if ((need == 1 && cp < 0x02u) || (need == 3 && cp > 0x04u))
+        return 0;
+
+    for (std::size_t n = 1; n <= need; n++) {
+        if (n >= avail)
+            return -1;
+        std::uint32_t body = chars[n];
+        if ((body & 0xC0u) != 0x80u)
+            return 0;
+        cp = (cp << 6u) | (body & 0x3Fu);
+
+        // The first two bytes tell the overlong sequences, the surrogates and
+        // the code points above U+10FFFF, only a valid prefix is cut (-1).
+        if (n == 1) {
+            if ((need == 2 && (cp < 0x20u || (cp - 0x360u) < 0x20u)) ||
+                (need == 3 && (cp < 0x10u || cp > 0x10Fu)))
+                return 0;
+        }
+    }
+
+    // Overlong sequence, UTF-16 surrogate or above U+10FFFF
+    if ((cp < min_code_point) || ((cp - 0xD800u) < 2048u) || (cp > 0x10FFFFu))
+        return 0;
+
+    *code_point = cp;
+    return (int)(need + 1);
+}
+
+//
+// Decode the whole characters of a buffer to UTF-16, the code points above
+// 0xFFFF are output as the surrogate pairs. The input is not validated,
+// an incomplete character at the end is not decoded.
+//
+static inline
+std::size_t utf8_decode_scalar(const char * src, std::size_t len, std::uint16_t * dest)
+{
+    const char * end = src + len;
+    const std::uint16_t * dest_first = dest;
+    while (src < end) {
+        std::size_t skip = utf8_decode_len(src);
+        if (skip > (std::size_t)(end - src))
+            break;
+        std::uint32_t code_point = utf8_decode(src, skip);
+        if (code_point <= 0x0000FFFFu) {
+            *dest++ = (std::uint16_t)code_point;
+        } else {
+            *dest++ = (std::uint16_t)((code_point >> 10u) + 0xD7C0u);
+            *dest++ = (std::uint16_t)((code_point & 0x03FFu) + 0xDC00u);
+        }
+        src += skip;
+    }
+    return (std::size_t)(dest - dest_first);
+}
+
+//
+// Decode the whole characters of a buffer to UTF-32, the input is not validated,
+// an incomplete character at the end is not decoded. Returns the code points written.
+//
+static inline
+std::size_t utf8_to_utf32_scalar(const char * src, std::size_t len, std::uint32_t * dest)
+{
+    const char * end = src + len;
+    const std::uint32_t * dest_first = dest;
+    while (src < end) {
+        std::size_t skip = utf8_decode_len(src);
+        if (skip > (std::size_t)(end - src))
+            break;
+        *dest++ = utf8_decode(src, skip);
+        src += skip;
+    }
+    return (std::size_t)(dest - dest_first);
+}
+
+//
+// Encode a UTF-16 buffer to UTF-8, a high surrogate followed by a low surrogate
+// is encoded as a 4 bytes sequence, the unpaired surrogates are encoded as is
+// (3 bytes). The input is not validated. Returns the bytes written, the dest
+// must have room for (len * 3) bytes.
+//
+static inline
+std::size_t utf16_to_utf8_scalar(const std::uint16_t * src, std::size_t len, char * dest)
+{
+    const std::uint16_t * end = src + len;
+    const char * dest_first = dest;
+    while (src < end) {
+        std::uint32_t code_point = *src++;
+        if ((code_point & 0xFC00u) == 0xD800u && src < end && (*src & 0xFC00u) == 0xDC00u) {
+            // ((high - 0xD800) << 10) + (low - 0xDC00) + 0x10000
+            code_point = (code_point << 10u) + *src++ - ((0xD800u << 10u) + 0xDC00u - 0x10000u);
+        }
+        dest += utf8_encode(code_point, dest);
+    }
+    return (std::size_t)(dest - dest_first);
+}
+
+//
+// Encode a UTF-32 buffer to UTF-8 by utf8_encode(), the input is not validated.
+// Returns the bytes written, the dest must have room for (len * 4) bytes.
+//
+static inline
+std::size_t utf32_to_utf8_scalar(const std::uint32_t * src, std::size_t len, char * dest)
+{
+    const std::uint32_t * end = src + len;
+    const char * dest_first = dest;
+    while (src < end) {
+        dest += utf8_encode(*src++, dest);
+    }
+    return (std::size_t)(dest - dest_first);
+}
+
+//
+// Encode a Latin-1 (ISO-8859-1) buffer to UTF-8, the bytes above 0x7F are 2 bytes.
+// Returns the bytes written, the dest must have room for (len * 2) bytes.
+//
+static inline
+std::size_t latin1_to_utf8_scalar(const char * src, std::size_t len, char * dest)
+{
+    const uint8_t * chars = (const uint8_t *)src;
+    uint8_t * out = (uint8_t *)dest;
+    for (std::size_t i = 0; i < len; i++) {
+        std::uint32_t ch = chars[i];
+        if (ch < 0x80u) {
+            *out++ = (uint8_t)ch;
+        } else {
+            *out++ = (uint8_t)((ch >> 6u) | 0xC0u);
+            *out++ = (uint8_t)((ch & 0x3Fu) | 0x80u);
+        }
+    }
+    return (std::size_t)(out - (uint8_t *)dest);
+}
+
+//
+// Decode UTF-8 to Latin-1, stop at the first character above U+00FF, the first
+// invalid sequence or the 2 bytes sequence cut by the end of the buffer.
+// Returns the bytes written, *consumed is the bytes of the converted characters.
+//
+static inline
+std::size_t utf8_to_latin1_scalar(const char * src, std::size_t len, char * dest, std::size_t * consumed)
+{
+    const uint8_t * chars = (const uint8_t *)src;
+    uint8_t * out = (uint8_t *)dest;
+    std::size_t i = 0;
+    while (i < len) {
+        std::uint32_t ch = chars[i];
+        if (ch < 0x80u) {
+            *out++ = (uint8_t)ch;
+            i++;
+        } else if ((ch & 0xFEu) == 0xC2u && (i + 1) < len && (chars[i + 1] & 0xC0u) == 0x80u) {
+            // 110000yy 10xxxxxx
+            *out++ = (uint8_t)(((ch & 0x03u) << 6u) | (chars[i + 1] & 0x3Fu));
+            i += 2;
+        } else {
+            break;
+        }
+    }
+    *consumed = i;
+    return (std::size_t)(out - (uint8_t *)dest);
+}
+
+//
+// The UTF-16 code units of a UTF-8 buffer without decoding it: one for each byte
+// except the continuation bytes (10xxxxxx), and one more for each 4 bytes lead
+// byte (11110xxx), it's a surrogate pair. The input is not validated, the count
+// is exact for the valid input only.
+//
+static inline
+std::size_t utf16_length_from_utf8_scalar(const char * src, std::size_t len)
+{
+    const uint8_t * chars = (const uint8_t *)src;
+    std::size_t units = 0;
+    for (std::size_t i = 0; i < len; i++) {
+        std::uint32_t ch = chars[i];
+        units += (std::size_t)((ch & 0xC0u) != 0x80u) + (std::size_t)(ch >= 0xF0u);
+    }
+    return units;
+}
+
+//
+// The code points of a UTF-8 buffer without decoding it, one for each byte
+// except the continuation bytes (10xxxxxx). The input is not validated.
+//
+static inline
+std::size_t count_code_points_scalar(const char * src, std::size_t len)
+{
+    const uint8_t * chars = (const uint8_t *)src;
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < len; i++) {
+        count += (std::size_t)((chars[i] & 0xC0u) != 0x80u);
+    }
+    return count;
+}
+
+//
+// Count the sequences of a UTF-8 buffer by their length, in one pass: counts[n - 1]
+// is added the n bytes sequences (the lead bytes), the continuation bytes are
+// skipped. The input is not validated, the lead bytes 0xF8 - 0xFF are counted
+// as the 4 bytes sequences.
+//
+static inline
+void utf8_seq_histogram_scalar(const char * src, std::size_t len, std::size_t counts[4])
+{
+    const uint8_t * chars = (const uint8_t *)src;
+    std::size_t ascii = 0, mb2 = 0, mb3 = 0, mb4 = 0;
+    for (std::size_t i = 0; i < len; i++) {
+        std::uint32_t ch = chars[i];
+        ascii += (std::size_t)(ch < 0x80u);
+        mb2   += (std::size_t)((ch & 0xE0u) == 0xC0u);
+        mb3   += (std::size_t)((ch & 0xF0u) == 0xE0u);
+        mb4   += (std::size_t)(ch >= 0xF0u);
+    }
+    counts[0] += ascii;
+    counts[1] += mb2;
+    counts[2] += mb3;
+    counts[3] += mb4;
+}
+
 } // namespace utf8
 
 #endif // UTF8_UTILS_H
@@ -0,0 +1,410 @@
+#ifndef UTF8_VALIDATE_H
+#define UTF8_VALIDATE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#include <cstring>
+#endif // __cplusplus
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) \
+ && (defined(_M_X64) || defined(_M_AMD64) || defined(__amd64__) || defined(__x86_64__))
+#define UTF8_HAVE_AVX512_BW  1
+#endif
+
+#include "utf8-encoding/utf8_dispatch.h"
+
+/*******************************************************************************
+
+    UTF-8 validation (RFC 3629), without any output.
+
+    The SIMD kernels classify each pair of bytes (previous byte, current byte)
+    by three nibble lookups with pshufb, the error flags of the three lookups
+    are ANDed, so a pair is valid only if no flag survives:
+
+        byte_1_high[prev1 >> 4] & byte_1_low[prev1 & 0x0F] & byte_2_high[input >> 4]
+
+    The 3rd and 4th bytes of the sequences are checked by the lead byte two
+    or three bytes before. All the errors are accumulated in one vector, which
+    is tested only once at the end.
+
+    See: John Keiser, Daniel Lemire, "Validating UTF-8 In Less Than One
+         Instruction Per Byte", Software: Practice and Experience, 2021.
+
+    Unlike fromUtf8_sse_validate(), the noncharacters are valid here.
+
+*******************************************************************************/
+
+#ifdef __cplusplus
+namespace utf8 {
+#endif
+
+enum {
+    kUtf8_TooShort      = 0x01,     // 11______ 0_______ or 11______ 11______
+    kUtf8_TooLong       = 0x02,     // 0_______ 10______
+    kUtf8_Overlong3     = 0x04,     // 11100000 100_____
+    kUtf8_TooLarge      = 0x08,     // 11110100 1001____, 11110100 101_____, 11110101 ...
+    kUtf8_Surrogate     = 0x10,     // 11101101 101_____
+    kUtf8_Overlong2     = 0x20,     // 1100000_ 10______
+    kUtf8_TooLarge1000  = 0x40,     // 11110101 1000____, 11110110 ...
+    kUtf8_Overlong4     = 0x40,     // 11110000 1000____
+    kUtf8_TwoConts      = 0x80,     // 10______ 10______
+
+    kUtf8_Carry         = kUtf8_TooShort | kUtf8_TooLong | kUtf8_TwoConts
+};
+
+static inline
+bool utf8_validate_scalar(const char * src, size_t len)
+{
+    const uint8_t * p = (const uint8_t *)src;
+    const uint8_t * end = p + len;
+    while (p < end) {
+        uint32_t ch = *p;
+        if (ch < 0x80u) {
+            p++;
+            continue;
+        }
+
+        uint32_t code_point, min_code_point;
+        size_t need;
+        if ((ch & 0xE0u) == 0xC0u) {
+            code_point = ch & 0x1Fu;
+            need = 1;
+            min_code_point = 0x80u;
+        } else if ((ch & 0xF0u) == 0xE0u) {
+            code_point = ch & 0x0Fu;
+            need = 2;
+            min_code_point = 0x800u;
+        } else if ((ch & 0xF8u) == 0xF0u) {
+            code_point = ch & 0x07u;
+            need = 3;
+            min_code_point = 0x10000u;
+        } else {
+            return false;
+        }
+
+        if ((size_t)(end - p) <= need)
+            return false;
+
+        for (size_t n = 1; n <= need; n++) {
+            uint32_t body = p[n];
+            if ((body & 0xC0u) != 0x80u)
+                return false;
+            code_point = (code_point << 6) | (body & 0x3Fu);
+        }
+
+        // Overlong sequence, UTF-16 surrogate or above U+10FFFF
+        if ((code_point < min_code_point) || ((code_point - 0xD800u) < 2048u) || (code_point > 0x10FFFFu))
+            return false;
+
+        p += need + 1;
+    }
+    return true;
+}
+
+#if defined(__SSE4_1__)
+
+static inline
+__m128i utf8_validate_byte_1_high_lookup()
+{
+    return _mm_setr_epi8(
+        // 0_______ ________ <ASCII in byte 1>
+        kUtf8_TooLong, kUtf8_TooLong, kUtf8_TooLong, kUtf8_TooLong,
+        kUtf8_TooLong, kUtf8_TooLong, kUtf8_TooLong, kUtf8_TooLong,
+        // 10______ ________ <continuation in byte 1>
+        kUtf8_TwoConts, kUtf8_TwoConts, kUtf8_TwoConts, kUtf8_TwoConts,
+        // 1100____ ________ <two byte lead in byte 1>
+        kUtf8_TooShort | kUtf8_Overlong2,
+        // 1101____ ________ <two byte lead in byte 1>
+        kUtf8_TooShort,
+        // 1110____ ________ <three byte lead in byte 1>
+        kUtf8_TooShort | kUtf8_Overlong3 | kUtf8_Surrogate,
+        // 1111____ ________ <four+ byte lead in byte 1>
+        (char)(kUtf8_TooShort | kUtf8_TooLarge | kUtf8_TooLarge1000 | kUtf8_Overlong4));
+}
+
+static inline
+__m128i utf8_validate_byte_1_low_lookup()
+{
+    return _mm_setr_epi8(
+        // ____0000 ________
+        (char)(kUtf8_Carry | kUtf8_Overlong3 | kUtf8_Overlong2 | kUtf8_Overlong4),
+        // ____0001 ________
+        (char)(kUtf8_Carry | kUtf8_Overlong2),
+        // ____001_ ________
+        (char)kUtf8_Carry,
+        (char)kUtf8_Carry,
+        // ____0100 ________
+        (char)(kUtf8_Carry | kUtf8_TooLarge),
+        // ____0101 ________
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        // ____011_ ________
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        // ____1___ ________
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        // ____1101 ________
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000 | kUtf8_Surrogate),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000),
+        (char)(kUtf8_Carry | kUtf8_TooLarge | kUtf8_TooLarge1000));
+}
+
+static inline
+__m128i utf8_validate_byte_2_high_lookup()
+{
+    return _mm_setr_epi8(
+        // ________ 0_______ <ASCII in byte 2>
+        kUtf8_TooShort, kUtf8_TooShort, kUtf8_TooShort, kUtf8_TooShort,
+        kUtf8_TooShort, kUtf8_TooShort, kUtf8_TooShort, kUtf8_TooShort,
+        // ________ 1000____
+        (char)(kUtf8_TooLong | kUtf8_Overlong2 | kUtf8_TwoConts | kUtf8_Overlong3 | kUtf8_TooLarge1000 | kUtf8_Overlong4),
+        // ________ 1001____
+        (char)(kUtf8_TooLong | kUtf8_Overlong2 | kUtf8_TwoConts | kUtf8_Overlong3 | kUtf8_TooLarge),
+        // ________ 101_____
+        (char)(kUtf8_TooLong | kUtf8_Overlong2 | kUtf8_TwoConts | kUtf8_Surrogate | kUtf8_TooLarge),
+        (char)(kUtf8_TooLong | kUtf8_Overlong2 | kUtf8_TwoConts | kUtf8_Surrogate | kUtf8_TooLarge),
+        // ________ 11______ <lead in byte 2>
+        kUtf8_TooShort, kUtf8_TooShort, kUtf8_TooShort, kUtf8_TooShort);
+}
+
+static inline
+bool utf8_validate_sse41(const char * src, size_t len)
+{
+    static const size_t kPerLoopBytes = 16;
+
+    const __m128i byte_1_high_lookup = utf8_validate_byte_1_high_lookup();
+    const __m128i byte_1_low_lookup  = utf8_validate_byte_1_low_lookup();
+    const __m128i byte_2_high_lookup = utf8_validate_byte_2_high_lookup();
+    const __m128i mask_0F            = _mm_set1_epi8(0x0F);
+    const __m128i third_byte_min     = _mm_set1_epi8(0xE0u - 0x80u);
+    const __m128i fourth_byte_min    = _mm_set1_epi8(0xF0u - 0x80u);
+    const __m128i mask_80            = _mm_set1_epi8(0x80u);
+    // The lead bytes in the last 3 bytes which need more bytes
+    const __m128i incomplete_max     = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                     0xF0u - 1, 0xE0u - 1, 0xC0u - 1);
+
+    const char * end = src + len;
+
+    __m128i error           = _mm_setzero_si128();
+    __m128i prev_input      = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+
+    alignas(16) char tail[kPerLoopBytes];
+
+    while (src < end) {
+        __m128i input;
+        if ((src + kPerLoopBytes) <= end) {
+            input = _mm_loadu_si128((const __m128i *)src);
+        } else {
+            // Pad the rest bytes with the ASCII zeros
+            ::memset(tail, 0, sizeof(tail));
+            ::memcpy(tail, src, (size_t)(end - src));
+            input = _mm_load_si128((const __m128i *)tail);
+        }
+
+        if (_mm_movemask_epi8(input) == 0) {
+            // All ASCII, only the sequence cut by the previous block can be wrong
+            error = _mm_or_si128(error, prev_incomplete);
+            prev_incomplete = _mm_setzero_si128();
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(input, prev_input, 16 - 1);
+            __m128i prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+            __m128i prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+
+            __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_lookup, _mm_and_si128(_mm_srli_epi16(prev1, 4), mask_0F));
+            __m128i byte_1_low  = _mm_shuffle_epi8(byte_1_low_lookup,  _mm_and_si128(prev1, mask_0F));
+            __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_lookup, _mm_and_si128(_mm_srli_epi16(input, 4), mask_0F));
+            __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+            // The 3rd and 4th bytes must be continuation bytes, flagged as kUtf8_TwoConts
+            __m128i is_third_byte  = _mm_subs_epu8(prev2, third_byte_min);
+            __m128i is_fourth_byte = _mm_subs_epu8(prev3, fourth_byte_min);
+            __m128i must_be_2_3_continuation = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), mask_80);
+
+            error = _mm_or_si128(error, _mm_xor_si128(must_be_2_3_continuation, special_cases));
+            prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+        }
+
+        prev_input = input;
+        src += kPerLoopBytes;
+    }
+
+    // The last sequence must be complete
+    error = _mm_or_si128(error, prev_incomplete);
+    return (_mm_testz_si128(error, error) != 0);
+}
+
+#endif // __SSE4_1__
+
+#if defined(__AVX2__)
+
+static inline
+bool utf8_validate_avx2(const char * src, size_t len)
+{
+    static const size_t kPerLoopBytes = 32;
+
+    const __m256i byte_1_high_lookup = _mm256_broadcastsi128_si256(utf8_validate_byte_1_high_lookup());
+    const __m256i byte_1_low_lookup  = _mm256_broadcastsi128_si256(utf8_validate_byte_1_low_lookup());
+    const __m256i byte_2_high_lookup = _mm256_broadcastsi128_si256(utf8_validate_byte_2_high_lookup());
+    const __m256i mask_0F            = _mm256_set1_epi8(0x0F);
+    const __m256i third_byte_min     = _mm256_set1_epi8(0xE0u - 0x80u);
+    const __m256i fourth_byte_min    = _mm256_set1_epi8(0xF0u - 0x80u);
+    const __m256i mask_80            = _mm256_set1_epi8(0x80u);
+    const __m256i incomplete_max     = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                        0xF0u - 1, 0xE0u - 1, 0xC0u - 1);
+
+    const char * end = src + len;
+
+    __m256i error           = _mm256_setzero_si256();
+    __m256i prev_input      = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    alignas(32) char tail[kPerLoopBytes];
+
+    while (src < end) {
+        __m256i input;
+        if ((src + kPerLoopBytes) <= end) {
+            input = _mm256_loadu_si256((const __m256i *)src);
+        } else {
+            ::memset(tail, 0, sizeof(tail));
+            ::memcpy(tail, src, (size_t)(end - src));
+            input = _mm256_load_si256((const __m256i *)tail);
+        }
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+        } else {
+            // The alignr of AVX2 works in the 128 bit lanes, so move the previous lane in first.
+            __m256i prev_lane = _mm256_permute2x128_si256(prev_input, input, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(input, prev_lane, 16 - 1);
+            __m256i prev2 = _mm256_alignr_epi8(input, prev_lane, 16 - 2);
+            __m256i prev3 = _mm256_alignr_epi8(input, prev_lane, 16 - 3);
+
+            __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_lookup, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), mask_0F));
+            __m256i byte_1_low  = _mm256_shuffle_epi8(byte_1_low_lookup,  _mm256_and_si256(prev1, mask_0F));
+            __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_lookup, _mm256_and_si256(_mm256_srli_epi16(input, 4), mask_0F));
+            __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+            __m256i is_third_byte  = _mm256_subs_epu8(prev2, third_byte_min);
+            __m256i is_fourth_byte = _mm256_subs_epu8(prev3, fourth_byte_min);
+            __m256i must_be_2_3_continuation = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), mask_80);
+
+            error = _mm256_or_si256(error, _mm256_xor_si256(must_be_2_3_continuation, special_cases));
+            prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+        }
+
+        prev_input = input;
+        src += kPerLoopBytes;
+    }
+
+    error = _mm256_or_si256(error, prev_incomplete);
+    return (_mm256_testz_si256(error, error) != 0);
+}
+
+#endif // __AVX2__
+
+#if UTF8_HAVE_AVX512_BW
+
+static inline
+bool utf8_validate_avx512(const char * src, size_t len)
+{
+    static const size_t kPerLoopBytes = 64;
+
+    const __m512i byte_1_high_lookup = _mm512_broadcast_i32x4(utf8_validate_byte_1_high_lookup());
+    const __m512i byte_1_low_lookup  = _mm512_broadcast_i32x4(utf8_validate_byte_1_low_lookup());
+    const __m512i byte_2_high_lookup = _mm512_broadcast_i32x4(utf8_validate_byte_2_high_lookup());
+    const __m512i mask_0F            = _mm512_set1_epi8(0x0F);
+    const __m512i third_byte_min     = _mm512_set1_epi8(0xE0u - 0x80u);
+    const __m512i fourth_byte_min    = _mm512_set1_epi8(0xF0u - 0x80u);
+    const __m512i mask_80            = _mm512_set1_epi8(0x80u);
+    // Byte 61 = 0xF0 - 1, byte 62 = 0xE0 - 1, byte 63 = 0xC0 - 1, the others are 0xFF.
+    const __m512i incomplete_max     = _mm512_set_epi64(0xBFDFEFFFFFFFFFFFull, -1, -1, -1, -1, -1, -1, -1);
+
+    const char * end = src + len;
+
+    __m512i error           = _mm512_setzero_si512();
+    __m512i prev_input      = _mm512_setzero_si512();
+    __m512i prev_incomplete = _mm512_setzero_si512();
+
+    while (src < end) {
+        __m512i input;
+        if ((src + kPerLoopBytes) <= end) {
+            input = _mm512_loadu_si512((const void *)src);
+        } else {
+            // The masked load pads the rest bytes with zeros, and never touches them.
+            __mmask64 load_mask = (~0ull) >> (kPerLoopBytes - (size_t)(end - src));
+            input = _mm512_maskz_loadu_epi8(load_mask, (const void *)src);
+        }
+
+        if (_mm512_movepi8_mask(input) == 0) {
+            error = _mm512_or_si512(error, prev_incomplete);
+            prev_incomplete = _mm512_setzero_si512();
+        } else {
+            // Move the previous 128 bit lane in, then alignr in each lane.
+            __m512i prev_lane = _mm512_alignr_epi64(input, prev_input, 6);
+            __m512i prev1 = _mm512_alignr_epi8(input, prev_lane, 16 - 1);
+            __m512i prev2 = _mm512_alignr_epi8(input, prev_lane, 16 - 2);
+            __m512i prev3 = _mm512_alignr_epi8(input, prev_lane, 16 - 3);
+
+            __m512i byte_1_high = _mm512_shuffle_epi8(byte_1_high_lookup, _mm512_and_si512(_mm512_srli_epi16(prev1, 4), mask_0F));
+            __m512i byte_1_low  = _mm512_shuffle_epi8(byte_1_low_lookup,  _mm512_and_si512(prev1, mask_0F));
+            __m512i byte_2_high = _mm512_shuffle_epi8(byte_2_high_lookup, _mm512_and_si512(_mm512_srli_epi16(input, 4), mask_0F));
+            __m512i special_cases = _mm512_and_si512(_mm512_and_si512(byte_1_high, byte_1_low), byte_2_high);
+
+            __m512i is_third_byte  = _mm512_subs_epu8(prev2, third_byte_min);
+            __m512i is_fourth_byte = _mm512_subs_epu8(prev3, fourth_byte_min);
+            __m512i must_be_2_3_continuation = _mm512_and_si512(_mm512_or_si512(is_third_byte, is_fourth_byte), mask_80);
+
+            error = _mm512_or_si512(error, _mm512_xor_si512(must_be_2_3_continuation, special_cases));
+            prev_incomplete = _mm512_subs_epu8(input, incomplete_max);
+        }
+
+        prev_input = input;
+        src += kPerLoopBytes;
+    }
+
+    error = _mm512_or_si512(error, prev_incomplete);
+    return (_mm512_test_epi8_mask(error, error) == 0);
+}
+
+#endif // UTF8_HAVE_AVX512_BW
+
+//
+// Returns true if the whole buffer is valid UTF-8, with the widest kernel
+// of the running CPU, it's resolved once by utf8_validate_dispatch().
+//
+static inline
+bool validate(const char * src, size_t len)
+{
+    return utf8_validate_dispatch(src, len);
+}
+
+#ifdef __cplusplus
+} // namespace utf8
+#endif
+
+#endif // UTF8_VALIDATE_H
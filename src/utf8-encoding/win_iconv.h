@@ -178,6 +178,224 @@ int Utf8ToAnsi(const char * pchSrc, char * pchDest, int nDestLen)
     return output_len;
 }
 
+#else // !_MSC_VER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>     // For strlen()
+
+#include <algorithm>    // For std::min()
+
+#include "utf8-encoding/utf8_utils.h"
+#include "utf8-encoding/utf8_gb18030.h"
+#include "utf8-encoding/fromutf8-sse.h"
+
+#if defined(_WIN32)
+#include <windows.h>    // WCHAR is the 16 bits wchar_t
+#else
+typedef uint16_t WCHAR;
+#endif
+
+//
+// The portable versions, "Ansi" is GB18030 (a superset of GBK, the CP_ACP
+// of the Chinese Windows). The input is converted by the buffer kernels
+// directly into pchDest, without any temporary buffer, same as the Windows
+// API, an invalid sequence is replaced by U+FFFD, a character without the
+// Ansi mapping is replaced by '?'.
+//
+// nDestLen is the size of pchDest in bytes. Returns the exact size required
+// for the whole input, in characters (char or WCHAR) including the '\0'. If
+// it's above the capacity, the output is cut before the first character that
+// doesn't fit and is still terminated by '\0'. pchDest can be NULL if nDestLen
+// is 0, to query the required size. Returns -1 if pchSrc is NULL.
+//
+
+namespace win_iconv {
+
+//
+// Convert [src, src + len) by a buffer kernel (convert), whose dest must have
+// room for (len * ratio + 16) characters, the rounds are bounded by the space
+// left in dest. The characters which the kernel stops at are converted by step(),
+// once the dest is full, the rest is only counted, through a small buffer.
+//
+template <typename CharT, typename Convert, typename Step>
+static inline
+int convert_to_buffer(const char * src, size_t len, CharT * dest, size_t capacity,
+                      size_t ratio, Convert convert, Step step)
+{
+    static const size_t kScratchSize = 256;
+    CharT scratch[kScratchSize + 16];
+
+    size_t room = (capacity > 0) ? (capacity - 1) : 0;
+    size_t written = 0;
+    size_t required = 0;
+    bool is_full = false;
+
+    while (len > 0) {
+        CharT * out = is_full ? scratch : (dest + written);
+        size_t out_room = is_full ? (kScratchSize + 16) : (room - written);
+        if (out_room >= (16 + ratio)) {
+            size_t round_len = std::min<size_t>(len, (out_room - 16) / ratio);
+            size_t consumed;
+            size_t output_len = convert(src, round_len, out, &consumed);
+            src += consumed;
+            len -= consumed;
+            required += output_len;
+            if (!is_full)
+                written += output_len;
+            if (consumed == round_len)
+                continue;
+        }
+
+        CharT chars[4];
+        size_t seq_len;
+        size_t output_len = step(src, len, chars, &seq_len);
+        if (!is_full) {
+            if (output_len <= (room - written)) {
+                for (size_t i = 0; i < output_len; i++)
+                    dest[written + i] = chars[i];
+                written += output_len;
+            } else {
+                is_full = true;
+            }
+        }
+        src += seq_len;
+        len -= seq_len;
+        required += output_len;
+    }
+
+    if (capacity > 0)
+        dest[written] = 0;
+    return (int)(required + 1);
+}
+
+// Try the kernel on the first 1 ~ 4 bytes, returns the length of the first character, or 0.
+template <typename CharT, typename Convert>
+static inline
+size_t convert_one_char(const char * src, size_t len, CharT * chars, size_t * output_len, Convert convert)
+{
+    CharT buffer[4 * 2 + 16];
+    size_t max_len = std::min<size_t>(len, 4);
+    for (size_t seq_len = 1; seq_len <= max_len; seq_len++) {
+        size_t consumed;
+        size_t n = convert(src, seq_len, buffer, &consumed);
+        if (consumed == seq_len) {
+            for (size_t i = 0; i < n; i++)
+                chars[i] = buffer[i];
+            *output_len = n;
+            return seq_len;
+        }
+    }
+    return 0;
+}
+
+static inline
+size_t utf8_to_utf16_kernel(const char * src, size_t len, uint16_t * dest, size_t * consumed)
+{
+    return fromUtf8_sse_validate(src, len, dest, consumed);
+}
+
+} // namespace win_iconv
+
+static inline
+int AnsiToUnicode(const char * pchSrc, WCHAR * pchDest, int nDestLen)
+{
+    if (pchSrc == NULL || (pchDest == NULL && nDestLen > 0)) {
+        return -1;
+    }
+
+    size_t capacity = (nDestLen > 0) ? ((size_t)nDestLen / sizeof(WCHAR)) : 0;
+    return win_iconv::convert_to_buffer(pchSrc, strlen(pchSrc), (uint16_t *)pchDest, capacity, 1,
+        gb18030_to_utf16,
+        [](const char * src, size_t len, uint16_t * chars, size_t * seq_len) -> size_t {
+            size_t output_len;
+            *seq_len = win_iconv::convert_one_char(src, len, chars, &output_len, gb18030_to_utf16);
+            if (*seq_len != 0)
+                return output_len;
+            chars[0] = 0xFFFDu;
+            *seq_len = 1;
+            return 1;
+        });
+}
+
+static inline
+int Utf8ToUnicode(const char * pchSrc, WCHAR * pchDest, int nDestLen)
+{
+    if (pchSrc == NULL || (pchDest == NULL && nDestLen > 0)) {
+        return -1;
+    }
+
+    size_t capacity = (nDestLen > 0) ? ((size_t)nDestLen / sizeof(WCHAR)) : 0;
+    return win_iconv::convert_to_buffer(pchSrc, strlen(pchSrc), (uint16_t *)pchDest, capacity, 1,
+        win_iconv::utf8_to_utf16_kernel,
+        [](const char * src, size_t len, uint16_t * chars, size_t * seq_len) -> size_t {
+            // The kernel also stops at the noncharacters, they are valid here.
+            uint32_t code_point;
+            int ret = utf8::utf8_decode_checked(src, len, &code_point);
+            if (ret <= 0) {
+                chars[0] = 0xFFFDu;
+                *seq_len = 1;
+                return 1;
+            }
+            *seq_len = (size_t)ret;
+            if (code_point <= 0xFFFFu) {
+                chars[0] = (uint16_t)code_point;
+                return 1;
+            }
+            chars[0] = (uint16_t)((code_point >> 10u) + 0xD7C0u);
+            chars[1] = (uint16_t)((code_point & 0x03FFu) + 0xDC00u);
+            return 2;
+        });
+}
+
+static inline
+int AnsiToUtf8(const char * pchSrc, char * pchDest, int nDestLen)
+{
+    if (pchSrc == NULL || (pchDest == NULL && nDestLen > 0)) {
+        return -1;
+    }
+
+    size_t capacity = (nDestLen > 0) ? (size_t)nDestLen : 0;
+    return win_iconv::convert_to_buffer(pchSrc, strlen(pchSrc), pchDest, capacity, 2,
+        gb18030_to_utf8,
+        [](const char * src, size_t len, char * chars, size_t * seq_len) -> size_t {
+            size_t output_len;
+            *seq_len = win_iconv::convert_one_char(src, len, chars, &output_len, gb18030_to_utf8);
+            if (*seq_len != 0)
+                return output_len;
+            // U+FFFD
+            chars[0] = (char)0xEFu;
+            chars[1] = (char)0xBFu;
+            chars[2] = (char)0xBDu;
+            *seq_len = 1;
+            return 3;
+        });
+}
+
+static inline
+int Utf8ToAnsi(const char * pchSrc, char * pchDest, int nDestLen)
+{
+    if (pchSrc == NULL || (pchDest == NULL && nDestLen > 0)) {
+        return -1;
+    }
+
+    size_t capacity = (nDestLen > 0) ? (size_t)nDestLen : 0;
+    return win_iconv::convert_to_buffer(pchSrc, strlen(pchSrc), pchDest, capacity, 2,
+        utf8_to_gb18030,
+        [](const char * src, size_t len, char * chars, size_t * seq_len) -> size_t {
+            size_t output_len;
+            *seq_len = win_iconv::convert_one_char(src, len, chars, &output_len, utf8_to_gb18030);
+            if (*seq_len != 0)
+                return output_len;
+            // An invalid sequence (1 byte) or a character without the mapping.
+            uint32_t code_point;
+            int ret = utf8::utf8_decode_checked(src, len, &code_point);
+            chars[0] = '?';
+            *seq_len = (ret > 0) ? (size_t)ret : 1;
+            return 1;
+        });
+}
+
 #endif // _MSC_VER
 
 #endif // WIN_ICONV_H
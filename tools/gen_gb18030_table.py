@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+#
+# Generate src/utf8-encoding/utf8_gb18030_table.h from the GB18030 mapping
+# of the glibc iconv(), so the tables convert the same as iconv().
+#
+# Usage: python3 tools/gen_gb18030_table.py > src/utf8-encoding/utf8_gb18030_table.h
+#
+
+import ctypes
+import ctypes.util
+import struct
+import sys
+
+libc = ctypes.CDLL(ctypes.util.find_library('c'), use_errno=True)
+libc.iconv_open.restype = ctypes.c_void_p
+libc.iconv_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+libc.iconv.restype = ctypes.c_size_t
+libc.iconv.argtypes = [ctypes.c_void_p,
+                       ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_size_t),
+                       ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_size_t)]
+
+cd = libc.iconv_open(b'UTF-32LE', b'GB18030')
+if cd == ctypes.c_void_p(-1).value:
+    sys.exit('iconv_open() failed')
+
+out_buf = ctypes.create_string_buffer(16)
+
+def decode(seq):
+    """Returns the code point of a GB18030 sequence, or None if it's invalid."""
+    libc.iconv(cd, None, None, None, None)
+    in_buf = ctypes.c_char_p(seq)
+    in_left = ctypes.c_size_t(len(seq))
+    out_ptr = ctypes.c_char_p(ctypes.addressof(out_buf))
+    out_left = ctypes.c_size_t(16)
+    ret = libc.iconv(cd, ctypes.byref(in_buf), ctypes.byref(in_left),
+                     ctypes.byref(out_ptr), ctypes.byref(out_left))
+    if ret == ctypes.c_size_t(-1).value or in_left.value != 0 or out_left.value != 12:
+        return None
+    return struct.unpack('<I', out_buf.raw[:4])[0]
+
+def index_to_4bytes(index):
+    b3 = 0x30 + index % 10; index //= 10
+    b2 = 0x81 + index % 126; index //= 126
+    b1 = 0x30 + index % 10; index //= 10
+    return bytes([0x81 + index, b1, b2, b3])
+
+# The 2 bytes sequences, [lead - 0x81][trail - 0x40], the supplementary code
+# points are stored as 0xD800 + their index in the supplementary list.
+two_bytes = [[0] * 192 for _ in range(126)]
+supplementary = []
+encode_2bytes = {}
+for lead in range(0x81, 0xFF):
+    for trail in range(0x40, 0xFF):
+        if trail == 0x7F:
+            continue
+        cp = decode(bytes([lead, trail]))
+        if cp is None:
+            continue
+        if cp > 0xFFFF:
+            two_bytes[lead - 0x81][trail - 0x40] = 0xD800 + len(supplementary)
+            supplementary.append((cp, (lead << 8) | trail))
+        else:
+            assert not (0xD800 <= cp < 0xE000)
+            two_bytes[lead - 0x81][trail - 0x40] = cp
+        encode_2bytes[cp] = (lead << 8) | trail
+
+# The 4 bytes sequences of BMP, the runs of the consecutive code points.
+ranges = []
+for index in range(39420):
+    cp = decode(index_to_4bytes(index))
+    if cp is None:
+        continue
+    assert cp not in encode_2bytes
+    if ranges and ranges[-1][0] + ranges[-1][2] == index and ranges[-1][1] + ranges[-1][2] == cp:
+        ranges[-1][2] += 1
+    else:
+        ranges.append([index, cp, 1])
+
+# The Unicode (BMP) to the 2 bytes sequences, 256 code points per page,
+# the pages without any 2 bytes sequence share the empty page 0.
+pages = [[0] * 256]
+page_index = [0] * 256
+for cp, code in sorted(encode_2bytes.items()):
+    if cp > 0xFFFF:
+        continue
+    if page_index[cp >> 8] == 0:
+        page_index[cp >> 8] = len(pages)
+        pages.append([0] * 256)
+    pages[page_index[cp >> 8]][cp & 0xFF] = code
+
+def emit_array(values, per_line, fmt, indent='    '):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append(indent + ', '.join(fmt % v for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+out = sys.stdout
+out.write('''#ifndef UTF8_GB18030_TABLE_H
+#define UTF8_GB18030_TABLE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+//
+// The GB18030 mapping tables, generated by tools/gen_gb18030_table.py from
+// the glibc iconv(), only included by utf8_gb18030.cc.
+//
+
+#include <stdint.h>
+
+#define GB18030_SUPPLEMENTARY_2BYTES    %d
+#define GB18030_4BYTES_RANGES           %d
+#define GB18030_ENCODE_PAGES            %d
+
+namespace utf8 {
+
+struct gb18030_range_t {
+    uint16_t index;         // The linear index of the first 4 bytes sequence
+    uint16_t code_point;    // The first code point
+    uint16_t count;
+};
+
+''' % (len(supplementary), len(ranges), len(pages)))
+
+out.write('// The code points of the 2 bytes sequences, [lead - 0x81][trail - 0x40], 0 is invalid,\n')
+out.write('// [0xD800, 0xDFFF] is the index of gb18030_supplementary_2bytes[].\n')
+out.write('static const uint16_t gb18030_2bytes_table[126][192] = {\n')
+for lead in range(126):
+    out.write('    { // 0x%02X\n' % (lead + 0x81))
+    out.write(emit_array(two_bytes[lead], 12, '0x%04X', '        ') + '\n')
+    out.write('    },\n')
+out.write('};\n\n')
+
+out.write('// The 2 bytes sequences of the supplementary code points.\n')
+out.write('static const uint32_t gb18030_supplementary_2bytes[GB18030_SUPPLEMENTARY_2BYTES][2] = {\n')
+out.write(emit_array(['{ 0x%05X, 0x%04X }' % s for s in supplementary], 3, '%s') + '\n')
+out.write('};\n\n')
+
+out.write('// The 4 bytes sequences of BMP, ordered by the index.\n')
+out.write('static const gb18030_range_t gb18030_4bytes_ranges[GB18030_4BYTES_RANGES] = {\n')
+out.write(emit_array(['{ %5d, 0x%04X, %5d }' % tuple(r) for r in ranges], 4, '%s') + '\n')
+out.write('};\n\n')
+
+ranges_by_cp = sorted(ranges, key=lambda r: r[1])
+out.write('// Same as gb18030_4bytes_ranges[], ordered by the code point.\n')
+out.write('static const gb18030_range_t gb18030_4bytes_ranges_by_code_point[GB18030_4BYTES_RANGES] = {\n')
+out.write(emit_array(['{ %5d, 0x%04X, %5d }' % tuple(r) for r in ranges_by_cp], 4, '%s') + '\n')
+out.write('};\n\n')
+
+out.write('// The page of a code point (BMP) in gb18030_encode_pages[], [code_point >> 8].\n')
+out.write('static const uint8_t gb18030_encode_page_index[256] = {\n')
+out.write(emit_array(page_index, 16, '%3d') + '\n')
+out.write('};\n\n')
+
+out.write('// The 2 bytes sequences of the code points, [page][code_point & 0xFF], 0 is none.\n')
+out.write('static const uint16_t gb18030_encode_pages[GB18030_ENCODE_PAGES][256] = {\n')
+for i, page in enumerate(pages):
+    owner = [p for p in range(256) if page_index[p] == i and i != 0]
+    out.write('    { // %s\n' % (('U+%02Xxx' % owner[0]) if owner else 'empty'))
+    out.write(emit_array(page, 12, '0x%04X', '        ') + '\n')
+    out.write('    },\n')
+out.write('};\n\n')
+
+out.write('''} // namespace utf8
+
+#endif // UTF8_GB18030_TABLE_H
+''')